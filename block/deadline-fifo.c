@@ -0,0 +1,206 @@
+/*
+ * Deadline FIFO core shared by the SIO and Zen I/O schedulers.
+ * Based on the deadline I/O scheduler.
+ *
+ * See block/deadline-fifo.h
+ */
+#include <linux/kernel.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/rbtree.h>
+
+#include "deadline-fifo.h"
+
+static inline struct rb_root *
+dfifo_rb_root(struct dfifo_data *dd, struct request *rq)
+{
+	return &dd->sort_list[rq_data_dir(rq)];
+}
+
+/*
+ * get the request after `rq' in sector-sorted order
+ */
+static inline struct request *
+dfifo_latter_request(struct request *rq)
+{
+	struct rb_node *node = rb_next(&rq->rb_node);
+
+	if (node)
+		return rb_entry_rq(node);
+
+	return NULL;
+}
+
+static void dfifo_del_rq_rb(struct dfifo_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	if (dd->next_rq[data_dir] == rq)
+		dd->next_rq[data_dir] = dfifo_latter_request(rq);
+
+	elv_rb_del(dfifo_rb_root(dd, rq), rq);
+}
+
+/*
+ * remove rq from rbtree and fifo.
+ */
+static void dfifo_remove_request(struct dfifo_data *dd, struct request *rq)
+{
+	rq_fifo_clear(rq);
+	dfifo_del_rq_rb(dd, rq);
+}
+
+struct dfifo_data *dfifo_alloc(struct request_queue *q)
+{
+	struct dfifo_data *dd;
+	int sync;
+
+	dd = kmalloc_node(sizeof(*dd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!dd)
+		return NULL;
+
+	for (sync = DFIFO_ASYNC; sync <= DFIFO_SYNC; sync++) {
+		INIT_LIST_HEAD(&dd->fifo_list[sync][READ]);
+		INIT_LIST_HEAD(&dd->fifo_list[sync][WRITE]);
+	}
+	dd->sort_list[READ] = RB_ROOT;
+	dd->sort_list[WRITE] = RB_ROOT;
+
+	return dd;
+}
+EXPORT_SYMBOL_GPL(dfifo_alloc);
+
+void dfifo_exit_queue(struct elevator_queue *e)
+{
+	struct dfifo_data *dd = e->elevator_data;
+
+	BUG_ON(!list_empty(&dd->fifo_list[DFIFO_SYNC][READ]));
+	BUG_ON(!list_empty(&dd->fifo_list[DFIFO_SYNC][WRITE]));
+	BUG_ON(!list_empty(&dd->fifo_list[DFIFO_ASYNC][READ]));
+	BUG_ON(!list_empty(&dd->fifo_list[DFIFO_ASYNC][WRITE]));
+
+	kfree(dd);
+}
+EXPORT_SYMBOL_GPL(dfifo_exit_queue);
+
+/*
+ * Back merges are found by the elevator through its request hash; look
+ * up front merges in the sector sorted tree.
+ */
+int dfifo_merge(struct request_queue *q, struct request **req,
+		struct bio *bio)
+{
+	struct dfifo_data *dd = q->elevator->elevator_data;
+	sector_t sector = bio->bi_sector + bio_sectors(bio);
+	struct request *__rq;
+
+	__rq = elv_rb_find(&dd->sort_list[bio_data_dir(bio)], sector);
+	if (__rq) {
+		BUG_ON(sector != blk_rq_pos(__rq));
+
+		if (elv_rq_merge_ok(__rq, bio)) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+EXPORT_SYMBOL_GPL(dfifo_merge);
+
+void dfifo_merged_request(struct request_queue *q, struct request *req,
+			  int type)
+{
+	struct dfifo_data *dd = q->elevator->elevator_data;
+
+	/*
+	 * if the merge was a front merge, we need to reposition request
+	 */
+	if (type == ELEVATOR_FRONT_MERGE) {
+		elv_rb_del(dfifo_rb_root(dd, req), req);
+		elv_rb_add(dfifo_rb_root(dd, req), req);
+	}
+}
+EXPORT_SYMBOL_GPL(dfifo_merged_request);
+
+void dfifo_merged_requests(struct request_queue *q, struct request *rq,
+			   struct request *next)
+{
+	struct dfifo_data *dd = q->elevator->elevator_data;
+
+	/*
+	 * if next expires before rq, assign its expire time to rq
+	 * and move into next position (next will be deleted) in fifo
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist)) {
+		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+			list_move(&rq->queuelist, &next->queuelist);
+			rq_set_fifo_time(rq, rq_fifo_time(next));
+		}
+	}
+
+	/* next request is gone */
+	dfifo_remove_request(dd, next);
+}
+EXPORT_SYMBOL_GPL(dfifo_merged_requests);
+
+void dfifo_add_request(struct request_queue *q, struct request *rq)
+{
+	struct dfifo_data *dd = q->elevator->elevator_data;
+	const int sync = rq_is_sync(rq);
+	const int data_dir = rq_data_dir(rq);
+
+	elv_rb_add(dfifo_rb_root(dd, rq), rq);
+
+	rq_set_fifo_time(rq, jiffies + dd->fifo_expire[sync][data_dir]);
+	list_add_tail(&rq->queuelist, &dd->fifo_list[sync][data_dir]);
+}
+EXPORT_SYMBOL_GPL(dfifo_add_request);
+
+/*
+ * Return the next request of the running batch, or NULL if the batch is
+ * over (or there is none) and the scheduler has to choose a request.
+ */
+struct request *dfifo_batch_next(struct dfifo_data *dd)
+{
+	struct request *rq;
+
+	/* batches are reads XOR writes */
+	rq = dd->next_rq[WRITE] ? dd->next_rq[WRITE] : dd->next_rq[READ];
+	if (rq && dd->batching < dd->fifo_batch)
+		return rq;
+
+	dd->batching = 0;
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(dfifo_batch_next);
+
+/*
+ * Move rq to the dispatch queue; the requests following it in sector
+ * order make up the rest of its batch.
+ */
+void dfifo_dispatch(struct dfifo_data *dd, struct request *rq)
+{
+	const int data_dir = rq_data_dir(rq);
+
+	dd->next_rq[READ] = NULL;
+	dd->next_rq[WRITE] = NULL;
+	dd->next_rq[data_dir] = dfifo_latter_request(rq);
+
+	dfifo_remove_request(dd, rq);
+	elv_dispatch_add_tail(rq->q, rq);
+
+	dd->batching++;
+
+	if (data_dir == WRITE)
+		dd->starved = 0;
+	else
+		dd->starved++;
+}
+EXPORT_SYMBOL_GPL(dfifo_dispatch);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Deadline FIFO core for I/O schedulers");
@@ -0,0 +1,80 @@
+/*
+ * Deadline FIFO core shared by the SIO and Zen I/O schedulers.
+ *
+ * Requests are kept on a FIFO per (sync, data direction) pair, each
+ * with its own expiry time, and on a sector sorted rbtree per data
+ * direction. The rbtree gives front merge lookups, correct former/latter
+ * requests for request merging and sector-sorted batches: once a
+ * scheduler picked a request, up to fifo_batch requests following it in
+ * sector order are dispatched before the scheduler is asked again.
+ *
+ * The elevator_data of a scheduler using the core must be the
+ * struct dfifo_data returned by dfifo_alloc().
+ */
+#ifndef _DEADLINE_FIFO_H
+#define _DEADLINE_FIFO_H
+
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/rbtree.h>
+
+enum { DFIFO_ASYNC, DFIFO_SYNC };
+
+struct dfifo_data {
+	/* requests are present on both fifo_list and sort_list */
+	struct list_head fifo_list[2][2];	/* [sync][data_dir] */
+	struct rb_root sort_list[2];		/* [data_dir] */
+
+	/* next in sort order of the running batch, or NULL */
+	struct request *next_rq[2];
+	unsigned int batching;		/* requests dispatched in the batch */
+	unsigned int starved;		/* times reads have starved writes */
+
+	/* tunables */
+	int fifo_expire[2][2];		/* [sync][data_dir], in jiffies */
+	int fifo_batch;
+	int writes_starved;
+};
+
+struct dfifo_data *dfifo_alloc(struct request_queue *q);
+void dfifo_exit_queue(struct elevator_queue *e);
+
+/* elevator callbacks */
+int dfifo_merge(struct request_queue *q, struct request **req,
+		struct bio *bio);
+void dfifo_merged_request(struct request_queue *q, struct request *req,
+			  int type);
+void dfifo_merged_requests(struct request_queue *q, struct request *rq,
+			   struct request *next);
+void dfifo_add_request(struct request_queue *q, struct request *rq);
+
+/* dispatch helpers */
+struct request *dfifo_batch_next(struct dfifo_data *dd);
+void dfifo_dispatch(struct dfifo_data *dd, struct request *rq);
+
+static inline struct request *
+dfifo_head(struct dfifo_data *dd, int sync, int data_dir)
+{
+	struct list_head *list = &dd->fifo_list[sync][data_dir];
+
+	if (list_empty(list))
+		return NULL;
+
+	return rq_entry_fifo(list->next);
+}
+
+/*
+ * Return the oldest request of the given fifo if it has expired.
+ */
+static inline struct request *
+dfifo_expired(struct dfifo_data *dd, int sync, int data_dir)
+{
+	struct request *rq = dfifo_head(dd, sync, data_dir);
+
+	if (rq && time_after(jiffies, rq_fifo_time(rq)))
+		return rq;
+
+	return NULL;
+}
+
+#endif /* _DEADLINE_FIFO_H */
@@ -26,6 +26,7 @@
 #include <linux/compiler.h>
 #include <linux/blktrace_api.h>
 #include <linux/jiffies.h>
+#include <linux/bitops.h>
 
 /*
  * enum row_queue_prio - Priorities of the ROW queues
@@ -55,36 +56,81 @@ enum row_queue_prio {
  *			in a dispatch cycle
  * @is_urgent: Flags indicating whether the queue can notify on
  *			urgent requests
+ * @target_us: Target completion latency (usec) used in latency
+ *			mode, 0 if the queue has no target
  *
  */
 struct row_queue_params {
 	bool idling_enabled;
 	int quantum;
 	bool is_urgent;
+	int target_us;
 };
 
 /*
  * This array holds the default values of the different configurables
  * for each ROW queue. Each row of the array holds the following values:
- * {idling_enabled, quantum, is_urgent}
+ * {idling_enabled, quantum, is_urgent, target_us}
  * Each row corresponds to a queue with the same index (according to
  * enum row_queue_prio)
  */
 static const struct row_queue_params row_queues_def[] = {
-/* idling_enabled, quantum, is_urgent */
-	{true, 100, true},	/* ROWQ_PRIO_HIGH_READ */
-	{true, 75, true},	/* ROWQ_PRIO_REG_READ */
-	{false, 5, false},	/* ROWQ_PRIO_HIGH_SWRITE */
-	{false, 4, false},	/* ROWQ_PRIO_REG_SWRITE */
-	{false, 4, false},	/* ROWQ_PRIO_REG_WRITE */
-	{false, 3, false},	/* ROWQ_PRIO_LOW_READ */
-	{false, 2, false}	/* ROWQ_PRIO_LOW_SWRITE */
+/* idling_enabled, quantum, is_urgent, target_us */
+	{true, 100, true, 10000},	/* ROWQ_PRIO_HIGH_READ */
+	{true, 75, true, 20000},	/* ROWQ_PRIO_REG_READ */
+	{false, 5, false, 50000},	/* ROWQ_PRIO_HIGH_SWRITE */
+	{false, 4, false, 100000},	/* ROWQ_PRIO_REG_SWRITE */
+	{false, 4, false, 200000},	/* ROWQ_PRIO_REG_WRITE */
+	{false, 3, false, 0},		/* ROWQ_PRIO_LOW_READ */
+	{false, 2, false, 0}		/* ROWQ_PRIO_LOW_SWRITE */
 };
 
 /* Default values for idling on read queues (in msec) */
 #define ROW_IDLE_TIME_MSEC 10
 #define ROW_READ_FREQ_MSEC 25
 
+/*
+ * Latency accounting: latencies are kept in log2 usec buckets (bucket i
+ * counts latencies in [2^(i-1), 2^i) usec, the last bucket everything
+ * above). Every ROW_LAT_WINDOW completions on a queue the percentiles are
+ * recomputed, the buckets are halved so that old samples fade out and,
+ * in latency mode, the dispatch quantum of the queue is adapted. Adapted
+ * quanta stay within ROW_LAT_QUANTUM_SCALE times the default quantum.
+ */
+#define ROW_LAT_BUCKETS		24
+#define ROW_LAT_WINDOW		64
+#define ROW_LAT_QUANTUM_SCALE	4
+
+/**
+ * struct rowq_lat_hist - latency histogram
+ * @bucket:	log2 usec buckets
+ * @p50:	median latency (usec) at the last update
+ * @p99:	99th percentile latency (usec) at the last update
+ *
+ */
+struct rowq_lat_hist {
+	unsigned int		bucket[ROW_LAT_BUCKETS];
+	unsigned int		p50;
+	unsigned int		p99;
+};
+
+/**
+ * struct rowq_lat_data - latency accounting of a queue
+ * @dispatch:		insertion to dispatch latency
+ * @complete:		insertion to completion latency
+ * @target_us:		target completion latency (usec), 0 for none
+ * @base_quantum:	dispatch quantum when latency mode was enabled
+ * @nr_completed:	completions since the last update
+ *
+ */
+struct rowq_lat_data {
+	struct rowq_lat_hist	dispatch;
+	struct rowq_lat_hist	complete;
+	int			target_us;
+	int			base_quantum;
+	unsigned int		nr_completed;
+};
+
 /**
  * struct rowq_idling_data -  parameters for idling on the queue
  * @last_insert_time:	time the last request was inserted
@@ -109,6 +155,7 @@ struct rowq_idling_data {
  * @dispatch quantum:	number of requests this queue may
  *			dispatch in a dispatch cycle
  * @idle_data:		data for idling on queues
+ * @lat:		latency accounting
  *
  */
 struct row_queue {
@@ -124,6 +171,8 @@ struct row_queue {
 
 	/* used only for READ queues */
 	struct rowq_idling_data	idle_data;
+
+	struct rowq_lat_data	lat;
 };
 
 /**
@@ -153,6 +202,8 @@ struct idling_data {
  *			scheduler, nr_reqs[1] holds the number of all WRITE
  *			requests in scheduler
  * @cycle_flags:	used for marking unserved queueus
+ * @lat_mode:		adapt dispatch quanta to the queues' target
+ *			completion latencies
  *
  */
 struct row_data {
@@ -166,10 +217,21 @@ struct row_data {
 	unsigned int			nr_reqs[2];
 
 	unsigned int			cycle_flags;
+
+	int				lat_mode;
 };
 
 #define RQ_ROWQ(rq) ((struct row_queue *) ((rq)->elevator_private[0]))
 
+/*
+ * Insertion timestamp (usec) of a request, only taken in latency mode
+ * and 0 otherwise. It is only ever subtracted from a later timestamp,
+ * so truncation to unsigned long is fine.
+ */
+#define RQ_INSERT_US(rq) ((unsigned long) ((rq)->elevator_private[1]))
+#define RQ_SET_INSERT_US(rq, us) \
+	((rq)->elevator_private[1] = (void *)(unsigned long)(us))
+
 #define row_log(q, fmt, args...)   \
 	blk_add_trace_msg(q, "%s():" fmt , __func__, ##args)
 #define row_log_rowq(rdata, rowq_id, fmt, args...)		\
@@ -207,6 +269,88 @@ static inline void __maybe_unused row_dump_queues_stat(struct row_data *rd)
 }
 
 /******************** Static helper functions ***********************/
+static inline unsigned long row_now_us(void)
+{
+	return (unsigned long)ktime_to_us(ktime_get());
+}
+
+static void row_lat_hist_add(struct rowq_lat_hist *hist, unsigned long us)
+{
+	int i = fls_long(us);
+
+	if (i >= ROW_LAT_BUCKETS)
+		i = ROW_LAT_BUCKETS - 1;
+	hist->bucket[i]++;
+}
+
+/*
+ * row_lat_hist_update() - Recompute the percentiles of a histogram
+ * @hist:	histogram to update
+ *
+ * Percentiles are reported as the upper bound of the bucket they fall
+ * in. The buckets are halved afterwards so that the next update mostly
+ * reflects the requests completed since this one.
+ */
+static void row_lat_hist_update(struct rowq_lat_hist *hist)
+{
+	unsigned int total = 0, sum = 0;
+	unsigned int p50_cnt, p99_cnt;
+	int i;
+
+	for (i = 0; i < ROW_LAT_BUCKETS; i++)
+		total += hist->bucket[i];
+	if (!total)
+		return;
+
+	p50_cnt = DIV_ROUND_UP(total * 50, 100);
+	p99_cnt = DIV_ROUND_UP(total * 99, 100);
+	hist->p50 = hist->p99 = 0;
+	for (i = 0; i < ROW_LAT_BUCKETS; i++) {
+		sum += hist->bucket[i];
+		if (!hist->p50 && sum >= p50_cnt)
+			hist->p50 = 1U << i;
+		if (!hist->p99 && sum >= p99_cnt)
+			hist->p99 = 1U << i;
+		hist->bucket[i] >>= 1;
+	}
+}
+
+/*
+ * row_lat_adapt() - Adapt the dispatch quantum of a queue to its target
+ * @rd:		pointer to struct row_data
+ * @rqueue:	queue whose percentiles were just updated
+ *
+ * A queue missing its target (p99 above it) gets a quarter more
+ * requests per dispatch cycle; a queue comfortably within it (p99 below
+ * half of it) gives an eighth back, so the share freed by a fast device
+ * goes to the other queues.
+ */
+static void row_lat_adapt(struct row_data *rd, struct row_queue *rqueue)
+{
+	int def = row_queues_def[rqueue->prio].quantum;
+	int max_quantum = def * ROW_LAT_QUANTUM_SCALE;
+	int min_quantum = max(def / ROW_LAT_QUANTUM_SCALE, 1);
+	unsigned int p99 = rqueue->lat.complete.p99;
+	int target = rqueue->lat.target_us;
+	int quantum = rqueue->disp_quantum;
+
+	if (!rd->lat_mode || target <= 0)
+		return;
+
+	if (p99 > target)
+		quantum += quantum / 4 + 1;
+	else if (p99 < target / 2)
+		quantum -= max(quantum / 8, 1);
+
+	quantum = clamp(quantum, min_quantum, max_quantum);
+	if (quantum != rqueue->disp_quantum) {
+		row_log_rowq(rd, rqueue->prio,
+			"p99=%uus target=%dus: quantum %d -> %d", p99, target,
+			rqueue->disp_quantum, quantum);
+		rqueue->disp_quantum = quantum;
+	}
+}
+
 /*
  * kick_queue() - Wake up device driver queue thread
  * @work:	pointer to struct work_struct
@@ -281,6 +425,8 @@ static void row_add_request(struct request_queue *q,
 	rd->nr_reqs[rq_data_dir(rq)]++;
 	rqueue->nr_req++;
 	rq_set_fifo_time(rq, jiffies); /* for statistics*/
+	if (rd->lat_mode)
+		RQ_SET_INSERT_US(rq, row_now_us());
 
 	if (row_queues_def[rqueue->prio].idling_enabled) {
 		if (delayed_work_pending(&rd->read_idle.idle_work))
@@ -396,6 +542,9 @@ static void row_dispatch_insert(struct row_data *rd)
 	rq = rq_entry_fifo(rd->row_queues[rd->curr_queue].fifo.next);
 	row_remove_request(rd->dispatch_queue, rq);
 	elv_dispatch_add_tail(rd->dispatch_queue, rq);
+	if (RQ_INSERT_US(rq))
+		row_lat_hist_add(&rd->row_queues[rd->curr_queue].lat.dispatch,
+				 row_now_us() - RQ_INSERT_US(rq));
 	rd->row_queues[rd->curr_queue].nr_dispatched++;
 	row_clear_rowq_unserved(rd, rd->curr_queue);
 	row_log_rowq(rd, rd->curr_queue, " Dispatched request nr_disp = %d",
@@ -435,6 +584,32 @@ static int row_choose_queue(struct row_data *rd)
 	return 1;
 }
 
+/*
+ * row_completed_request() - Account the latency of a completed request
+ * @q:		requests queue
+ * @rq:		completed request
+ *
+ */
+static void row_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct row_data *rd = q->elevator->elevator_data;
+	struct row_queue *rqueue = RQ_ROWQ(rq);
+
+	/* inserted while latency mode was off */
+	if (!RQ_INSERT_US(rq))
+		return;
+
+	row_lat_hist_add(&rqueue->lat.complete,
+			 row_now_us() - RQ_INSERT_US(rq));
+	if (++rqueue->lat.nr_completed < ROW_LAT_WINDOW)
+		return;
+
+	rqueue->lat.nr_completed = 0;
+	row_lat_hist_update(&rqueue->lat.dispatch);
+	row_lat_hist_update(&rqueue->lat.complete);
+	row_lat_adapt(rd, rqueue);
+}
+
 /*
  * row_dispatch_requests() - selects the next request to dispatch
  * @q:		requests queue
@@ -549,6 +724,8 @@ static void *row_init_queue(struct request_queue *q)
 		rdata->row_queues[i].idle_data.begin_idling = false;
 		rdata->row_queues[i].idle_data.last_insert_time =
 			ktime_set(0, 0);
+		rdata->row_queues[i].lat.target_us =
+			row_queues_def[i].target_us;
 	}
 
 	/*
@@ -693,6 +870,21 @@ SHOW_FUNCTION(row_lp_swrite_quantum_show,
 	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum, 0);
 SHOW_FUNCTION(row_read_idle_show, rowd->read_idle.idle_time, 0);
 SHOW_FUNCTION(row_read_idle_freq_show, rowd->read_idle.freq, 0);
+SHOW_FUNCTION(row_hp_read_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_HIGH_READ].lat.target_us, 0);
+SHOW_FUNCTION(row_rp_read_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_REG_READ].lat.target_us, 0);
+SHOW_FUNCTION(row_hp_swrite_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_HIGH_SWRITE].lat.target_us, 0);
+SHOW_FUNCTION(row_rp_swrite_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_REG_SWRITE].lat.target_us, 0);
+SHOW_FUNCTION(row_rp_write_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_REG_WRITE].lat.target_us, 0);
+SHOW_FUNCTION(row_lp_read_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_LOW_READ].lat.target_us, 0);
+SHOW_FUNCTION(row_lp_swrite_target_us_show,
+	rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].lat.target_us, 0);
+SHOW_FUNCTION(row_latency_mode_show, rowd->lat_mode, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -711,31 +903,127 @@ static ssize_t __FUNC(struct elevator_queue *e,				\
 	*(__PTR) = __data;						\
 	return ret;							\
 }
-STORE_FUNCTION(row_hp_read_quantum_store,
-&rowd->row_queues[ROWQ_PRIO_HIGH_READ].disp_quantum, 1, INT_MAX, 0);
-STORE_FUNCTION(row_rp_read_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_REG_READ].disp_quantum,
-			1, INT_MAX, 0);
-STORE_FUNCTION(row_hp_swrite_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_HIGH_SWRITE].disp_quantum,
-			1, INT_MAX, 0);
-STORE_FUNCTION(row_rp_swrite_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_REG_SWRITE].disp_quantum,
-			1, INT_MAX, 0);
-STORE_FUNCTION(row_rp_write_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_REG_WRITE].disp_quantum,
-			1, INT_MAX, 0);
-STORE_FUNCTION(row_lp_read_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_LOW_READ].disp_quantum,
-			1, INT_MAX, 0);
-STORE_FUNCTION(row_lp_swrite_quantum_store,
-			&rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].disp_quantum,
-			1, INT_MAX, 1);
 STORE_FUNCTION(row_read_idle_store, &rowd->read_idle.idle_time, 1, INT_MAX, 0);
 STORE_FUNCTION(row_read_idle_freq_store, &rowd->read_idle.freq, 1, INT_MAX, 0);
+STORE_FUNCTION(row_hp_read_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_HIGH_READ].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_rp_read_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_REG_READ].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_hp_swrite_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_HIGH_SWRITE].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_rp_swrite_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_REG_SWRITE].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_rp_write_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_REG_WRITE].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_lp_read_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_LOW_READ].lat.target_us,
+			0, INT_MAX, 0);
+STORE_FUNCTION(row_lp_swrite_target_us_store,
+			&rowd->row_queues[ROWQ_PRIO_LOW_SWRITE].lat.target_us,
+			0, INT_MAX, 0);
 
 #undef STORE_FUNCTION
 
+/*
+ * In latency mode the quanta are adapted from the base quanta, which
+ * are restored when the mode is disabled, so a quantum written then
+ * becomes the base quantum as well.
+ */
+static ssize_t row_quantum_store(struct row_data *rowd, int prio,
+				 const char *page, size_t count)
+{
+	struct row_queue *rqueue = &rowd->row_queues[prio];
+	int quantum;
+
+	row_var_store(&quantum, page, count);
+	quantum = max(quantum, 1);
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	rqueue->disp_quantum = quantum;
+	if (rowd->lat_mode)
+		rqueue->lat.base_quantum = quantum;
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	return count;
+}
+
+#define QUANTUM_STORE_FUNCTION(__FUNC, __PRIO)				\
+static ssize_t __FUNC(struct elevator_queue *e,				\
+		const char *page, size_t count)				\
+{									\
+	return row_quantum_store(e->elevator_data, (__PRIO), page, count); \
+}
+QUANTUM_STORE_FUNCTION(row_hp_read_quantum_store, ROWQ_PRIO_HIGH_READ);
+QUANTUM_STORE_FUNCTION(row_rp_read_quantum_store, ROWQ_PRIO_REG_READ);
+QUANTUM_STORE_FUNCTION(row_hp_swrite_quantum_store, ROWQ_PRIO_HIGH_SWRITE);
+QUANTUM_STORE_FUNCTION(row_rp_swrite_quantum_store, ROWQ_PRIO_REG_SWRITE);
+QUANTUM_STORE_FUNCTION(row_rp_write_quantum_store, ROWQ_PRIO_REG_WRITE);
+QUANTUM_STORE_FUNCTION(row_lp_read_quantum_store, ROWQ_PRIO_LOW_READ);
+QUANTUM_STORE_FUNCTION(row_lp_swrite_quantum_store, ROWQ_PRIO_LOW_SWRITE);
+#undef QUANTUM_STORE_FUNCTION
+
+/*
+ * Enabling latency mode remembers the current quanta as the starting
+ * point for adaptation; disabling it restores them.
+ */
+static ssize_t row_latency_mode_store(struct elevator_queue *e,
+		const char *page, size_t count)
+{
+	struct row_data *rowd = e->elevator_data;
+	int enable, i;
+
+	row_var_store(&enable, page, count);
+	enable = !!enable;
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	if (enable != rowd->lat_mode) {
+		for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+			struct row_queue *rqueue = &rowd->row_queues[i];
+
+			if (enable)
+				rqueue->lat.base_quantum = rqueue->disp_quantum;
+			else
+				rqueue->disp_quantum = rqueue->lat.base_quantum;
+		}
+		rowd->lat_mode = enable;
+	}
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	return count;
+}
+
+static ssize_t row_latency_stats_show(struct elevator_queue *e, char *page)
+{
+	struct row_data *rowd = e->elevator_data;
+	ssize_t len;
+	int i;
+
+	len = scnprintf(page, PAGE_SIZE, "queue disp_p50 disp_p99 "
+			"compl_p50 compl_p99 target quantum\n");
+
+	spin_lock_irq(rowd->dispatch_queue->queue_lock);
+	for (i = 0; i < ROWQ_MAX_PRIO; i++) {
+		struct row_queue *rqueue = &rowd->row_queues[i];
+
+		len += scnprintf(page + len, PAGE_SIZE - len,
+				 "rowq%d %u %u %u %u %d %d\n", i,
+				 rqueue->lat.dispatch.p50,
+				 rqueue->lat.dispatch.p99,
+				 rqueue->lat.complete.p50,
+				 rqueue->lat.complete.p99,
+				 rqueue->lat.target_us,
+				 rqueue->disp_quantum);
+	}
+	spin_unlock_irq(rowd->dispatch_queue->queue_lock);
+
+	return len;
+}
+
 #define ROW_ATTR(name) \
 	__ATTR(name, S_IRUGO|S_IWUSR, row_##name##_show, \
 				      row_##name##_store)
@@ -750,6 +1038,15 @@ static struct elv_fs_entry row_attrs[] = {
 	ROW_ATTR(lp_swrite_quantum),
 	ROW_ATTR(read_idle),
 	ROW_ATTR(read_idle_freq),
+	ROW_ATTR(hp_read_target_us),
+	ROW_ATTR(rp_read_target_us),
+	ROW_ATTR(hp_swrite_target_us),
+	ROW_ATTR(rp_swrite_target_us),
+	ROW_ATTR(rp_write_target_us),
+	ROW_ATTR(lp_read_target_us),
+	ROW_ATTR(lp_swrite_target_us),
+	ROW_ATTR(latency_mode),
+	__ATTR(latency_stats, S_IRUGO, row_latency_stats_show, NULL),
 	__ATTR_NULL
 };
 
@@ -757,6 +1054,7 @@ static struct elevator_type iosched_row = {
 	.ops = {
 		.elevator_merge_req_fn		= row_merged_requests,
 		.elevator_dispatch_fn		= row_dispatch_requests,
+		.elevator_completed_req_fn	= row_completed_request,
 		.elevator_add_req_fn		= row_add_request,
 		.elevator_reinsert_req_fn	= row_reinsert_req,
 		.elevator_is_urgent_fn		= row_urgent_pending,
@@ -5,9 +5,11 @@
  * Copyright (C) 2012 Miguel Boton <mboton@lowlevel-studios.com>
  *
  *
- * This algorithm does not do any kind of sorting, as it is aimed for
- * aleatory access devices, but it does some basic merging. We try to
- * keep minimum overhead to achieve low latency.
+ * This algorithm is aimed for aleatory access devices: requests are
+ * chosen from their fifos, only the batch following a chosen request is
+ * dispatched in sector order. We try to keep minimum overhead to achieve
+ * low latency. The fifos, merging and batching live in the deadline fifo
+ * core (block/deadline-fifo.c).
  *
  * Asynchronous and synchronous requests are not treated separately, but
  * we relay on deadlines to ensure fairness.
@@ -18,12 +20,8 @@
 #include <linux/bio.h>
 #include <linux/module.h>
 #include <linux/init.h>
-#include <linux/version.h>
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
-#include <linux/slab.h>
-#endif
 
-enum { ASYNC, SYNC };
+#include "deadline-fifo.h"
 
 /* Tunables */
 static const int sync_read_expire  = HZ / 2;	/* max time before a sync read is submitted. */
@@ -36,88 +34,8 @@ static const int writes_starved = 2;		/* max times reads can starve a write */
 static const int fifo_batch     = 8;		/* # of sequential requests treated as one
 						   by the above parameters. For throughput. */
 
-/* Elevator data */
-struct sio_data {
-	/* Request queues */
-	struct list_head fifo_list[2][2];
-
-	/* Attributes */
-	unsigned int batched;
-	unsigned int starved;
-
-	/* Settings */
-	int fifo_expire[2][2];
-	int fifo_batch;
-	int writes_starved;
-};
-
-static void
-sio_merged_requests(struct request_queue *q, struct request *rq,
-		    struct request *next)
-{
-	/*
-	 * If next expires before rq, assign its expire time to rq
-	 * and move into next position (next will be deleted) in fifo.
-	 */
-	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist)) {
-		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
-			list_move(&rq->queuelist, &next->queuelist);
-			rq_set_fifo_time(rq, rq_fifo_time(next));
-		}
-	}
-
-	/* Delete next request */
-	rq_fifo_clear(next);
-}
-
-static void
-sio_add_request(struct request_queue *q, struct request *rq)
-{
-	struct sio_data *sd = q->elevator->elevator_data;
-	const int sync = rq_is_sync(rq);
-	const int data_dir = rq_data_dir(rq);
-
-	/*
-	 * Add request to the proper fifo list and set its
-	 * expire time.
-	 */
-	rq_set_fifo_time(rq, jiffies + sd->fifo_expire[sync][data_dir]);
-	list_add_tail(&rq->queuelist, &sd->fifo_list[sync][data_dir]);
-}
-
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
-static int
-sio_queue_empty(struct request_queue *q)
-{
-	struct sio_data *sd = q->elevator->elevator_data;
-
-	/* Check if fifo lists are empty */
-	return list_empty(&sd->fifo_list[SYNC][READ]) && list_empty(&sd->fifo_list[SYNC][WRITE]) &&
-	       list_empty(&sd->fifo_list[ASYNC][READ]) && list_empty(&sd->fifo_list[ASYNC][WRITE]);
-}
-#endif
-
 static struct request *
-sio_expired_request(struct sio_data *sd, int sync, int data_dir)
-{
-	struct list_head *list = &sd->fifo_list[sync][data_dir];
-	struct request *rq;
-
-	if (list_empty(list))
-		return NULL;
-
-	/* Retrieve request */
-	rq = rq_entry_fifo(list->next);
-
-	/* Request has expired */
-	if (time_after(jiffies, rq_fifo_time(rq)))
-		return rq;
-
-	return NULL;
-}
-
-static struct request *
-sio_choose_expired_request(struct sio_data *sd)
+sio_choose_expired_request(struct dfifo_data *sd)
 {
 	struct request *rq;
 
@@ -126,17 +44,17 @@ sio_choose_expired_request(struct sio_data *sd)
 	 * Asynchronous requests have priority over synchronous.
 	 * Write requests have priority over read.
 	 */
-	rq = sio_expired_request(sd, ASYNC, WRITE);
+	rq = dfifo_expired(sd, DFIFO_ASYNC, WRITE);
 	if (rq)
 		return rq;
-	rq = sio_expired_request(sd, ASYNC, READ);
+	rq = dfifo_expired(sd, DFIFO_ASYNC, READ);
 	if (rq)
 		return rq;
 
-	rq = sio_expired_request(sd, SYNC, WRITE);
+	rq = dfifo_expired(sd, DFIFO_SYNC, WRITE);
 	if (rq)
 		return rq;
-	rq = sio_expired_request(sd, SYNC, READ);
+	rq = dfifo_expired(sd, DFIFO_SYNC, READ);
 	if (rq)
 		return rq;
 
@@ -144,62 +62,42 @@ sio_choose_expired_request(struct sio_data *sd)
 }
 
 static struct request *
-sio_choose_request(struct sio_data *sd, int data_dir)
+sio_choose_request(struct dfifo_data *sd, int data_dir)
 {
-	struct list_head *sync = sd->fifo_list[SYNC];
-	struct list_head *async = sd->fifo_list[ASYNC];
+	struct request *rq;
 
 	/*
 	 * Retrieve request from available fifo list.
 	 * Synchronous requests have priority over asynchronous.
 	 * Read requests have priority over write.
 	 */
-	if (!list_empty(&sync[data_dir]))
-		return rq_entry_fifo(sync[data_dir].next);
-	if (!list_empty(&async[data_dir]))
-		return rq_entry_fifo(async[data_dir].next);
-
-	if (!list_empty(&sync[!data_dir]))
-		return rq_entry_fifo(sync[!data_dir].next);
-	if (!list_empty(&async[!data_dir]))
-		return rq_entry_fifo(async[!data_dir].next);
-
-	return NULL;
-}
-
-static inline void
-sio_dispatch_request(struct sio_data *sd, struct request *rq)
-{
-	/*
-	 * Remove the request from the fifo list
-	 * and dispatch it.
-	 */
-	rq_fifo_clear(rq);
-	elv_dispatch_add_tail(rq->q, rq);
-
-	sd->batched++;
+	rq = dfifo_head(sd, DFIFO_SYNC, data_dir);
+	if (rq)
+		return rq;
+	rq = dfifo_head(sd, DFIFO_ASYNC, data_dir);
+	if (rq)
+		return rq;
 
-	if (rq_data_dir(rq))
-		sd->starved = 0;
-	else
-		sd->starved++;
+	rq = dfifo_head(sd, DFIFO_SYNC, !data_dir);
+	if (rq)
+		return rq;
+	return dfifo_head(sd, DFIFO_ASYNC, !data_dir);
 }
 
 static int
 sio_dispatch_requests(struct request_queue *q, int force)
 {
-	struct sio_data *sd = q->elevator->elevator_data;
-	struct request *rq = NULL;
+	struct dfifo_data *sd = q->elevator->elevator_data;
+	struct request *rq;
 	int data_dir = READ;
 
 	/*
-	 * Retrieve any expired request after a batch of
-	 * sequential requests.
+	 * Continue the running batch of sequential requests, retrieve
+	 * any expired request once it is over.
 	 */
-	if (sd->batched > sd->fifo_batch) {
-		sd->batched = 0;
+	rq = dfifo_batch_next(sd);
+	if (!rq)
 		rq = sio_choose_expired_request(sd);
-	}
 
 	/* Retrieve request */
 	if (!rq) {
@@ -212,90 +110,30 @@ sio_dispatch_requests(struct request_queue *q, int force)
 	}
 
 	/* Dispatch request */
-	sio_dispatch_request(sd, rq);
+	dfifo_dispatch(sd, rq);
 
 	return 1;
 }
 
-static struct request *
-sio_former_request(struct request_queue *q, struct request *rq)
-{
-	struct sio_data *sd = q->elevator->elevator_data;
-	const int sync = rq_is_sync(rq);
-	const int data_dir = rq_data_dir(rq);
-
-	if (rq->queuelist.prev == &sd->fifo_list[sync][data_dir])
-		return NULL;
-
-	/* Return former request */
-	return list_entry(rq->queuelist.prev, struct request, queuelist);
-}
-
-static struct request *
-sio_latter_request(struct request_queue *q, struct request *rq)
-{
-	struct sio_data *sd = q->elevator->elevator_data;
-	const int sync = rq_is_sync(rq);
-	const int data_dir = rq_data_dir(rq);
-
-	if (rq->queuelist.next == &sd->fifo_list[sync][data_dir])
-		return NULL;
-
-	/* Return latter request */
-	return list_entry(rq->queuelist.next, struct request, queuelist);
-}
-
-#if LINUX_VERSION_CODE < KERNEL_VERSION(3,5,0)
 static void *
-#else
-static int
-#endif
 sio_init_queue(struct request_queue *q)
 {
-	struct sio_data *sd;
+	struct dfifo_data *sd;
 
 	/* Allocate structure */
-	sd = kmalloc_node(sizeof(*sd), GFP_KERNEL, q->node);
+	sd = dfifo_alloc(q);
 	if (!sd)
-#if LINUX_VERSION_CODE < KERNEL_VERSION(3,5,0)
 		return NULL;
-#else
-		return -ENOMEM;
-#endif
-
-	/* Initialize fifo lists */
-	INIT_LIST_HEAD(&sd->fifo_list[SYNC][READ]);
-	INIT_LIST_HEAD(&sd->fifo_list[SYNC][WRITE]);
-	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][READ]);
-	INIT_LIST_HEAD(&sd->fifo_list[ASYNC][WRITE]);
 
 	/* Initialize data */
-	sd->batched = 0;
-	sd->fifo_expire[SYNC][READ] = sync_read_expire;
-	sd->fifo_expire[SYNC][WRITE] = sync_write_expire;
-	sd->fifo_expire[ASYNC][READ] = async_read_expire;
-	sd->fifo_expire[ASYNC][WRITE] = async_write_expire;
+	sd->fifo_expire[DFIFO_SYNC][READ] = sync_read_expire;
+	sd->fifo_expire[DFIFO_SYNC][WRITE] = sync_write_expire;
+	sd->fifo_expire[DFIFO_ASYNC][READ] = async_read_expire;
+	sd->fifo_expire[DFIFO_ASYNC][WRITE] = async_write_expire;
 	sd->fifo_batch = fifo_batch;
-#if LINUX_VERSION_CODE < KERNEL_VERSION(3,5,0)
-	return sd;
-#else
-	q->elevator->elevator_data = sd;
-	return 0;
-#endif
-}
+	sd->writes_starved = writes_starved;
 
-static void
-sio_exit_queue(struct elevator_queue *e)
-{
-	struct sio_data *sd = e->elevator_data;
-
-	BUG_ON(!list_empty(&sd->fifo_list[SYNC][READ]));
-	BUG_ON(!list_empty(&sd->fifo_list[SYNC][WRITE]));
-	BUG_ON(!list_empty(&sd->fifo_list[ASYNC][READ]));
-	BUG_ON(!list_empty(&sd->fifo_list[ASYNC][WRITE]));
-
-	/* Free structure */
-	kfree(sd);
+	return sd;
 }
 
 /*
@@ -320,16 +158,16 @@ sio_var_store(int *var, const char *page, size_t count)
 #define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
 static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
 {									\
-	struct sio_data *sd = e->elevator_data;			\
+	struct dfifo_data *sd = e->elevator_data;			\
 	int __data = __VAR;						\
 	if (__CONV)							\
 		__data = jiffies_to_msecs(__data);			\
 	return sio_var_show(__data, (page));			\
 }
-SHOW_FUNCTION(sio_sync_read_expire_show, sd->fifo_expire[SYNC][READ], 1);
-SHOW_FUNCTION(sio_sync_write_expire_show, sd->fifo_expire[SYNC][WRITE], 1);
-SHOW_FUNCTION(sio_async_read_expire_show, sd->fifo_expire[ASYNC][READ], 1);
-SHOW_FUNCTION(sio_async_write_expire_show, sd->fifo_expire[ASYNC][WRITE], 1);
+SHOW_FUNCTION(sio_sync_read_expire_show, sd->fifo_expire[DFIFO_SYNC][READ], 1);
+SHOW_FUNCTION(sio_sync_write_expire_show, sd->fifo_expire[DFIFO_SYNC][WRITE], 1);
+SHOW_FUNCTION(sio_async_read_expire_show, sd->fifo_expire[DFIFO_ASYNC][READ], 1);
+SHOW_FUNCTION(sio_async_write_expire_show, sd->fifo_expire[DFIFO_ASYNC][WRITE], 1);
 SHOW_FUNCTION(sio_fifo_batch_show, sd->fifo_batch, 0);
 SHOW_FUNCTION(sio_writes_starved_show, sd->writes_starved, 0);
 #undef SHOW_FUNCTION
@@ -337,7 +175,7 @@ SHOW_FUNCTION(sio_writes_starved_show, sd->writes_starved, 0);
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
 static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
 {									\
-	struct sio_data *sd = e->elevator_data;			\
+	struct dfifo_data *sd = e->elevator_data;			\
 	int __data;							\
 	int ret = sio_var_store(&__data, (page), count);		\
 	if (__data < (MIN))						\
@@ -350,10 +188,10 @@ static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)
 		*(__PTR) = __data;					\
 	return ret;							\
 }
-STORE_FUNCTION(sio_sync_read_expire_store, &sd->fifo_expire[SYNC][READ], 0, INT_MAX, 1);
-STORE_FUNCTION(sio_sync_write_expire_store, &sd->fifo_expire[SYNC][WRITE], 0, INT_MAX, 1);
-STORE_FUNCTION(sio_async_read_expire_store, &sd->fifo_expire[ASYNC][READ], 0, INT_MAX, 1);
-STORE_FUNCTION(sio_async_write_expire_store, &sd->fifo_expire[ASYNC][WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(sio_sync_read_expire_store, &sd->fifo_expire[DFIFO_SYNC][READ], 0, INT_MAX, 1);
+STORE_FUNCTION(sio_sync_write_expire_store, &sd->fifo_expire[DFIFO_SYNC][WRITE], 0, INT_MAX, 1);
+STORE_FUNCTION(sio_async_read_expire_store, &sd->fifo_expire[DFIFO_ASYNC][READ], 0, INT_MAX, 1);
+STORE_FUNCTION(sio_async_write_expire_store, &sd->fifo_expire[DFIFO_ASYNC][WRITE], 0, INT_MAX, 1);
 STORE_FUNCTION(sio_fifo_batch_store, &sd->fifo_batch, 0, INT_MAX, 0);
 STORE_FUNCTION(sio_writes_starved_store, &sd->writes_starved, 0, INT_MAX, 0);
 #undef STORE_FUNCTION
@@ -374,16 +212,15 @@ static struct elv_fs_entry sio_attrs[] = {
 
 static struct elevator_type iosched_sio = {
 	.ops = {
-		.elevator_merge_req_fn		= sio_merged_requests,
+		.elevator_merge_fn		= dfifo_merge,
+		.elevator_merged_fn		= dfifo_merged_request,
+		.elevator_merge_req_fn		= dfifo_merged_requests,
 		.elevator_dispatch_fn		= sio_dispatch_requests,
-		.elevator_add_req_fn		= sio_add_request,
-#if LINUX_VERSION_CODE <= KERNEL_VERSION(2,6,38)
-		.elevator_queue_empty_fn	= sio_queue_empty,
-#endif
-		.elevator_former_req_fn		= sio_former_request,
-		.elevator_latter_req_fn		= sio_latter_request,
+		.elevator_add_req_fn		= dfifo_add_request,
+		.elevator_former_req_fn		= elv_rb_former_request,
+		.elevator_latter_req_fn		= elv_rb_latter_request,
 		.elevator_init_fn		= sio_init_queue,
-		.elevator_exit_fn		= sio_exit_queue,
+		.elevator_exit_fn		= dfifo_exit_queue,
 	},
 
 	.elevator_attrs = sio_attrs,
@@ -411,4 +248,4 @@ module_exit(sio_exit);
 MODULE_AUTHOR("Miguel Boton");
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Simple IO scheduler");
-MODULE_VERSION("0.2");
+MODULE_VERSION("0.3");
@@ -6,144 +6,78 @@
  *
  * FCFS, dispatches are back-inserted, deadlines ensure fairness.
  * Should work best with devices where there is no travel delay.
+ * The fifos, merging and batching live in the deadline fifo core
+ * (block/deadline-fifo.c).
  */
 #include <linux/blkdev.h>
 #include <linux/elevator.h>
 #include <linux/bio.h>
 #include <linux/module.h>
-#include <linux/slab.h>
 #include <linux/init.h>
 
-enum zen_data_dir { ASYNC, SYNC };
+#include "deadline-fifo.h"
 
 static const int sync_expire  = HZ / 4;    /* max time before a sync is submitted. */
 static const int async_expire = 2 * HZ;    /* ditto for async, these limits are SOFT! */
 static const int fifo_batch = 1;
 
-struct zen_data {
-	/* Runtime Data */
-	/* Requests are only present on fifo_list */
-	struct list_head fifo_list[2];
-
-        unsigned int batching;          /* number of sequential requests made */
-
-	/* tunables */
-	int fifo_expire[2];
-	int fifo_batch;
-};
-
-static inline struct zen_data *
-zen_get_data(struct request_queue *q) {
-	return q->elevator->elevator_data;
-}
-
-static void zen_dispatch(struct zen_data *, struct request *);
-
-static void
-zen_merged_requests(struct request_queue *q, struct request *rq,
-                    struct request *next)
-{
-	/*
-	 * if next expires before rq, assign its expire time to arq
-	 * and move into next position (next will be deleted) in fifo
-	 */
-	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist)) {
-		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
-			list_move(&rq->queuelist, &next->queuelist);
-			rq_set_fifo_time(rq, rq_fifo_time(next));
-		}
-	}
-
-	/* next request is gone */
-	rq_fifo_clear(next);
-}
-
-static void zen_add_request(struct request_queue *q, struct request *rq)
-{
-	struct zen_data *zdata = zen_get_data(q);
-	const int dir = rq_data_dir(rq);
-
-	if (zdata->fifo_expire[dir]) {
-		rq_set_fifo_time(rq, jiffies + zdata->fifo_expire[dir]);
-		list_add_tail(&rq->queuelist, &zdata->fifo_list[dir]);
-	}
-}
-
-static void zen_dispatch(struct zen_data *zdata, struct request *rq)
-{
-	/* Remove request from list and dispatch it */
-	rq_fifo_clear(rq);
-	elv_dispatch_add_tail(rq->q, rq);
-
-	/* Increment # of sequential requests */
-	zdata->batching++;
-}
-
 /*
- * get the first expired request in direction ddir
+ * Return the older of two requests, either of which may be NULL.
  */
 static struct request *
-zen_expired_request(struct zen_data *zdata, int ddir)
+zen_older_request(struct request *a, struct request *b)
 {
-        struct request *rq;
-
-        if (list_empty(&zdata->fifo_list[ddir]))
-                return NULL;
+	if (!a)
+		return b;
+	if (!b)
+		return a;
 
-        rq = rq_entry_fifo(zdata->fifo_list[ddir].next);
-        if (time_after(jiffies, rq_fifo_time(rq)))
-                return rq;
-
-        return NULL;
+	return time_before(rq_fifo_time(b), rq_fifo_time(a)) ? b : a;
 }
 
 /*
- * zen_check_fifo returns 0 if there are no expired requests on the fifo,
- * otherwise it returns the next expired request
+ * zen_check_fifo returns NULL if there are no expired requests on the
+ * fifos, otherwise it returns the expired request with the earliest
+ * deadline.
  */
 static struct request *
-zen_check_fifo(struct zen_data *zdata)
+zen_check_fifo(struct dfifo_data *zdata)
 {
-        struct request *rq_sync = zen_expired_request(zdata, SYNC);
-        struct request *rq_async = zen_expired_request(zdata, ASYNC);
-
-        if (rq_async && rq_sync) {
-        	if (time_after(rq_fifo_time(rq_async), rq_fifo_time(rq_sync)))
-                	return rq_sync;
-        } else if (rq_sync) {
-                return rq_sync;
-	} else if (rq_async) {
-		return rq_async;
-	}
+	struct request *rq;
 
-        return 0;
+	rq = zen_older_request(dfifo_expired(zdata, DFIFO_SYNC, READ),
+			       dfifo_expired(zdata, DFIFO_SYNC, WRITE));
+	rq = zen_older_request(rq, dfifo_expired(zdata, DFIFO_ASYNC, READ));
+	return zen_older_request(rq, dfifo_expired(zdata, DFIFO_ASYNC, WRITE));
 }
 
 static struct request *
-zen_choose_request(struct zen_data *zdata)
+zen_choose_request(struct dfifo_data *zdata)
 {
-        /*
-         * Retrieve request from available fifo list.
-         * Synchronous requests have priority over asynchronous.
-         */
-        if (!list_empty(&zdata->fifo_list[SYNC]))
-                return rq_entry_fifo(zdata->fifo_list[SYNC].next);
-        if (!list_empty(&zdata->fifo_list[ASYNC]))
-                return rq_entry_fifo(zdata->fifo_list[ASYNC].next);
+	struct request *rq;
 
-        return NULL;
+	/*
+	 * Retrieve request from available fifo list.
+	 * Synchronous requests have priority over asynchronous.
+	 */
+	rq = zen_older_request(dfifo_head(zdata, DFIFO_SYNC, READ),
+			       dfifo_head(zdata, DFIFO_SYNC, WRITE));
+	if (rq)
+		return rq;
+
+	return zen_older_request(dfifo_head(zdata, DFIFO_ASYNC, READ),
+				 dfifo_head(zdata, DFIFO_ASYNC, WRITE));
 }
 
 static int zen_dispatch_requests(struct request_queue *q, int force)
 {
-	struct zen_data *zdata = zen_get_data(q);
-	struct request *rq = NULL;
+	struct dfifo_data *zdata = q->elevator->elevator_data;
+	struct request *rq;
 
-	/* Check for and issue expired requests */
-	if (zdata->batching > zdata->fifo_batch) {
-		zdata->batching = 0;
+	/* Continue the batch, then check for and issue expired requests */
+	rq = dfifo_batch_next(zdata);
+	if (!rq)
 		rq = zen_check_fifo(zdata);
-	}
 
 	if (!rq) {
 		rq = zen_choose_request(zdata);
@@ -151,35 +85,26 @@ static int zen_dispatch_requests(struct request_queue *q, int force)
 			return 0;
 	}
 
-	zen_dispatch(zdata, rq);
+	dfifo_dispatch(zdata, rq);
 
 	return 1;
 }
 
 static void *zen_init_queue(struct request_queue *q)
 {
-	struct zen_data *zdata;
+	struct dfifo_data *zdata;
 
-	zdata = kmalloc_node(sizeof(*zdata), GFP_KERNEL, q->node);
+	zdata = dfifo_alloc(q);
 	if (!zdata)
 		return NULL;
-	INIT_LIST_HEAD(&zdata->fifo_list[SYNC]);
-	INIT_LIST_HEAD(&zdata->fifo_list[ASYNC]);
-	zdata->fifo_expire[SYNC] = sync_expire;
-	zdata->fifo_expire[ASYNC] = async_expire;
+	zdata->fifo_expire[DFIFO_SYNC][READ] = sync_expire;
+	zdata->fifo_expire[DFIFO_SYNC][WRITE] = sync_expire;
+	zdata->fifo_expire[DFIFO_ASYNC][READ] = async_expire;
+	zdata->fifo_expire[DFIFO_ASYNC][WRITE] = async_expire;
 	zdata->fifo_batch = fifo_batch;
 	return zdata;
 }
 
-static void zen_exit_queue(struct elevator_queue *e)
-{
-	struct zen_data *zdata = e->elevator_data;
-
-	BUG_ON(!list_empty(&zdata->fifo_list[SYNC]));
-	BUG_ON(!list_empty(&zdata->fifo_list[ASYNC]));
-	kfree(zdata);
-}
-
 /* Sysfs */
 static ssize_t
 zen_var_show(int var, char *page)
@@ -197,21 +122,21 @@ zen_var_store(int *var, const char *page, size_t count)
 #define SHOW_FUNCTION(__FUNC, __VAR, __CONV) \
 static ssize_t __FUNC(struct elevator_queue *e, char *page) \
 { \
-	struct zen_data *zdata = e->elevator_data; \
+	struct dfifo_data *zdata = e->elevator_data; \
 	int __data = __VAR; \
 	if (__CONV) \
 		__data = jiffies_to_msecs(__data); \
 		return zen_var_show(__data, (page)); \
 }
-SHOW_FUNCTION(zen_sync_expire_show, zdata->fifo_expire[SYNC], 1);
-SHOW_FUNCTION(zen_async_expire_show, zdata->fifo_expire[ASYNC], 1);
+SHOW_FUNCTION(zen_sync_expire_show, zdata->fifo_expire[DFIFO_SYNC][READ], 1);
+SHOW_FUNCTION(zen_async_expire_show, zdata->fifo_expire[DFIFO_ASYNC][READ], 1);
 SHOW_FUNCTION(zen_fifo_batch_show, zdata->fifo_batch, 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV) \
 static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count) \
 { \
-	struct zen_data *zdata = e->elevator_data; \
+	struct dfifo_data *zdata = e->elevator_data; \
 	int __data; \
 	int ret = zen_var_store(&__data, (page), count); \
 	if (__data < (MIN)) \
@@ -224,11 +149,26 @@ static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)
 		*(__PTR) = __data; \
 	return ret; \
 }
-STORE_FUNCTION(zen_sync_expire_store, &zdata->fifo_expire[SYNC], 0, INT_MAX, 1);
-STORE_FUNCTION(zen_async_expire_store, &zdata->fifo_expire[ASYNC], 0, INT_MAX, 1);
 STORE_FUNCTION(zen_fifo_batch_store, &zdata->fifo_batch, 0, INT_MAX, 0);
 #undef STORE_FUNCTION
 
+/* Zen does not tell reads from writes, both share one expire time */
+#define EXPIRE_STORE_FUNCTION(__FUNC, __SYNC) \
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count) \
+{ \
+	struct dfifo_data *zdata = e->elevator_data; \
+	int __data; \
+	int ret = zen_var_store(&__data, (page), count); \
+	if (__data < 0) \
+		__data = 0; \
+	zdata->fifo_expire[__SYNC][READ] = msecs_to_jiffies(__data); \
+	zdata->fifo_expire[__SYNC][WRITE] = msecs_to_jiffies(__data); \
+	return ret; \
+}
+EXPIRE_STORE_FUNCTION(zen_sync_expire_store, DFIFO_SYNC);
+EXPIRE_STORE_FUNCTION(zen_async_expire_store, DFIFO_ASYNC);
+#undef EXPIRE_STORE_FUNCTION
+
 #define DD_ATTR(name) \
         __ATTR(name, S_IRUGO|S_IWUSR, zen_##name##_show, \
                                       zen_##name##_store)
@@ -242,13 +182,15 @@ static struct elv_fs_entry zen_attrs[] = {
 
 static struct elevator_type iosched_zen = {
 	.ops = {
-		.elevator_merge_req_fn		= zen_merged_requests,
+		.elevator_merge_fn		= dfifo_merge,
+		.elevator_merged_fn		= dfifo_merged_request,
+		.elevator_merge_req_fn		= dfifo_merged_requests,
 		.elevator_dispatch_fn		= zen_dispatch_requests,
-		.elevator_add_req_fn		= zen_add_request,
+		.elevator_add_req_fn		= dfifo_add_request,
 		.elevator_former_req_fn         = elv_rb_former_request,
 		.elevator_latter_req_fn         = elv_rb_latter_request,
 		.elevator_init_fn		= zen_init_queue,
-		.elevator_exit_fn		= zen_exit_queue,
+		.elevator_exit_fn		= dfifo_exit_queue,
 	},
 	.elevator_attrs = zen_attrs,
 	.elevator_name = "zen",
@@ -0,0 +1,115 @@
+/*
+ * Cryptographic API.
+ *
+ * Snappy compression, using the csnappy implementation in
+ * drivers/staging/snappy.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ *
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/crypto.h>
+#include <linux/vmalloc.h>
+
+#include "../drivers/staging/snappy/csnappy.h"
+
+struct snappy_ctx {
+	void *snappy_comp_mem;
+};
+
+static int snappy_init(struct crypto_tfm *tfm)
+{
+	struct snappy_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	ctx->snappy_comp_mem = vmalloc(CSNAPPY_WORKMEM_BYTES);
+	if (!ctx->snappy_comp_mem)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static void snappy_exit(struct crypto_tfm *tfm)
+{
+	struct snappy_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	vfree(ctx->snappy_comp_mem);
+}
+
+static int snappy_compress(struct crypto_tfm *tfm, const u8 *src,
+			    unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	struct snappy_ctx *ctx = crypto_tfm_ctx(tfm);
+	uint32_t clen;
+
+	/* csnappy does not check the size of the output buffer */
+	if (*dlen < csnappy_max_compressed_length(slen))
+		return -EINVAL;
+
+	csnappy_compress((const char *)src, slen, (char *)dst, &clen,
+			 ctx->snappy_comp_mem,
+			 CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+
+	*dlen = clen;
+	return 0;
+}
+
+static int snappy_decompress(struct crypto_tfm *tfm, const u8 *src,
+			      unsigned int slen, u8 *dst, unsigned int *dlen)
+{
+	int hlen, err;
+	uint32_t len;
+
+	hlen = csnappy_get_uncompressed_length((const char *)src, slen, &len);
+	if (hlen < 0 || len > *dlen)
+		return -EINVAL;
+
+	err = csnappy_decompress_noheader((const char *)src + hlen, slen - hlen,
+					  (char *)dst, &len);
+	if (err != CSNAPPY_E_OK)
+		return -EINVAL;
+
+	*dlen = len;
+	return 0;
+}
+
+static struct crypto_alg alg = {
+	.cra_name		= "snappy",
+	.cra_flags		= CRYPTO_ALG_TYPE_COMPRESS,
+	.cra_ctxsize		= sizeof(struct snappy_ctx),
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(alg.cra_list),
+	.cra_init		= snappy_init,
+	.cra_exit		= snappy_exit,
+	.cra_u			= { .compress = {
+	.coa_compress		= snappy_compress,
+	.coa_decompress		= snappy_decompress } }
+};
+
+static int __init snappy_mod_init(void)
+{
+	return crypto_register_alg(&alg);
+}
+
+static void __exit snappy_mod_fini(void)
+{
+	crypto_unregister_alg(&alg);
+}
+
+module_init(snappy_mod_init);
+module_exit(snappy_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Snappy Compression Algorithm");
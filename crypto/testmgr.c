@@ -2405,6 +2405,21 @@ static const struct alg_test_desc alg_test_descs[] = {
 				.count = SHA512_TEST_VECTORS
 			}
 		}
+	}, {
+		.alg = "snappy",
+		.test = alg_test_comp,
+		.suite = {
+			.comp = {
+				.comp = {
+					.vecs = snappy_comp_tv_template,
+					.count = SNAPPY_COMP_TEST_VECTORS
+				},
+				.decomp = {
+					.vecs = snappy_decomp_tv_template,
+					.count = SNAPPY_DECOMP_TEST_VECTORS
+				}
+			}
+		}
 	}, {
 		.alg = "tgr128",
 		.test = alg_test_hash,
@@ -10272,6 +10272,86 @@ static struct comp_testvec lzo_decomp_tv_template[] = {
 	},
 };
 
+/*
+ * Snappy test vectors (null-terminated strings).
+ */
+#define SNAPPY_COMP_TEST_VECTORS 2
+#define SNAPPY_DECOMP_TEST_VECTORS 2
+
+static struct comp_testvec snappy_comp_tv_template[] = {
+	{
+		.inlen	= 70,
+		.outlen	= 38,
+		.input	= "Join us now and share the software "
+			"Join us now and share the software ",
+		.output	= "\x46\x78\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x01\x0d\x8a\x23\x00",
+	}, {
+		.inlen	= 159,
+		.outlen	= 132,
+		.input	= "This document describes a compression method based on the LZO "
+			"compression algorithm.  This document defines the application of "
+			"the LZO algorithm used in UBIFS.",
+		.output	= "\x9f\x01\xf0\x3c\x54\x68\x69\x73"
+			  "\x20\x64\x6f\x63\x75\x6d\x65\x6e"
+			  "\x74\x20\x64\x65\x73\x63\x72\x69"
+			  "\x62\x65\x73\x20\x61\x20\x63\x6f"
+			  "\x6d\x70\x72\x65\x73\x73\x69\x6f"
+			  "\x6e\x20\x6d\x65\x74\x68\x6f\x64"
+			  "\x20\x62\x61\x73\x65\x64\x20\x6f"
+			  "\x6e\x20\x74\x68\x65\x20\x4c\x5a"
+			  "\x4f\x32\x24\x00\x30\x61\x6c\x67"
+			  "\x6f\x72\x69\x74\x68\x6d\x2e\x20"
+			  "\x20\x54\x3a\x56\x00\x10\x66\x69"
+			  "\x6e\x65\x73\x05\x36\x34\x61\x70"
+			  "\x70\x6c\x69\x63\x61\x74\x69\x6f"
+			  "\x6e\x20\x6f\x66\x05\x13\x08\x4c"
+			  "\x5a\x4f\x19\x3d\x38\x20\x75\x73"
+			  "\x65\x64\x20\x69\x6e\x20\x55\x42"
+			  "\x49\x46\x53\x2e",
+	},
+};
+
+static struct comp_testvec snappy_decomp_tv_template[] = {
+	{
+		.inlen	= 132,
+		.outlen	= 159,
+		.input	= "\x9f\x01\xf0\x3c\x54\x68\x69\x73"
+			  "\x20\x64\x6f\x63\x75\x6d\x65\x6e"
+			  "\x74\x20\x64\x65\x73\x63\x72\x69"
+			  "\x62\x65\x73\x20\x61\x20\x63\x6f"
+			  "\x6d\x70\x72\x65\x73\x73\x69\x6f"
+			  "\x6e\x20\x6d\x65\x74\x68\x6f\x64"
+			  "\x20\x62\x61\x73\x65\x64\x20\x6f"
+			  "\x6e\x20\x74\x68\x65\x20\x4c\x5a"
+			  "\x4f\x32\x24\x00\x30\x61\x6c\x67"
+			  "\x6f\x72\x69\x74\x68\x6d\x2e\x20"
+			  "\x20\x54\x3a\x56\x00\x10\x66\x69"
+			  "\x6e\x65\x73\x05\x36\x34\x61\x70"
+			  "\x70\x6c\x69\x63\x61\x74\x69\x6f"
+			  "\x6e\x20\x6f\x66\x05\x13\x08\x4c"
+			  "\x5a\x4f\x19\x3d\x38\x20\x75\x73"
+			  "\x65\x64\x20\x69\x6e\x20\x55\x42"
+			  "\x49\x46\x53\x2e",
+		.output	= "This document describes a compression method based on the LZO "
+			"compression algorithm.  This document defines the application of "
+			"the LZO algorithm used in UBIFS.",
+	}, {
+		.inlen	= 38,
+		.outlen	= 70,
+		.input	= "\x46\x78\x4a\x6f\x69\x6e\x20\x75"
+			  "\x73\x20\x6e\x6f\x77\x20\x61\x6e"
+			  "\x64\x20\x73\x68\x61\x72\x65\x20"
+			  "\x74\x68\x65\x20\x73\x6f\x66\x74"
+			  "\x77\x01\x0d\x8a\x23\x00",
+		.output	= "Join us now and share the software "
+			"Join us now and share the software ",
+	},
+};
+
 /*
  * Michael MIC test vectors from IEEE 802.11i
  */
@@ -21,52 +21,17 @@
 #include <linux/cpufreq.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
-#include <linux/tick.h>
 #include <linux/time.h>
 #include <linux/timer.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
-#include <linux/mutex.h>
-#include <linux/slab.h>
-#include <linux/input.h>
 #include <asm/cputime.h>
 #include <linux/pm_qos_params.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/cpufreq_interactive.h>
 
-static atomic_t active_count = ATOMIC_INIT(0);
-
-struct cpufreq_interactive_cpuinfo {
-        struct timer_list cpu_timer;
-        int timer_idlecancel;
-        u64 time_in_idle;
-        u64 time_in_iowait;
-        u64 idle_exit_time;
-        u64 timer_run_time;
-        int idling;
-        u64 freq_change_time;
-        u64 freq_change_time_in_idle;
-        u64 freq_change_time_in_iowait;
-        struct cpufreq_policy *policy;
-        struct cpufreq_frequency_table *freq_table;
-        unsigned int target_freq;
-        unsigned int floor_freq;
-        u64 floor_validate_time;
-        int governor_enabled;
-};
-
-static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
-
-/* Workqueues handle frequency scaling */
-static struct task_struct *up_task;
-static struct workqueue_struct *down_wq;
-static struct work_struct freq_scale_down_work;
-static cpumask_t up_cpumask;
-static spinlock_t up_cpumask_lock;
-static cpumask_t down_cpumask;
-static spinlock_t down_cpumask_lock;
-static struct mutex set_speed_lock;
+#include "cpufreq_interactive_core.h"
 
 struct cpufreq_interactive_core_lock {
         struct pm_qos_request_list qos_min_req;
@@ -102,9 +67,6 @@ static unsigned long boost_factor;
 /* Max frequency boost in Hz; if 0 - no max is enforced */
 static unsigned long max_boost;
 
-/* Consider IO as busy */
-static unsigned long io_is_busy;
-
 /*
  * Targeted sustainable load relatively to current frequency.
  * If 0, target is set realtively to the max speed
@@ -114,14 +76,13 @@ static unsigned long sustain_load;
 /*
  * The minimum amount of time to spend at a frequency before we can ramp down.
  */
-#define DEFAULT_MIN_SAMPLE_TIME 30000;
+#define DEFAULT_MIN_SAMPLE_TIME 30000
 static unsigned long min_sample_time;
 
 /*
  * The sample rate of the timer used to increase frequency
  */
-#define DEFAULT_TIMER_RATE 20000;
-static unsigned long timer_rate;
+#define DEFAULT_TIMER_RATE 20000
 
 /*
  * Wait this long before raising speed above hispeed, by default a single
@@ -130,23 +91,24 @@ static unsigned long timer_rate;
 #define DEFAULT_ABOVE_HISPEED_DELAY DEFAULT_TIMER_RATE
 static unsigned long above_hispeed_delay_val;
 
+/*
+ * Max additional time to wait in idle, beyond timer_rate, at speeds above
+ * minimum before wakeup to reduce speed, or -1 if unnecessary.
+ */
+#define DEFAULT_TIMER_SLACK (4 * DEFAULT_TIMER_RATE)
+
 /*
  * Boost pulse to hispeed on touchscreen input.
  */
 static int input_boost_val;
 
-struct cpufreq_interactive_inputopen {
-        struct input_handle *handle;
-        struct work_struct inputopen_work;
-};
-
-static struct cpufreq_interactive_inputopen inputopen;
-
 /*
  * Non-zero means longer-term speed boost active.
  */
 static int boost_val;
 
+static struct interactive_gov interactive_gov;
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
                 unsigned int event);
 
@@ -161,8 +123,8 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 };
 
 static unsigned int cpufreq_interactive_get_target(
-        int cpu_load, int load_since_change,
-        struct cpufreq_interactive_cpuinfo *pcpu)
+        int cpu_load, int load_since_change, u64 now,
+        struct interactive_policy *ip)
 {
         unsigned int target_freq;
 
@@ -178,19 +140,19 @@ static unsigned int cpufreq_interactive_get_target(
         if (boost_factor) {
 
                 if (cpu_load >= go_maxspeed_load) {
-                        target_freq = pcpu->policy->cur * boost_factor;
+                        target_freq = ip->policy->cur * boost_factor;
 
                         if (max_boost &&
-                                target_freq > pcpu->policy->cur + max_boost)
+                                target_freq > ip->policy->cur + max_boost)
 
-                                target_freq = pcpu->policy->cur + max_boost;
+                                target_freq = ip->policy->cur + max_boost;
                 } else {
 
                         if (!sustain_load)
                                 sustain_load = 100;
 
                         target_freq =
-                                (pcpu->policy->cur * cpu_load / sustain_load);
+                                (ip->policy->cur * cpu_load / sustain_load);
                 }
 
                 goto done;
@@ -198,127 +160,42 @@ static unsigned int cpufreq_interactive_get_target(
 
         /* Jump boost policy */
         if (cpu_load >= go_hispeed_load || boost_val) {
-                if (pcpu->target_freq <= pcpu->policy->min) {
+                if (ip->target_freq <= ip->policy->min) {
                         target_freq = hispeed_freq;
                 } else {
-                        target_freq = pcpu->policy->max * cpu_load / 100;
+                        target_freq = ip->policy->max * cpu_load / 100;
 
                         if (target_freq < hispeed_freq)
                                 target_freq = hispeed_freq;
 
-                        if (pcpu->target_freq == hispeed_freq &&
+                        if (ip->target_freq == hispeed_freq &&
                             target_freq > hispeed_freq &&
-                            cputime64_sub(pcpu->timer_run_time,
-                                          pcpu->freq_change_time)
+                            now - ip->hispeed_validate_time
                             < above_hispeed_delay_val) {
 
-                                target_freq = pcpu->target_freq;
+                                target_freq = ip->target_freq;
                                 trace_cpufreq_interactive_notyet(
-                                                        smp_processor_id(),
+                                                        ip->policy->cpu,
                                                         cpu_load,
-                                                        pcpu->target_freq,
+                                                        ip->target_freq,
                                                         target_freq);
                         }
                 }
         } else {
-                target_freq = pcpu->policy->max * cpu_load / 100;
+                target_freq = ip->policy->max * cpu_load / 100;
         }
 
 done:
-        target_freq = min(target_freq, pcpu->policy->max);
+        target_freq = min(target_freq, ip->policy->max);
         return target_freq;
 }
 
-static inline cputime64_t get_cpu_iowait_time(
-        unsigned int cpu, cputime64_t *wall)
-{
-        u64 iowait_time = get_cpu_iowait_time_us(cpu, wall);
-
-        if (iowait_time == -1ULL)
-                return 0;
-
-        return iowait_time;
-}
-
-static void cpufreq_interactive_timer(unsigned long data)
+static unsigned int cpufreq_interactive_next_freq(
+        struct interactive_policy *ip, const struct interactive_sample *s)
 {
-        unsigned int delta_idle;
-        unsigned int delta_iowait;
-        unsigned int delta_time;
-        int cpu_load;
-        int load_since_change;
-        u64 time_in_idle;
-        u64 time_in_iowait;
-        u64 idle_exit_time;
-        struct cpufreq_interactive_cpuinfo *pcpu =
-                &per_cpu(cpuinfo, data);
-        u64 now_idle;
-        u64 now_iowait;
+        int cpu = ip->policy->cpu;
         unsigned int new_freq;
         unsigned int index;
-        unsigned long flags;
-
-        smp_rmb();
-
-        if (!pcpu->governor_enabled)
-                goto exit;
-
-        /*
-         * Once pcpu->timer_run_time is updated to >= pcpu->idle_exit_time,
-         * this lets idle exit know the current idle time sample has
-         * been processed, and idle exit can generate a new sample and
-         * re-arm the timer.  This prevents a concurrent idle
-         * exit on that CPU from writing a new set of info at the same time
-         * the timer function runs (the timer function can't use that info
-         * until more time passes).
-         */
-        time_in_idle = pcpu->time_in_idle;
-        time_in_iowait = pcpu->time_in_iowait;
-        idle_exit_time = pcpu->idle_exit_time;
-        now_idle = get_cpu_idle_time_us(data, &pcpu->timer_run_time);
-        now_iowait = get_cpu_iowait_time(data, NULL);
-        smp_wmb();
-
-        /* If we raced with cancelling a timer, skip. */
-        if (!idle_exit_time)
-                goto exit;
-
-        delta_idle = (unsigned int) cputime64_sub(now_idle, time_in_idle);
-        delta_iowait = (unsigned int) cputime64_sub(now_iowait, time_in_iowait);
-        delta_time = (unsigned int) cputime64_sub(pcpu->timer_run_time,
-                                                  idle_exit_time);
-
-        /*
-         * If timer ran less than 1ms after short-term sample started, retry.
-         */
-        if (delta_time < 1000)
-                goto rearm;
-
-        if (delta_idle > delta_time)
-                cpu_load = 0;
-        else {
-                if (io_is_busy && delta_idle >= delta_iowait)
-                        delta_idle -= delta_iowait;
-
-                cpu_load = 100 * (delta_time - delta_idle) / delta_time;
-        }
-
-        delta_idle = (unsigned int) cputime64_sub(now_idle,
-                                                pcpu->freq_change_time_in_idle);
-        delta_iowait = (unsigned int) cputime64_sub(now_iowait,
-                                        pcpu->freq_change_time_in_iowait);
-        delta_time = (unsigned int) cputime64_sub(pcpu->timer_run_time,
-                                                  pcpu->freq_change_time);
-
-        if ((delta_time == 0) || (delta_idle > delta_time))
-                load_since_change = 0;
-        else {
-                if (io_is_busy && delta_idle >= delta_iowait)
-                        delta_idle -= delta_iowait;
-
-                load_since_change =
-                        100 * (delta_time - delta_idle) / delta_time;
-        }
 
         /*
          * Combine short-term load (since last idle timer started or timer
@@ -327,334 +204,69 @@ static void cpufreq_interactive_timer(unsigned long data)
          *
          * This function implements the cpufreq scaling policy
          */
-        new_freq = cpufreq_interactive_get_target(cpu_load, load_since_change,
-                                                pcpu);
+        new_freq = cpufreq_interactive_get_target(s->load,
+                                                  s->load_since_change,
+                                                  s->now, ip);
 
-        if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
+        if (cpufreq_frequency_table_target(ip->policy, ip->freq_table,
                                            new_freq, CPUFREQ_RELATION_H,
                                            &index)) {
                 pr_warn_once("timer %d: cpufreq_frequency_table_target error\n",
-                             (int) data);
-                goto rearm;
+                             cpu);
+                return 0;
         }
 
-        new_freq = pcpu->freq_table[index].frequency;
+        new_freq = ip->freq_table[index].frequency;
 
         /*
          * Do not scale below floor_freq unless we have been at or above the
          * floor frequency for the minimum sample time since last validated.
          */
-        if (new_freq < pcpu->floor_freq) {
-                if (cputime64_sub(pcpu->timer_run_time,
-                                  pcpu->floor_validate_time)
-                    < min_sample_time) {
-
-                        trace_cpufreq_interactive_notyet(data, cpu_load,
-                                        pcpu->target_freq, new_freq);
-                        goto rearm;
+        if (new_freq < ip->floor_freq) {
+                if (s->now - ip->floor_validate_time < min_sample_time) {
+                        trace_cpufreq_interactive_notyet(cpu, s->load,
+                                        ip->target_freq, new_freq);
+                        return 0;
                 }
         }
 
-        pcpu->floor_freq = new_freq;
-        pcpu->floor_validate_time = pcpu->timer_run_time;
+        ip->floor_freq = new_freq;
+        ip->floor_validate_time = s->now;
 
-        if (pcpu->target_freq == new_freq) {
-                trace_cpufreq_interactive_already(data, cpu_load,
-                                pcpu->target_freq, new_freq);
-                goto rearm_if_notmax;
+        if (ip->target_freq == new_freq) {
+                trace_cpufreq_interactive_already(cpu, s->load,
+                                ip->target_freq, new_freq);
+                return 0;
         }
 
-        trace_cpufreq_interactive_target(data, cpu_load, pcpu->target_freq,
+        trace_cpufreq_interactive_target(cpu, s->load, ip->target_freq,
                                         new_freq);
 
-        if (new_freq < pcpu->target_freq) {
-                pcpu->target_freq = new_freq;
-                spin_lock_irqsave(&down_cpumask_lock, flags);
-                cpumask_set_cpu(data, &down_cpumask);
-                spin_unlock_irqrestore(&down_cpumask_lock, flags);
-                queue_work(down_wq, &freq_scale_down_work);
-        } else {
-                pcpu->target_freq = new_freq;
-                spin_lock_irqsave(&up_cpumask_lock, flags);
-                cpumask_set_cpu(data, &up_cpumask);
-                spin_unlock_irqrestore(&up_cpumask_lock, flags);
-                wake_up_process(up_task);
-        }
-
-rearm_if_notmax:
-        /*
-         * Already set max speed and don't see a need to change that,
-         * wait until next idle to re-evaluate, don't need timer.
-         */
-        if (pcpu->target_freq == pcpu->policy->max)
-                goto exit;
-
-rearm:
-        if (!timer_pending(&pcpu->cpu_timer)) {
-                /*
-                 * If already at min: if that CPU is idle, don't set timer.
-                 * Else cancel the timer if that CPU goes idle.  We don't
-                 * need to re-evaluate speed until the next idle exit.
-                 */
-                if (pcpu->target_freq == pcpu->policy->min) {
-                        smp_rmb();
-
-                        if (pcpu->idling)
-                                goto exit;
-
-                        pcpu->timer_idlecancel = 1;
-                }
-
-                pcpu->time_in_idle = get_cpu_idle_time_us(
-                        data, &pcpu->idle_exit_time);
-                pcpu->time_in_iowait = get_cpu_iowait_time(
-                        data, NULL);
-
-                mod_timer(&pcpu->cpu_timer,
-                          jiffies + usecs_to_jiffies(timer_rate));
-        }
-
-exit:
-        return;
-}
-
-static void cpufreq_interactive_idle_start(void)
-{
-        struct cpufreq_interactive_cpuinfo *pcpu =
-                &per_cpu(cpuinfo, smp_processor_id());
-        int pending;
-
-        if (!pcpu->governor_enabled)
-                return;
-
-        pcpu->idling = 1;
-        smp_wmb();
-        pending = timer_pending(&pcpu->cpu_timer);
-
-        if (pcpu->target_freq != pcpu->policy->min) {
-#ifdef CONFIG_SMP
-                /*
-                 * Entering idle while not at lowest speed.  On some
-                 * platforms this can hold the other CPU(s) at that speed
-                 * even though the CPU is idle. Set a timer to re-evaluate
-                 * speed so this idle CPU doesn't hold the other CPUs above
-                 * min indefinitely.  This should probably be a quirk of
-                 * the CPUFreq driver.
-                 */
-                if (!pending) {
-                        pcpu->time_in_idle = get_cpu_idle_time_us(
-                                smp_processor_id(), &pcpu->idle_exit_time);
-                        pcpu->time_in_iowait = get_cpu_iowait_time(
-                                smp_processor_id(), NULL);
-                        pcpu->timer_idlecancel = 0;
-                        mod_timer(&pcpu->cpu_timer,
-                                  jiffies + usecs_to_jiffies(timer_rate));
-                }
-#endif
-        } else {
-                /*
-                 * If at min speed and entering idle after load has
-                 * already been evaluated, and a timer has been set just in
-                 * case the CPU suddenly goes busy, cancel that timer.  The
-                 * CPU didn't go busy; we'll recheck things upon idle exit.
-                 */
-                if (pending && pcpu->timer_idlecancel) {
-                        del_timer(&pcpu->cpu_timer);
-                        /*
-                         * Ensure last timer run time is after current idle
-                         * sample start time, so next idle exit will always
-                         * start a new idle sampling period.
-                         */
-                        pcpu->idle_exit_time = 0;
-                        pcpu->timer_idlecancel = 0;
-                }
-        }
-
-}
-
-static void cpufreq_interactive_idle_end(void)
-{
-        struct cpufreq_interactive_cpuinfo *pcpu =
-                &per_cpu(cpuinfo, smp_processor_id());
-
-        pcpu->idling = 0;
-        smp_wmb();
-
-        /*
-         * Arm the timer for 1-2 ticks later if not already, and if the timer
-         * function has already processed the previous load sampling
-         * interval.  (If the timer is not pending but has not processed
-         * the previous interval, it is probably racing with us on another
-         * CPU.  Let it compute load based on the previous sample and then
-         * re-arm the timer for another interval when it's done, rather
-         * than updating the interval start time to be "now", which doesn't
-         * give the timer function enough time to make a decision on this
-         * run.)
-         */
-        if (timer_pending(&pcpu->cpu_timer) == 0 &&
-            pcpu->timer_run_time >= pcpu->idle_exit_time &&
-            pcpu->governor_enabled) {
-                pcpu->time_in_idle =
-                        get_cpu_idle_time_us(smp_processor_id(),
-                                             &pcpu->idle_exit_time);
-                pcpu->time_in_iowait =
-                        get_cpu_iowait_time(smp_processor_id(),
-                                                NULL);
-                pcpu->timer_idlecancel = 0;
-                mod_timer(&pcpu->cpu_timer,
-                          jiffies + usecs_to_jiffies(timer_rate));
-        }
-
-}
-
-static int cpufreq_interactive_up_task(void *data)
-{
-        unsigned int cpu;
-        cpumask_t tmp_mask;
-        unsigned long flags;
-        struct cpufreq_interactive_cpuinfo *pcpu;
-
-        while (1) {
-                set_current_state(TASK_INTERRUPTIBLE);
-                spin_lock_irqsave(&up_cpumask_lock, flags);
-
-                if (cpumask_empty(&up_cpumask)) {
-                        spin_unlock_irqrestore(&up_cpumask_lock, flags);
-                        schedule();
-
-                        if (kthread_should_stop())
-                                break;
-
-                        spin_lock_irqsave(&up_cpumask_lock, flags);
-                }
-
-                set_current_state(TASK_RUNNING);
-                tmp_mask = up_cpumask;
-                cpumask_clear(&up_cpumask);
-                spin_unlock_irqrestore(&up_cpumask_lock, flags);
-
-                for_each_cpu(cpu, &tmp_mask) {
-                        unsigned int j;
-                        unsigned int max_freq = 0;
-
-                        pcpu = &per_cpu(cpuinfo, cpu);
-                        smp_rmb();
-
-                        if (!pcpu->governor_enabled)
-                                continue;
-
-                        mutex_lock(&set_speed_lock);
-
-                        for_each_cpu(j, pcpu->policy->cpus) {
-                                struct cpufreq_interactive_cpuinfo *pjcpu =
-                                        &per_cpu(cpuinfo, j);
-
-                                if (pjcpu->target_freq > max_freq)
-                                        max_freq = pjcpu->target_freq;
-                        }
-
-                        __cpufreq_driver_target(pcpu->policy,
-                                                max_freq,
-                                                CPUFREQ_RELATION_H);
-                        mutex_unlock(&set_speed_lock);
-
-                        trace_cpufreq_interactive_up(cpu, pcpu->target_freq,
-                                                pcpu->policy->cur);
-
-                        pcpu->freq_change_time_in_idle =
-                                get_cpu_idle_time_us(cpu,
-                                                     &pcpu->freq_change_time);
-                        pcpu->freq_change_time_in_iowait =
-                                get_cpu_iowait_time(cpu, NULL);
-                }
-        }
-
-        return 0;
+        return new_freq;
 }
 
-static void cpufreq_interactive_freq_down(struct work_struct *work)
+static void cpufreq_interactive_speed_changed(struct interactive_policy *ip,
+                                              unsigned int old_freq)
 {
-        unsigned int cpu;
-        cpumask_t tmp_mask;
-        unsigned long flags;
-        struct cpufreq_interactive_cpuinfo *pcpu;
-
-        spin_lock_irqsave(&down_cpumask_lock, flags);
-        tmp_mask = down_cpumask;
-        cpumask_clear(&down_cpumask);
-        spin_unlock_irqrestore(&down_cpumask_lock, flags);
-
-        for_each_cpu(cpu, &tmp_mask) {
-                unsigned int j;
-                unsigned int max_freq = 0;
-
-                pcpu = &per_cpu(cpuinfo, cpu);
-                smp_rmb();
-
-                if (!pcpu->governor_enabled)
-                        continue;
-
-                mutex_lock(&set_speed_lock);
-
-                for_each_cpu(j, pcpu->policy->cpus) {
-                        struct cpufreq_interactive_cpuinfo *pjcpu =
-                                &per_cpu(cpuinfo, j);
-
-                        if (pjcpu->target_freq > max_freq)
-                                max_freq = pjcpu->target_freq;
-                }
-
-                __cpufreq_driver_target(pcpu->policy, max_freq,
-                                        CPUFREQ_RELATION_H);
+        /* above_hispeed_delay counts from the last frequency change */
+        ip->hispeed_validate_time = ktime_to_us(ktime_get());
 
-                mutex_unlock(&set_speed_lock);
-
-                trace_cpufreq_interactive_down(cpu, pcpu->target_freq,
-                                        pcpu->policy->cur);
-
-                pcpu->freq_change_time_in_idle =
-                        get_cpu_idle_time_us(cpu,
-                                             &pcpu->freq_change_time);
-                pcpu->freq_change_time_in_iowait =
-                        get_cpu_iowait_time(cpu, NULL);
-        }
+        if (ip->policy->cur < old_freq)
+                trace_cpufreq_interactive_down(ip->policy->cpu,
+                                ip->target_freq, ip->policy->cur);
+        else
+                trace_cpufreq_interactive_up(ip->policy->cpu,
+                                ip->target_freq, ip->policy->cur);
 }
 
 static void cpufreq_interactive_boost(void)
 {
-        int i;
-        int anyboost = 0;
-        unsigned long flags;
-        struct cpufreq_interactive_cpuinfo *pcpu;
-
-        spin_lock_irqsave(&up_cpumask_lock, flags);
-
-        for_each_online_cpu(i) {
-                pcpu = &per_cpu(cpuinfo, i);
-
-                if (pcpu->target_freq < hispeed_freq) {
-                        pcpu->target_freq = hispeed_freq;
-                        cpumask_set_cpu(i, &up_cpumask);
-                        anyboost = 1;
-                }
-
-                /* Set floor freq and (re)start timer for when last
-                 * validated.
-                 */
-
-                pcpu->floor_freq = hispeed_freq;
-                pcpu->floor_validate_time = ktime_to_us(ktime_get());
-        }
-
-        spin_unlock_irqrestore(&up_cpumask_lock, flags);
-
-        if (anyboost)
-                wake_up_process(up_task);
+        interactive_gov_boost(&interactive_gov, hispeed_freq);
 }
 
 static void cpufreq_interactive_core_lock_timer(unsigned long data)
 {
-        queue_work(down_wq, &core_lock.unlock_work);
+        schedule_work(&core_lock.unlock_work);
 }
 
 static void cpufreq_interactive_unlock_cores(struct work_struct *wq)
@@ -722,91 +334,14 @@ static int cpufreq_interactive_lock_cores_task(void *data)
  * usual algorithm of min_sample_time  decide when to allow speed
  * to drop.
  */
-
-static void cpufreq_interactive_input_event(struct input_handle *handle,
-                                            unsigned int type,
-                                            unsigned int code, int value)
+static void cpufreq_interactive_input_event(void)
 {
-        if (input_boost_val && type == EV_SYN && code == SYN_REPORT) {
+        if (input_boost_val) {
                 wake_up_process(core_lock.lock_task);
                 cpufreq_interactive_boost();
         }
 }
 
-static void cpufreq_interactive_input_open(struct work_struct *w)
-{
-        struct cpufreq_interactive_inputopen *io =
-                container_of(w, struct cpufreq_interactive_inputopen,
-                             inputopen_work);
-        int error;
-
-        error = input_open_device(io->handle);
-        if (error)
-                input_unregister_handle(io->handle);
-}
-
-static int cpufreq_interactive_input_connect(struct input_handler *handler,
-                                             struct input_dev *dev,
-                                             const struct input_device_id *id)
-{
-        struct input_handle *handle;
-        int error;
-
-        pr_info("%s: connect to %s\n", __func__, dev->name);
-        handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
-        if (!handle)
-                return -ENOMEM;
-
-        handle->dev = dev;
-        handle->handler = handler;
-        handle->name = "cpufreq_interactive";
-
-        error = input_register_handle(handle);
-        if (error)
-                goto err;
-
-        inputopen.handle = handle;
-        queue_work(down_wq, &inputopen.inputopen_work);
-        return 0;
-err:
-        kfree(handle);
-        return error;
-}
-
-static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
-{
-        input_close_device(handle);
-        input_unregister_handle(handle);
-        kfree(handle);
-}
-
-static const struct input_device_id cpufreq_interactive_ids[] = {
-        {
-                .flags = INPUT_DEVICE_ID_MATCH_EVBIT |
-                         INPUT_DEVICE_ID_MATCH_ABSBIT,
-                .evbit = { BIT_MASK(EV_ABS) },
-                .absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
-                            BIT_MASK(ABS_MT_POSITION_X) |
-                            BIT_MASK(ABS_MT_POSITION_Y) },
-        }, /* multi-touch touchscreen */
-        {
-                .flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
-                         INPUT_DEVICE_ID_MATCH_ABSBIT,
-                .keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
-                .absbit = { [BIT_WORD(ABS_X)] =
-                            BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
-        }, /* touchpad */
-        { },
-};
-
-static struct input_handler cpufreq_interactive_input_handler = {
-        .event          = cpufreq_interactive_input_event,
-        .connect        = cpufreq_interactive_input_connect,
-        .disconnect     = cpufreq_interactive_input_disconnect,
-        .name           = "cpufreq_interactive",
-        .id_table       = cpufreq_interactive_ids,
-};
-
 static ssize_t show_go_maxspeed_load(struct kobject *kobj,
                                      struct attribute *attr, char *buf)
 {
@@ -851,23 +386,6 @@ static ssize_t store_boost_factor(struct kobject *kobj,
 static struct global_attr boost_factor_attr = __ATTR(boost_factor, 0644,
                 show_boost_factor, store_boost_factor);
 
-static ssize_t show_io_is_busy(struct kobject *kobj,
-                                     struct attribute *attr, char *buf)
-{
-        return sprintf(buf, "%lu\n", io_is_busy);
-}
-
-static ssize_t store_io_is_busy(struct kobject *kobj,
-                        struct attribute *attr, const char *buf, size_t count)
-{
-        if (!strict_strtoul(buf, 0, &io_is_busy))
-                return count;
-        return -EINVAL;
-}
-
-static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,
-                show_io_is_busy, store_io_is_busy);
-
 static ssize_t show_sustain_load(struct kobject *kobj,
                                      struct attribute *attr, char *buf)
 {
@@ -1002,27 +520,7 @@ static ssize_t store_above_hispeed_delay(struct kobject *kobj,
 
 define_one_global_rw(above_hispeed_delay);
 
-static ssize_t show_timer_rate(struct kobject *kobj,
-                        struct attribute *attr, char *buf)
-{
-        return sprintf(buf, "%lu\n", timer_rate);
-}
-
-static ssize_t store_timer_rate(struct kobject *kobj,
-                        struct attribute *attr, const char *buf, size_t count)
-{
-        int ret;
-        unsigned long val;
-
-        ret = strict_strtoul(buf, 0, &val);
-        if (ret < 0)
-                return ret;
-        timer_rate = val;
-        return count;
-}
-
-static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
-                show_timer_rate, store_timer_rate);
+define_interactive_gov_attrs(interactive_gov);
 
 static ssize_t show_input_boost(struct kobject *kobj, struct attribute *attr,
                                 char *buf)
@@ -1085,6 +583,7 @@ static struct attribute *interactive_attributes[] = {
         &above_hispeed_delay.attr,
         &min_sample_time_attr.attr,
         &timer_rate_attr.attr,
+        &timer_slack_attr.attr,
         &input_boost.attr,
         &boost.attr,
         NULL,
@@ -1095,165 +594,43 @@ static struct attribute_group interactive_attr_group = {
         .name = "interactive",
 };
 
-static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
-                unsigned int event)
+static int cpufreq_interactive_start(struct interactive_policy *ip)
 {
-        int rc;
-        unsigned int j;
-        struct cpufreq_interactive_cpuinfo *pcpu;
-        struct cpufreq_frequency_table *freq_table;
-
-        switch (event) {
-        case CPUFREQ_GOV_START:
-                if (!cpu_online(policy->cpu))
-                        return -EINVAL;
-
-                freq_table =
-                        cpufreq_frequency_get_table(policy->cpu);
-
-                for_each_cpu(j, policy->cpus) {
-                        pcpu = &per_cpu(cpuinfo, j);
-                        pcpu->policy = policy;
-                        pcpu->target_freq = policy->cur;
-                        pcpu->freq_table = freq_table;
-                        pcpu->freq_change_time_in_idle =
-                                get_cpu_idle_time_us(j,
-                                             &pcpu->freq_change_time);
-                        pcpu->time_in_idle = pcpu->freq_change_time_in_idle;
-                        pcpu->idle_exit_time = pcpu->freq_change_time;
-                        pcpu->freq_change_time_in_iowait =
-                                get_cpu_iowait_time(j, NULL);
-                        pcpu->time_in_iowait = pcpu->freq_change_time_in_iowait;
-
-                        pcpu->timer_idlecancel = 1;
-                        pcpu->floor_freq = pcpu->target_freq;
-                        pcpu->floor_validate_time =
-                                pcpu->freq_change_time;
-                        pcpu->governor_enabled = 1;
-                        smp_wmb();
-                }
-
-                if (!hispeed_freq)
-                        hispeed_freq = 816000; // policy->max;
-
-                /*
-                 * Do not register the idle hook and create sysfs
-                 * entries if we have already done so.
-                 */
-                if (atomic_inc_return(&active_count) > 1)
-                        return 0;
-
-                rc = sysfs_create_group(cpufreq_global_kobject,
-                                &interactive_attr_group);
-                if (rc)
-                        return rc;
-
-                rc = input_register_handler(&cpufreq_interactive_input_handler);
-                if (rc)
-                        pr_warn("%s: failed to register input handler\n",
-                                __func__);
-
-                break;
-
-        case CPUFREQ_GOV_STOP:
-                for_each_cpu(j, policy->cpus) {
-                        pcpu = &per_cpu(cpuinfo, j);
-                        pcpu->governor_enabled = 0;
-                        smp_wmb();
-                        del_timer_sync(&pcpu->cpu_timer);
-
-                        /*
-                         * Reset idle exit time since we may cancel the timer
-                         * before it can run after the last idle exit time,
-                         * to avoid tripping the check in idle exit for a timer
-                         * that is trying to run.
-                         */
-                        pcpu->idle_exit_time = 0;
-                }
-
-                flush_work(&freq_scale_down_work);
-                if (atomic_dec_return(&active_count) > 0)
-                        return 0;
-
-                input_unregister_handler(&cpufreq_interactive_input_handler);
-                sysfs_remove_group(cpufreq_global_kobject,
-                                &interactive_attr_group);
+        if (!hispeed_freq)
+                hispeed_freq = 816000; // policy->max;
 
-                break;
-
-        case CPUFREQ_GOV_LIMITS:
-                if (policy->max < policy->cur)
-                        __cpufreq_driver_target(policy,
-                                        policy->max, CPUFREQ_RELATION_H);
-                else if (policy->min > policy->cur)
-                        __cpufreq_driver_target(policy,
-                                        policy->min, CPUFREQ_RELATION_L);
-                break;
-        }
         return 0;
 }
 
-static int cpufreq_interactive_idle_notifier(struct notifier_block *nb,
-                                             unsigned long val,
-                                             void *data)
-{
-        switch (val) {
-        case IDLE_START:
-                cpufreq_interactive_idle_start();
-                break;
-        case IDLE_END:
-                cpufreq_interactive_idle_end();
-                break;
-        }
-
-        return 0;
-}
+static const struct interactive_gov_ops interactive_ops = {
+        .next_freq = cpufreq_interactive_next_freq,
+        .start = cpufreq_interactive_start,
+        .speed_changed = cpufreq_interactive_speed_changed,
+        .input_event = cpufreq_interactive_input_event,
+};
 
-static struct notifier_block cpufreq_interactive_idle_nb = {
-        .notifier_call = cpufreq_interactive_idle_notifier,
+static struct interactive_gov interactive_gov = {
+        .ops = &interactive_ops,
+        .attr_group = &interactive_attr_group,
+        .timer_rate = DEFAULT_TIMER_RATE,
+        .timer_slack = DEFAULT_TIMER_SLACK,
 };
 
+static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
+                unsigned int event)
+{
+        return interactive_gov_event(&interactive_gov, policy, event);
+}
+
 static int __init cpufreq_interactive_init(void)
 {
-        unsigned int i;
-        struct cpufreq_interactive_cpuinfo *pcpu;
+        int rc;
         struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
 
         go_maxspeed_load = DEFAULT_GO_MAXSPEED_LOAD;
         go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
         min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
         above_hispeed_delay_val = DEFAULT_ABOVE_HISPEED_DELAY;
-        timer_rate = DEFAULT_TIMER_RATE;
-
-        /* Initalize per-cpu timers */
-        for_each_possible_cpu(i) {
-                pcpu = &per_cpu(cpuinfo, i);
-                init_timer(&pcpu->cpu_timer);
-                pcpu->cpu_timer.function = cpufreq_interactive_timer;
-                pcpu->cpu_timer.data = i;
-        }
-
-        up_task = kthread_create(cpufreq_interactive_up_task, NULL,
-                                 "kinteractiveup");
-        if (IS_ERR(up_task))
-                return PTR_ERR(up_task);
-
-        sched_setscheduler_nocheck(up_task, SCHED_FIFO, &param);
-        get_task_struct(up_task);
-
-        /* No rescuer thread, bind to CPU queuing the work for possibly
-           warm cache (probably doesn't matter much). */
-        down_wq = alloc_workqueue("knteractive_down", 0, 1);
-
-        if (!down_wq)
-                goto err_freeuptask;
-
-        INIT_WORK(&freq_scale_down_work,
-                  cpufreq_interactive_freq_down);
-
-        spin_lock_init(&up_cpumask_lock);
-        spin_lock_init(&down_cpumask_lock);
-        mutex_init(&set_speed_lock);
 
         pm_qos_add_request(&core_lock.qos_min_req, PM_QOS_MIN_ONLINE_CPUS,
                         PM_QOS_MIN_ONLINE_CPUS_DEFAULT_VALUE);
@@ -1272,20 +649,35 @@ static int __init cpufreq_interactive_init(void)
         core_lock.lock_task = kthread_create(cpufreq_interactive_lock_cores_task, NULL,
                                                 "kinteractive_lockcores");
 
-        if (IS_ERR(core_lock.lock_task))
-                return PTR_ERR(core_lock.lock_task);
+        if (IS_ERR(core_lock.lock_task)) {
+                rc = PTR_ERR(core_lock.lock_task);
+                goto err_qos;
+        }
 
         sched_setscheduler_nocheck(core_lock.lock_task, SCHED_FIFO, &param);
         get_task_struct(core_lock.lock_task);
 
-        idle_notifier_register(&cpufreq_interactive_idle_nb);
-        INIT_WORK(&inputopen.inputopen_work, cpufreq_interactive_input_open);
         INIT_WORK(&core_lock.unlock_work, cpufreq_interactive_unlock_cores);
-        return cpufreq_register_governor(&cpufreq_gov_interactive);
 
-err_freeuptask:
-        put_task_struct(up_task);
-        return -ENOMEM;
+        rc = interactive_gov_register(&interactive_gov);
+        if (rc)
+                goto err_task;
+
+        rc = cpufreq_register_governor(&cpufreq_gov_interactive);
+        if (rc)
+                goto err_gov;
+
+        return 0;
+
+err_gov:
+        interactive_gov_unregister(&interactive_gov);
+err_task:
+        kthread_stop(core_lock.lock_task);
+        put_task_struct(core_lock.lock_task);
+err_qos:
+        pm_qos_remove_request(&core_lock.qos_min_req);
+        pm_qos_remove_request(&core_lock.qos_max_req);
+        return rc;
 }
 
 #ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_INTERACTIVE
@@ -1297,9 +689,7 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
         cpufreq_unregister_governor(&cpufreq_gov_interactive);
-        kthread_stop(up_task);
-        put_task_struct(up_task);
-        destroy_workqueue(down_wq);
+        interactive_gov_unregister(&interactive_gov);
 
         pm_qos_remove_request(&core_lock.qos_min_req);
         pm_qos_remove_request(&core_lock.qos_max_req);
@@ -0,0 +1,1018 @@
+/*
+ * drivers/cpufreq/cpufreq_interactive_core.c
+ *
+ * Sampling engine shared by the interactive style governors.
+ *
+ * Copyright (C) 2010 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The interactive, dyninteractive and intelliactive governors differ in
+ * how they turn a load into a frequency.  Everything else lives here:
+ *
+ * - One deferrable timer per policy (per group of cpus sharing a clock)
+ *   samples the busiest cpu of the policy.  It runs on one of the cpus
+ *   of the policy; when that cpu goes idle the timer is handed to a
+ *   sibling that is still running, or left to be deferred if there is
+ *   none.  A non-deferrable slack timer bounds how long an idle policy
+ *   can be held above its minimum speed.
+ *
+ * - A single realtime thread sets the speed of every policy whose
+ *   target changed since it last ran, whichever governor runs it.
+ *
+ * - Idle and frequency transition notifiers, boost and the input handler
+ *   are registered once, however many governors are in use.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/input.h>
+#include <linux/kernel_stat.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+#include <linux/time.h>
+#include <asm/cputime.h>
+
+#include "cpufreq_interactive_core.h"
+
+struct interactive_cpu {
+	struct interactive_policy *ip;
+	int idling;
+	spinlock_t load_lock; /* protects the next 6 fields */
+	u64 time_in_idle;
+	u64 time_in_idle_timestamp;
+	u64 cputime_speedadj;
+	u64 cputime_speedadj_timestamp;
+	u64 target_set_time;
+	u64 target_set_time_in_idle;
+};
+
+static DEFINE_PER_CPU(struct interactive_cpu, icpu);
+
+/* Indexed by policy->cpu */
+static DEFINE_PER_CPU(struct interactive_policy, ipolicy);
+
+/* realtime thread handles frequency scaling */
+static struct task_struct *speedchange_task;
+static cpumask_t speedchange_cpumask;
+static DEFINE_SPINLOCK(speedchange_cpumask_lock);
+
+/* Serializes governor start, stop and limits, and (un)registration */
+static DEFINE_MUTEX(gov_lock);
+static LIST_HEAD(gov_list);
+static DEFINE_SPINLOCK(gov_list_lock);
+static int nr_govs;
+static int active_count;
+static int input_users;
+
+static struct input_handler interactive_input_handler;
+
+static inline u64 get_cpu_idle_time_jiffy(unsigned int cpu, u64 *wall,
+					  bool io_is_busy)
+{
+	cputime64_t idle_time;
+	cputime64_t cur_wall_time;
+	cputime64_t busy_time;
+
+	cur_wall_time = jiffies64_to_cputime64(get_jiffies_64());
+	busy_time = cputime64_add(kstat_cpu(cpu).cpustat.user,
+			kstat_cpu(cpu).cpustat.system);
+
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.irq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.softirq);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.steal);
+	busy_time = cputime64_add(busy_time, kstat_cpu(cpu).cpustat.nice);
+	if (io_is_busy)
+		busy_time = cputime64_add(busy_time,
+					  kstat_cpu(cpu).cpustat.iowait);
+
+	idle_time = cputime64_sub(cur_wall_time, busy_time);
+	if (wall)
+		*wall = jiffies_to_usecs(cur_wall_time);
+
+	return jiffies_to_usecs(idle_time);
+}
+
+/* The idle time of @cpu in usecs, iowait included unless @io_is_busy */
+static u64 get_cpu_idle_time(unsigned int cpu, u64 *wall, bool io_is_busy)
+{
+	u64 idle_time = get_cpu_idle_time_us(cpu, wall);
+	u64 iowait_time;
+
+	if (idle_time == -1ULL)
+		return get_cpu_idle_time_jiffy(cpu, wall, io_is_busy);
+
+	if (io_is_busy) {
+		iowait_time = get_cpu_iowait_time_us(cpu, NULL);
+		if (iowait_time != -1ULL && iowait_time <= idle_time)
+			idle_time -= iowait_time;
+	}
+
+	return idle_time;
+}
+
+/* Fold the time @cpu was not idle since the last update, at the current
+ * speed, into its sample.  load_lock held.
+ */
+static u64 update_load(struct interactive_policy *ip, int cpu)
+{
+	struct interactive_cpu *pcpu = &per_cpu(icpu, cpu);
+	u64 now;
+	u64 now_idle;
+	unsigned int delta_idle;
+	unsigned int delta_time;
+	u64 active_time;
+
+	now_idle = get_cpu_idle_time(cpu, &now, ip->gov->io_is_busy);
+	delta_idle = (unsigned int)(now_idle - pcpu->time_in_idle);
+	delta_time = (unsigned int)(now - pcpu->time_in_idle_timestamp);
+
+	if (delta_time <= delta_idle)
+		active_time = 0;
+	else
+		active_time = delta_time - delta_idle;
+
+	pcpu->cputime_speedadj += active_time * ip->policy->cur;
+
+	pcpu->time_in_idle = now_idle;
+	pcpu->time_in_idle_timestamp = now;
+	return now;
+}
+
+static void reset_sample(struct interactive_policy *ip, int cpu)
+{
+	struct interactive_cpu *pcpu = &per_cpu(icpu, cpu);
+	unsigned long flags;
+
+	spin_lock_irqsave(&pcpu->load_lock, flags);
+	pcpu->time_in_idle = get_cpu_idle_time(cpu,
+			&pcpu->time_in_idle_timestamp, ip->gov->io_is_busy);
+	pcpu->cputime_speedadj = 0;
+	pcpu->cputime_speedadj_timestamp = pcpu->time_in_idle_timestamp;
+	spin_unlock_irqrestore(&pcpu->load_lock, flags);
+}
+
+static void mark_target_set(struct interactive_policy *ip)
+{
+	struct interactive_cpu *pcpu;
+	unsigned long flags;
+	unsigned int j;
+
+	for_each_cpu(j, ip->policy->cpus) {
+		pcpu = &per_cpu(icpu, j);
+		spin_lock_irqsave(&pcpu->load_lock, flags);
+		pcpu->target_set_time_in_idle = get_cpu_idle_time(j,
+				&pcpu->target_set_time, ip->gov->io_is_busy);
+		spin_unlock_irqrestore(&pcpu->load_lock, flags);
+	}
+}
+
+/*
+ * Load of the busiest cpu of @ip since its sample started.  Returns false
+ * if no cpu has a sample yet.
+ */
+static bool take_sample(struct interactive_policy *ip,
+			struct interactive_sample *s)
+{
+	struct interactive_cpu *pcpu;
+	unsigned int delta_time, delta_since, idle_since;
+	unsigned int loadadjfreq, load;
+	u64 cputime_speedadj;
+	unsigned long flags;
+	bool valid = false;
+	unsigned int j;
+	u64 now;
+
+	memset(s, 0, sizeof(*s));
+
+	for_each_cpu(j, ip->policy->cpus) {
+		pcpu = &per_cpu(icpu, j);
+
+		spin_lock_irqsave(&pcpu->load_lock, flags);
+		now = update_load(ip, j);
+		delta_time = (unsigned int)(now -
+					    pcpu->cputime_speedadj_timestamp);
+		cputime_speedadj = pcpu->cputime_speedadj;
+		delta_since = (unsigned int)(now - pcpu->target_set_time);
+		idle_since = (unsigned int)(pcpu->time_in_idle -
+					    pcpu->target_set_time_in_idle);
+		spin_unlock_irqrestore(&pcpu->load_lock, flags);
+
+		if (now > s->now)
+			s->now = now;
+		if (!delta_time)
+			continue;
+		valid = true;
+
+		do_div(cputime_speedadj, delta_time);
+		loadadjfreq = (unsigned int)cputime_speedadj * 100;
+		s->loadadjfreq = max(s->loadadjfreq, loadadjfreq);
+
+		load = min(loadadjfreq / ip->policy->cur, 100U);
+		s->load = max(s->load, load);
+
+		if (delta_since && idle_since < delta_since) {
+			load = 100 * (delta_since - idle_since) / delta_since;
+			s->load_since_change = max(s->load_since_change, load);
+		}
+	}
+
+	return valid;
+}
+
+/*
+ * Arm the timers of @ip on @cpu, @cpu being this cpu unless the timers
+ * are known not to be pending.  timer_lock held.
+ */
+static void arm_timers(struct interactive_policy *ip, int cpu,
+		       unsigned long expires)
+{
+	if (cpu == smp_processor_id()) {
+		mod_timer_pinned(&ip->timer, expires);
+	} else {
+		ip->timer.expires = expires;
+		add_timer_on(&ip->timer, cpu);
+	}
+
+	del_timer(&ip->slack_timer);
+	if (ip->gov->timer_slack >= 0 && ip->target_freq > ip->policy->min) {
+		ip->slack_timer.expires = expires +
+			usecs_to_jiffies(ip->gov->timer_slack);
+		add_timer_on(&ip->slack_timer, cpu);
+	}
+
+	ip->timer_cpu = cpu;
+}
+
+/* Start a new sample on every cpu of @ip and arm its timers on @cpu. */
+static void start_sample(struct interactive_policy *ip, int cpu)
+{
+	unsigned long flags;
+	unsigned int j;
+
+	spin_lock_irqsave(&ip->timer_lock, flags);
+	for_each_cpu(j, ip->policy->cpus)
+		reset_sample(ip, j);
+	arm_timers(ip, cpu, jiffies + usecs_to_jiffies(ip->gov->timer_rate));
+	spin_unlock_irqrestore(&ip->timer_lock, flags);
+}
+
+static bool policy_idle(struct interactive_policy *ip)
+{
+	unsigned int j;
+
+	smp_rmb();
+	for_each_cpu(j, ip->policy->cpus)
+		if (!per_cpu(icpu, j).idling)
+			return false;
+
+	return true;
+}
+
+static void queue_speedchange(struct interactive_policy *ip)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+	cpumask_set_cpu(ip->policy->cpu, &speedchange_cpumask);
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+	wake_up_process(speedchange_task);
+}
+
+static void interactive_timer(unsigned long data)
+{
+	struct interactive_policy *ip = &per_cpu(ipolicy, data);
+	struct interactive_sample s;
+	unsigned int new_freq;
+
+	if (!down_read_trylock(&ip->enable_sem))
+		return;
+	if (!ip->governor_enabled)
+		goto exit;
+
+	if (!take_sample(ip, &s))
+		goto rearm;
+
+	new_freq = ip->gov->ops->next_freq(ip, &s);
+	if (!new_freq)
+		goto rearm;
+
+	if (new_freq != ip->target_freq) {
+		ip->target_freq = new_freq;
+		mark_target_set(ip);
+		queue_speedchange(ip);
+	}
+
+	/*
+	 * Already set max speed and don't see a need to change that,
+	 * wait until next idle to re-evaluate, don't need timer.
+	 */
+	if (ip->target_freq == ip->policy->max)
+		goto exit;
+
+	/*
+	 * Nor is there anything to re-evaluate at min speed with every
+	 * cpu idle; the next idle exit restarts the timer.
+	 */
+	if (ip->target_freq == ip->policy->min && policy_idle(ip))
+		goto exit;
+
+rearm:
+	if (!timer_pending(&ip->timer))
+		start_sample(ip, smp_processor_id());
+
+exit:
+	up_read(&ip->enable_sem);
+}
+
+/* Wakes the cpu so the deferred policy timer runs, nothing else to do. */
+static void interactive_nop_timer(unsigned long data)
+{
+}
+
+/* A running cpu of @ip other than @cpu, or nr_cpu_ids */
+static int busy_sibling(struct interactive_policy *ip, int cpu)
+{
+	unsigned int j;
+
+	for_each_cpu(j, ip->policy->cpus)
+		if (j != cpu && cpu_online(j) && !per_cpu(icpu, j).idling)
+			return j;
+
+	return nr_cpu_ids;
+}
+
+static void interactive_idle_start(void)
+{
+	int cpu = smp_processor_id();
+	struct interactive_cpu *pcpu = &per_cpu(icpu, cpu);
+	struct interactive_policy *ip = pcpu->ip;
+	unsigned long flags;
+	int sibling;
+
+	pcpu->idling = 1;
+	smp_wmb();
+
+	if (!ip || !down_read_trylock(&ip->enable_sem))
+		return;
+	if (!ip->governor_enabled)
+		goto exit;
+
+	spin_lock_irqsave(&ip->timer_lock, flags);
+
+	if (!timer_pending(&ip->timer)) {
+		spin_unlock_irqrestore(&ip->timer_lock, flags);
+
+		/*
+		 * Entering idle while not at lowest speed.  On some
+		 * platforms this can hold the other CPU(s) at that speed
+		 * even though the CPU is idle. Set a timer to re-evaluate
+		 * speed so this idle CPU doesn't hold the other CPUs above
+		 * min indefinitely.  This should probably be a quirk of
+		 * the CPUFreq driver.
+		 */
+		if (ip->target_freq != ip->policy->min) {
+			start_sample(ip, cpu);
+			if (ip->gov->ops->idle_start)
+				ip->gov->ops->idle_start(ip);
+		}
+		goto exit;
+	}
+
+	/*
+	 * The timer would be deferred until this cpu wakes up; let a
+	 * sibling that is still running evaluate the policy instead.
+	 */
+	if (ip->timer_cpu == cpu) {
+		sibling = busy_sibling(ip, cpu);
+		if (sibling < nr_cpu_ids) {
+			unsigned long expires = ip->timer.expires;
+
+			del_timer(&ip->timer);
+			arm_timers(ip, sibling, expires);
+		}
+	}
+
+	spin_unlock_irqrestore(&ip->timer_lock, flags);
+exit:
+	up_read(&ip->enable_sem);
+}
+
+static void interactive_idle_end(void)
+{
+	int cpu = smp_processor_id();
+	struct interactive_cpu *pcpu = &per_cpu(icpu, cpu);
+	struct interactive_policy *ip = pcpu->ip;
+	unsigned long flags;
+	bool run_now = false;
+
+	pcpu->idling = 0;
+	smp_wmb();
+
+	if (!ip || !down_read_trylock(&ip->enable_sem))
+		return;
+	if (!ip->governor_enabled) {
+		up_read(&ip->enable_sem);
+		return;
+	}
+
+	spin_lock_irqsave(&ip->timer_lock, flags);
+
+	if (!timer_pending(&ip->timer)) {
+		/* Arm the timer for 1-2 ticks later if not already. */
+		spin_unlock_irqrestore(&ip->timer_lock, flags);
+		start_sample(ip, cpu);
+		up_read(&ip->enable_sem);
+		return;
+	}
+
+	if (ip->timer_cpu != cpu && per_cpu(icpu, ip->timer_cpu).idling) {
+		/* Deferred behind an idle sibling, take it over. */
+		arm_timers(ip, cpu, ip->timer.expires);
+	}
+
+	if (ip->timer_cpu == cpu && time_after_eq(jiffies, ip->timer.expires)) {
+		del_timer(&ip->timer);
+		del_timer(&ip->slack_timer);
+		run_now = true;
+	}
+
+	spin_unlock_irqrestore(&ip->timer_lock, flags);
+	up_read(&ip->enable_sem);
+
+	if (run_now)
+		interactive_timer(ip->policy->cpu);
+}
+
+static int interactive_idle_notifier(struct notifier_block *nb,
+				     unsigned long val, void *data)
+{
+	switch (val) {
+	case IDLE_START:
+		interactive_idle_start();
+		break;
+	case IDLE_END:
+		interactive_idle_end();
+		break;
+	}
+
+	return 0;
+}
+
+static struct notifier_block interactive_idle_nb = {
+	.notifier_call = interactive_idle_notifier,
+};
+
+/*
+ * Sets the speed of every policy queued since the last run, so changes
+ * requested by several policies at about the same time cost one wakeup.
+ */
+static int interactive_speedchange_task(void *data)
+{
+	unsigned int cpu;
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	struct interactive_policy *ip;
+	unsigned int old_freq;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+
+		if (cpumask_empty(&speedchange_cpumask)) {
+			spin_unlock_irqrestore(&speedchange_cpumask_lock,
+					       flags);
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+
+			spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+		}
+
+		set_current_state(TASK_RUNNING);
+		tmp_mask = speedchange_cpumask;
+		cpumask_clear(&speedchange_cpumask);
+		spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+		for_each_cpu(cpu, &tmp_mask) {
+			ip = &per_cpu(ipolicy, cpu);
+			if (!down_read_trylock(&ip->enable_sem))
+				continue;
+			if (!ip->governor_enabled) {
+				up_read(&ip->enable_sem);
+				continue;
+			}
+
+			old_freq = ip->policy->cur;
+			if (ip->target_freq != old_freq)
+				__cpufreq_driver_target(ip->policy,
+							ip->target_freq,
+							CPUFREQ_RELATION_H);
+			if (ip->gov->ops->speed_changed)
+				ip->gov->ops->speed_changed(ip, old_freq);
+
+			up_read(&ip->enable_sem);
+		}
+	}
+
+	return 0;
+}
+
+static int interactive_transition_notifier(
+	struct notifier_block *nb, unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freq = data;
+	struct interactive_policy *ip;
+	struct interactive_cpu *pcpu;
+	unsigned long flags;
+	unsigned int j;
+
+	if (val != CPUFREQ_POSTCHANGE)
+		return 0;
+
+	ip = per_cpu(icpu, freq->cpu).ip;
+	if (!ip || !down_read_trylock(&ip->enable_sem))
+		return 0;
+
+	/* Account the time spent at the old speed before it changes. */
+	if (ip->governor_enabled) {
+		for_each_cpu(j, ip->policy->cpus) {
+			pcpu = &per_cpu(icpu, j);
+			spin_lock_irqsave(&pcpu->load_lock, flags);
+			update_load(ip, j);
+			spin_unlock_irqrestore(&pcpu->load_lock, flags);
+		}
+	}
+
+	up_read(&ip->enable_sem);
+	return 0;
+}
+
+static struct notifier_block interactive_transition_nb = {
+	.notifier_call = interactive_transition_notifier,
+};
+
+/**
+ * interactive_gov_boost - raise every policy run by @gov to @freq
+ *
+ * The policies are not let below @freq for the governor's minimum
+ * sample time from now.
+ */
+void interactive_gov_boost(struct interactive_gov *gov, unsigned int freq)
+{
+	struct interactive_policy *ip;
+	unsigned long flags;
+	int anyboost = 0;
+	u64 now;
+	int i;
+
+	now = ktime_to_us(ktime_get());
+	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+
+	for_each_online_cpu(i) {
+		ip = &per_cpu(ipolicy, i);
+		if (!ip->governor_enabled || ip->gov != gov)
+			continue;
+
+		if (ip->target_freq < freq) {
+			ip->target_freq = min(freq, ip->policy->max);
+			cpumask_set_cpu(i, &speedchange_cpumask);
+			ip->hispeed_validate_time = now;
+			mark_target_set(ip);
+			anyboost = 1;
+		}
+
+		/*
+		 * Set floor freq and (re)start timer for when last
+		 * validated.
+		 */
+		ip->floor_freq = freq;
+		ip->floor_validate_time = now;
+	}
+
+	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+	if (anyboost)
+		wake_up_process(speedchange_task);
+}
+EXPORT_SYMBOL_GPL(interactive_gov_boost);
+
+/**
+ * interactive_policy_of - the interactive policy @cpu belongs to
+ *
+ * May be stale or run by another governor: check governor_enabled and
+ * gov before using it.
+ */
+struct interactive_policy *interactive_policy_of(int cpu)
+{
+	return per_cpu(icpu, cpu).ip;
+}
+EXPORT_SYMBOL_GPL(interactive_policy_of);
+
+/**
+ * interactive_get_tokenized_data - parse a "value" or "value freq:value ..."
+ * tunable into a kmalloc()ed array
+ */
+unsigned int *interactive_get_tokenized_data(const char *buf,
+					     int *num_tokens)
+{
+	const char *cp;
+	int i;
+	int ntokens = 1;
+	unsigned int *tokenized_data;
+	int err = -EINVAL;
+
+	cp = buf;
+	while ((cp = strpbrk(cp + 1, " :")))
+		ntokens++;
+
+	if (!(ntokens & 0x1))
+		goto err;
+
+	tokenized_data = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!tokenized_data) {
+		err = -ENOMEM;
+		goto err;
+	}
+
+	cp = buf;
+	i = 0;
+	while (i < ntokens) {
+		if (sscanf(cp, "%u", &tokenized_data[i++]) != 1)
+			goto err_kfree;
+
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+
+	if (i != ntokens)
+		goto err_kfree;
+
+	*num_tokens = ntokens;
+	return tokenized_data;
+
+err_kfree:
+	kfree(tokenized_data);
+err:
+	return ERR_PTR(err);
+}
+EXPORT_SYMBOL_GPL(interactive_get_tokenized_data);
+
+static void interactive_input_event(struct input_handle *handle,
+				    unsigned int type,
+				    unsigned int code, int value)
+{
+	struct interactive_gov *gov;
+	unsigned long flags;
+
+	if (type != EV_SYN || code != SYN_REPORT)
+		return;
+
+	spin_lock_irqsave(&gov_list_lock, flags);
+	list_for_each_entry(gov, &gov_list, node)
+		if (gov->active_count && gov->ops->input_event)
+			gov->ops->input_event();
+	spin_unlock_irqrestore(&gov_list_lock, flags);
+}
+
+static int interactive_input_connect(struct input_handler *handler,
+				     struct input_dev *dev,
+				     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err2;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err1;
+
+	return 0;
+err1:
+	input_unregister_handle(handle);
+err2:
+	kfree(handle);
+	return error;
+}
+
+static void interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id interactive_ids[] = {
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) |
+			    BIT_MASK(ABS_MT_POSITION_Y) },
+	}, /* multi-touch touchscreen */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] =
+			    BIT_MASK(ABS_X) | BIT_MASK(ABS_Y) },
+	}, /* touchpad */
+	{ },
+};
+
+static struct input_handler interactive_input_handler = {
+	.event		= interactive_input_event,
+	.connect	= interactive_input_connect,
+	.disconnect	= interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= interactive_ids,
+};
+
+static int interactive_gov_start(struct interactive_gov *gov,
+				 struct cpufreq_policy *policy)
+{
+	struct interactive_policy *ip = &per_cpu(ipolicy, policy->cpu);
+	unsigned int j;
+	int rc;
+
+	if (!cpu_online(policy->cpu))
+		return -EINVAL;
+
+	/*
+	 * Do not register the notifiers and create sysfs entries if
+	 * we have already done so.
+	 */
+	if (!gov->active_count) {
+		rc = sysfs_create_group(cpufreq_global_kobject,
+					gov->attr_group);
+		if (rc)
+			return rc;
+	}
+
+	down_write(&ip->enable_sem);
+	del_timer_sync(&ip->timer);
+	del_timer_sync(&ip->slack_timer);
+
+	ip->policy = policy;
+	ip->gov = gov;
+	ip->freq_table = cpufreq_frequency_get_table(policy->cpu);
+	ip->target_freq = policy->cur;
+	ip->floor_freq = ip->target_freq;
+	ip->floor_validate_time = ktime_to_us(ktime_get());
+	ip->hispeed_validate_time = ip->floor_validate_time;
+
+	if (gov->ops->start) {
+		rc = gov->ops->start(ip);
+		if (rc) {
+			up_write(&ip->enable_sem);
+			if (!gov->active_count)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   gov->attr_group);
+			return rc;
+		}
+	}
+
+	for_each_cpu(j, policy->cpus)
+		per_cpu(icpu, j).ip = ip;
+	mark_target_set(ip);
+	start_sample(ip, ip->policy->cpu);
+	ip->governor_enabled = 1;
+	up_write(&ip->enable_sem);
+
+	if (!gov->active_count++ && gov->ops->input_event &&
+	    !input_users++) {
+		rc = input_register_handler(&interactive_input_handler);
+		if (rc)
+			pr_warn("%s: failed to register input handler\n",
+				__func__);
+	}
+
+	if (!active_count++) {
+		idle_notifier_register(&interactive_idle_nb);
+		cpufreq_register_notifier(&interactive_transition_nb,
+					  CPUFREQ_TRANSITION_NOTIFIER);
+	}
+
+	return 0;
+}
+
+static void interactive_gov_stop(struct interactive_gov *gov,
+				 struct cpufreq_policy *policy)
+{
+	struct interactive_policy *ip = &per_cpu(ipolicy, policy->cpu);
+
+	down_write(&ip->enable_sem);
+	ip->governor_enabled = 0;
+	ip->target_freq = 0;
+	del_timer_sync(&ip->timer);
+	del_timer_sync(&ip->slack_timer);
+	up_write(&ip->enable_sem);
+
+	if (gov->ops->stop)
+		gov->ops->stop(ip);
+
+	if (!--active_count) {
+		cpufreq_unregister_notifier(&interactive_transition_nb,
+					    CPUFREQ_TRANSITION_NOTIFIER);
+		idle_notifier_unregister(&interactive_idle_nb);
+	}
+
+	if (--gov->active_count)
+		return;
+
+	if (gov->ops->input_event && !--input_users)
+		input_unregister_handler(&interactive_input_handler);
+
+	sysfs_remove_group(cpufreq_global_kobject, gov->attr_group);
+}
+
+static void interactive_gov_limits(struct cpufreq_policy *policy)
+{
+	struct interactive_policy *ip = &per_cpu(ipolicy, policy->cpu);
+
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy,
+				policy->max, CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy,
+				policy->min, CPUFREQ_RELATION_L);
+
+	/* hold write semaphore to avoid race */
+	down_write(&ip->enable_sem);
+	if (!ip->governor_enabled) {
+		up_write(&ip->enable_sem);
+		return;
+	}
+
+	/* update target_freq firstly */
+	if (policy->max < ip->target_freq)
+		ip->target_freq = policy->max;
+	else if (policy->min > ip->target_freq)
+		ip->target_freq = policy->min;
+
+	/*
+	 * Reschedule timer.
+	 * Delete the timers, else the timer callback may
+	 * return without re-arm the timer when failed
+	 * acquire the semaphore. This race may cause timer
+	 * stopped unexpectedly.
+	 */
+	del_timer_sync(&ip->timer);
+	del_timer_sync(&ip->slack_timer);
+	start_sample(ip, ip->policy->cpu);
+	up_write(&ip->enable_sem);
+}
+
+/**
+ * interactive_gov_event - cpufreq_governor::governor for a governor
+ * built on this core
+ */
+int interactive_gov_event(struct interactive_gov *gov,
+			  struct cpufreq_policy *policy, unsigned int event)
+{
+	int rc = 0;
+
+	mutex_lock(&gov_lock);
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		rc = interactive_gov_start(gov, policy);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		interactive_gov_stop(gov, policy);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		interactive_gov_limits(policy);
+		break;
+	}
+
+	mutex_unlock(&gov_lock);
+	return rc;
+}
+EXPORT_SYMBOL_GPL(interactive_gov_event);
+
+/**
+ * interactive_gov_register - make the core ready for @gov
+ *
+ * To be called before @gov registers its cpufreq_governor.
+ */
+int interactive_gov_register(struct interactive_gov *gov)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+	unsigned long flags;
+	int rc = 0;
+
+	mutex_lock(&gov_lock);
+
+	if (!nr_govs) {
+		speedchange_task =
+			kthread_create(interactive_speedchange_task, NULL,
+				       "cfinteractive");
+		if (IS_ERR(speedchange_task)) {
+			rc = PTR_ERR(speedchange_task);
+			goto out;
+		}
+
+		sched_setscheduler_nocheck(speedchange_task, SCHED_FIFO,
+					   &param);
+		get_task_struct(speedchange_task);
+
+		/* NB: wake up so the thread does not look hung to the freezer */
+		wake_up_process(speedchange_task);
+	}
+
+	nr_govs++;
+	spin_lock_irqsave(&gov_list_lock, flags);
+	list_add_tail(&gov->node, &gov_list);
+	spin_unlock_irqrestore(&gov_list_lock, flags);
+out:
+	mutex_unlock(&gov_lock);
+	return rc;
+}
+EXPORT_SYMBOL_GPL(interactive_gov_register);
+
+/**
+ * interactive_gov_unregister - undo interactive_gov_register()
+ *
+ * To be called after @gov unregistered its cpufreq_governor.
+ */
+void interactive_gov_unregister(struct interactive_gov *gov)
+{
+	unsigned long flags;
+
+	mutex_lock(&gov_lock);
+
+	spin_lock_irqsave(&gov_list_lock, flags);
+	list_del(&gov->node);
+	spin_unlock_irqrestore(&gov_list_lock, flags);
+
+	if (!--nr_govs) {
+		kthread_stop(speedchange_task);
+		put_task_struct(speedchange_task);
+	}
+
+	mutex_unlock(&gov_lock);
+}
+EXPORT_SYMBOL_GPL(interactive_gov_unregister);
+
+static int __init cpufreq_interactive_core_init(void)
+{
+	struct interactive_policy *ip;
+	unsigned int i;
+
+	for_each_possible_cpu(i) {
+		ip = &per_cpu(ipolicy, i);
+		init_timer_deferrable(&ip->timer);
+		ip->timer.function = interactive_timer;
+		ip->timer.data = i;
+		init_timer(&ip->slack_timer);
+		ip->slack_timer.function = interactive_nop_timer;
+		spin_lock_init(&ip->timer_lock);
+		init_rwsem(&ip->enable_sem);
+		spin_lock_init(&per_cpu(icpu, i).load_lock);
+	}
+
+	return 0;
+}
+
+/* Ahead of the governors, which register at fs_initcall when default. */
+core_initcall(cpufreq_interactive_core_init);
+
+static void __exit cpufreq_interactive_core_exit(void)
+{
+}
+
+module_exit(cpufreq_interactive_core_exit);
+
+MODULE_DESCRIPTION("Sampling engine of the interactive style cpufreq "
+	"governors");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,179 @@
+/*
+ * drivers/cpufreq/cpufreq_interactive_core.h
+ *
+ * Sampling engine shared by the interactive style governors.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CPUFREQ_INTERACTIVE_CORE_H
+#define _CPUFREQ_INTERACTIVE_CORE_H
+
+#include <linux/cpufreq.h>
+#include <linux/list.h>
+#include <linux/rwsem.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
+#include <linux/timer.h>
+#include <linux/types.h>
+
+struct interactive_policy;
+
+/* Load of a policy over the last sample window, taken from its busiest cpu */
+struct interactive_sample {
+	u64 now;			/* usecs */
+	unsigned int load;		/* % of the window not idle */
+	unsigned int load_since_change;	/* same, since the target last changed */
+	unsigned int loadadjfreq;	/* not idle time * speed, % * kHz */
+};
+
+struct interactive_gov_ops {
+	/*
+	 * Pick the frequency @ip should run at, or return 0 to leave the
+	 * target alone.  Called from the policy timer.
+	 */
+	unsigned int (*next_freq)(struct interactive_policy *ip,
+				  const struct interactive_sample *s);
+	/* Optional.  Called with gov_lock held. */
+	int (*start)(struct interactive_policy *ip);
+	void (*stop)(struct interactive_policy *ip);
+	/* Optional.  A cpu of @ip goes idle above the minimum speed. */
+	void (*idle_start)(struct interactive_policy *ip);
+	/* Optional.  From the speedchange thread, after @ip was set. */
+	void (*speed_changed)(struct interactive_policy *ip,
+			      unsigned int old_freq);
+	/* Optional.  A touchscreen or touchpad reported an event. */
+	void (*input_event)(void);
+};
+
+struct interactive_gov {
+	const struct interactive_gov_ops *ops;
+	struct attribute_group *attr_group;
+
+	/* Tunables every interactive style governor has */
+	unsigned long timer_rate;	/* usecs */
+	int timer_slack;		/* usecs beyond timer_rate, -1 for none */
+	bool io_is_busy;
+
+	/* private to the core */
+	int active_count;
+	struct list_head node;
+};
+
+/*
+ * State of one cpufreq policy, that is of one group of cpus sharing a
+ * clock, run by an interactive style governor.  The governor owns the
+ * fields up to and including hispeed_validate_time; the speedchange
+ * thread sets policy->cur to target_freq.
+ */
+struct interactive_policy {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	struct interactive_gov *gov;
+	unsigned int target_freq;
+	unsigned int floor_freq;
+	u64 floor_validate_time;
+	u64 hispeed_validate_time;
+
+	/* private to the core */
+	struct timer_list timer;
+	struct timer_list slack_timer;
+	int timer_cpu;
+	spinlock_t timer_lock;
+	struct rw_semaphore enable_sem;
+	int governor_enabled;
+};
+
+extern int interactive_gov_register(struct interactive_gov *gov);
+extern void interactive_gov_unregister(struct interactive_gov *gov);
+extern int interactive_gov_event(struct interactive_gov *gov,
+		struct cpufreq_policy *policy, unsigned int event);
+extern void interactive_gov_boost(struct interactive_gov *gov,
+		unsigned int freq);
+extern struct interactive_policy *interactive_policy_of(int cpu);
+extern unsigned int *interactive_get_tokenized_data(const char *buf,
+		int *num_tokens);
+
+/*
+ * Defines timer_rate_attr, timer_slack_attr and io_is_busy_attr for the
+ * common tunables of @_gov, for its attribute group.
+ */
+#define define_interactive_gov_attrs(_gov)				\
+static ssize_t show_timer_rate(struct kobject *kobj,			\
+		struct attribute *attr, char *buf)			\
+{									\
+	return sprintf(buf, "%lu\n", (_gov).timer_rate);		\
+}									\
+									\
+static ssize_t store_timer_rate(struct kobject *kobj,			\
+		struct attribute *attr, const char *buf, size_t count)	\
+{									\
+	int ret;							\
+	unsigned long val;						\
+									\
+	ret = strict_strtoul(buf, 0, &val);				\
+	if (ret < 0)							\
+		return ret;						\
+	if (!val)							\
+		return -EINVAL;						\
+	(_gov).timer_rate = val;					\
+	return count;							\
+}									\
+									\
+static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,	\
+		show_timer_rate, store_timer_rate);			\
+									\
+static ssize_t show_timer_slack(struct kobject *kobj,			\
+		struct attribute *attr, char *buf)			\
+{									\
+	return sprintf(buf, "%d\n", (_gov).timer_slack);		\
+}									\
+									\
+static ssize_t store_timer_slack(struct kobject *kobj,			\
+		struct attribute *attr, const char *buf, size_t count)	\
+{									\
+	int ret;							\
+	long val;							\
+									\
+	ret = strict_strtol(buf, 0, &val);				\
+	if (ret < 0)							\
+		return ret;						\
+	if (val < -1)							\
+		return -EINVAL;						\
+	(_gov).timer_slack = val;					\
+	return count;							\
+}									\
+									\
+static struct global_attr timer_slack_attr = __ATTR(timer_slack, 0644, \
+		show_timer_slack, store_timer_slack);			\
+									\
+static ssize_t show_io_is_busy(struct kobject *kobj,			\
+		struct attribute *attr, char *buf)			\
+{									\
+	return sprintf(buf, "%u\n", (_gov).io_is_busy);			\
+}									\
+									\
+static ssize_t store_io_is_busy(struct kobject *kobj,			\
+		struct attribute *attr, const char *buf, size_t count)	\
+{									\
+	int ret;							\
+	unsigned long val;						\
+									\
+	ret = strict_strtoul(buf, 0, &val);				\
+	if (ret < 0)							\
+		return ret;						\
+	(_gov).io_is_busy = !!val;					\
+	return count;							\
+}									\
+									\
+static struct global_attr io_is_busy_attr = __ATTR(io_is_busy, 0644,	\
+		show_io_is_busy, store_io_is_busy)
+
+#endif /* _CPUFREQ_INTERACTIVE_CORE_H */
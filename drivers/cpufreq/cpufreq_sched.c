@@ -0,0 +1,379 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * Scheduler driven cpufreq governor.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * The scheduler reports the decayed utilization of a cpu every time a
+ * CFS task is enqueued, dequeued or ticks (see cpufreq_sched_update_util()),
+ * with the runqueue lock held.  Nothing that can sleep or take other
+ * scheduler locks may run from there, so a frequency change is only
+ * flagged, and the cpu whose utilization changed wakes up the speedchange
+ * thread once its runqueue lock is dropped: at its next context switch or
+ * tick (see cpufreq_sched_kick()).  A cpu that goes idle right after
+ * flagging does so through a context switch, so the request does not
+ * wait for it to wake up again.  The thread then programs the frequency
+ * the policy needs at that time, so only the latest request counts.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/jiffies.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+
+struct cpufreq_sched_cpuinfo {
+	struct cpufreq_policy *policy;
+	struct cpufreq_frequency_table *freq_table;
+	unsigned long util;
+	unsigned long util_stamp;
+	/* valid on the policy->cpu entry only */
+	unsigned int down_freq;
+	unsigned long freq_change_time;
+	int governor_enabled;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpuinfo, cpuinfo);
+/* the cpu flagged a policy since it last woke up the thread */
+static DEFINE_PER_CPU(int, speedchange_kick);
+
+static atomic_t active_count = ATOMIC_INIT(0);
+
+static struct task_struct *speedchange_task;
+static cpumask_t speedchange_cpumask;
+static DEFINE_SPINLOCK(speedchange_cpumask_lock);
+static DEFINE_MUTEX(set_speed_lock);
+
+/* Headroom over the utilization, in percent */
+#define DEFAULT_MARGIN 25
+static unsigned int margin = DEFAULT_MARGIN;
+
+/* Minimum time at a frequency before lowering it */
+#define DEFAULT_DOWN_DELAY_MS 40
+static unsigned int down_delay_ms = DEFAULT_DOWN_DELAY_MS;
+
+/*
+ * A cpu that has not reported for this many jiffies is idle (its tick
+ * is stopped, or the idle task is running) and does not hold up the
+ * frequency of the cpus it shares a clock with.
+ */
+#define UTIL_STALE_JIFFIES 2
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event);
+
+static struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+/*
+ * Raw frequency the cpus of @policy need: the busiest one's utilization
+ * plus margin, scaled to policy->max.  Not yet resolved to the table.
+ */
+static unsigned int cpufreq_sched_policy_target(struct cpufreq_policy *policy)
+{
+	unsigned int j;
+	unsigned long util = 0;
+
+	for_each_cpu(j, policy->cpus) {
+		struct cpufreq_sched_cpuinfo *pjcpu = &per_cpu(cpuinfo, j);
+
+		if (time_after(jiffies, pjcpu->util_stamp + UTIL_STALE_JIFFIES))
+			continue;
+		if (pjcpu->util > util)
+			util = pjcpu->util;
+	}
+
+	return div_u64((u64)util * policy->max * (100 + margin),
+		       100 * SCHED_POWER_SCALE);
+}
+
+/*
+ * Highest table frequency below the current one: a target at or below
+ * it resolves (CPUFREQ_RELATION_L) to a lower frequency than policy->cur.
+ */
+static void cpufreq_sched_update_down_freq(struct cpufreq_sched_cpuinfo *pcpu)
+{
+	struct cpufreq_policy *policy = pcpu->policy;
+	unsigned int index;
+
+	pcpu->down_freq = 0;
+	if (!pcpu->freq_table || policy->cur <= policy->min)
+		return;
+
+	if (!cpufreq_frequency_table_target(policy, pcpu->freq_table,
+					    policy->cur - 1,
+					    CPUFREQ_RELATION_H, &index))
+		pcpu->down_freq = pcpu->freq_table[index].frequency;
+}
+
+/* Called from the scheduler with the runqueue of @cpu locked. */
+void cpufreq_sched_update_util(int cpu, unsigned long util)
+{
+	struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	struct cpufreq_sched_cpuinfo *ppcpu;
+	struct cpufreq_policy *policy;
+	unsigned int target;
+
+	pcpu->util = util;
+	pcpu->util_stamp = jiffies;
+
+	if (!pcpu->governor_enabled)
+		return;
+	smp_rmb();
+
+	policy = pcpu->policy;
+	ppcpu = &per_cpu(cpuinfo, policy->cpu);
+	target = cpufreq_sched_policy_target(policy);
+
+	if (target > policy->cur) {
+		if (policy->cur >= policy->max)
+			return;
+	} else if (target > ppcpu->down_freq ||
+		   time_before(jiffies, ppcpu->freq_change_time +
+			       msecs_to_jiffies(down_delay_ms))) {
+		return;
+	}
+
+	/*
+	 * Flag the policy even if another cpu already did: that one may be
+	 * asleep and not get to wake up the thread for a while.
+	 */
+	spin_lock(&speedchange_cpumask_lock);
+	cpumask_set_cpu(policy->cpu, &speedchange_cpumask);
+	spin_unlock(&speedchange_cpumask_lock);
+
+	per_cpu(speedchange_kick, cpu) = 1;
+}
+
+/*
+ * Called by the scheduler on @cpu, after a context switch or tick, with
+ * no runqueue lock held.
+ */
+void cpufreq_sched_kick(int cpu)
+{
+	if (xchg(&per_cpu(speedchange_kick, cpu), 0))
+		wake_up_process(speedchange_task);
+}
+
+static int cpufreq_sched_speedchange_task(void *data)
+{
+	unsigned int cpu;
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+
+		if (cpumask_empty(&speedchange_cpumask)) {
+			spin_unlock_irqrestore(&speedchange_cpumask_lock,
+					       flags);
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+
+			spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+		}
+
+		set_current_state(TASK_RUNNING);
+		tmp_mask = speedchange_cpumask;
+		cpumask_clear(&speedchange_cpumask);
+		spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+		for_each_cpu(cpu, &tmp_mask) {
+			struct cpufreq_policy *policy;
+			unsigned int target;
+
+			pcpu = &per_cpu(cpuinfo, cpu);
+			mutex_lock(&set_speed_lock);
+			smp_rmb();
+
+			if (!pcpu->governor_enabled) {
+				mutex_unlock(&set_speed_lock);
+				continue;
+			}
+
+			/* utilization may have moved on since the request */
+			policy = pcpu->policy;
+			target = cpufreq_sched_policy_target(policy);
+			if (target < policy->cur &&
+			    time_before(jiffies, pcpu->freq_change_time +
+					msecs_to_jiffies(down_delay_ms))) {
+				mutex_unlock(&set_speed_lock);
+				continue;
+			}
+
+			__cpufreq_driver_target(policy, target,
+						CPUFREQ_RELATION_L);
+			pcpu->freq_change_time = jiffies;
+			cpufreq_sched_update_down_freq(pcpu);
+			mutex_unlock(&set_speed_lock);
+		}
+	}
+
+	return 0;
+}
+
+static ssize_t show_margin(struct kobject *kobj,
+			   struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", margin);
+}
+
+static ssize_t store_margin(struct kobject *kobj, struct attribute *attr,
+			    const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 100)
+		return -EINVAL;
+	margin = val;
+	return count;
+}
+
+static struct global_attr margin_attr = __ATTR(margin, 0644,
+		show_margin, store_margin);
+
+static ssize_t show_down_delay_ms(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", down_delay_ms);
+}
+
+static ssize_t store_down_delay_ms(struct kobject *kobj,
+				   struct attribute *attr,
+				   const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	down_delay_ms = val;
+	return count;
+}
+
+static struct global_attr down_delay_ms_attr = __ATTR(down_delay_ms, 0644,
+		show_down_delay_ms, store_down_delay_ms);
+
+static struct attribute *sched_attributes[] = {
+	&margin_attr.attr,
+	&down_delay_ms_attr.attr,
+	NULL,
+};
+
+static struct attribute_group sched_attr_group = {
+	.attrs = sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event)
+{
+	int rc;
+	unsigned int j;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	struct cpufreq_frequency_table *freq_table;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu))
+			return -EINVAL;
+
+		freq_table = cpufreq_frequency_get_table(policy->cpu);
+
+		mutex_lock(&set_speed_lock);
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->policy = policy;
+			pcpu->freq_table = freq_table;
+			pcpu->freq_change_time = jiffies;
+			cpufreq_sched_update_down_freq(pcpu);
+			smp_wmb();
+			pcpu->governor_enabled = 1;
+		}
+		mutex_unlock(&set_speed_lock);
+
+		if (atomic_inc_return(&active_count) > 1)
+			return 0;
+
+		rc = sysfs_create_group(cpufreq_global_kobject,
+				&sched_attr_group);
+		if (rc)
+			return rc;
+
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		mutex_lock(&set_speed_lock);
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->governor_enabled = 0;
+			smp_wmb();
+		}
+		mutex_unlock(&set_speed_lock);
+
+		if (atomic_dec_return(&active_count) > 0)
+			return 0;
+
+		sysfs_remove_group(cpufreq_global_kobject,
+				&sched_attr_group);
+
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		mutex_lock(&set_speed_lock);
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		cpufreq_sched_update_down_freq(&per_cpu(cpuinfo, policy->cpu));
+		mutex_unlock(&set_speed_lock);
+		break;
+	}
+	return 0;
+}
+
+static int __init cpufreq_sched_init(void)
+{
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+
+	speedchange_task = kthread_create(cpufreq_sched_speedchange_task, NULL,
+					  "ksched_freq");
+	if (IS_ERR(speedchange_task))
+		return PTR_ERR(speedchange_task);
+
+	sched_setscheduler_nocheck(speedchange_task, SCHED_FIFO, &param);
+	get_task_struct(speedchange_task);
+
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+module_init(cpufreq_sched_init);
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A scheduler driven cpufreq governor");
+MODULE_LICENSE("GPL");
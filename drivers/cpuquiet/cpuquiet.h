@@ -22,6 +22,7 @@
 #include <linux/sysdev.h>
 
 extern struct mutex cpuquiet_lock;
+extern bool cpuquiet_soft_quiesce;
 extern struct cpuquiet_governor *cpuquiet_curr_governor;
 extern struct list_head cpuquiet_governors;
 int cpuquiet_add_class_sysfs(struct sysdev_class *cls);
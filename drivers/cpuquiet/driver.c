@@ -21,26 +21,51 @@
 #include <linux/cpuquiet.h>
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
 #include <asm/cputime.h>
 
 #include "cpuquiet.h"
 
+/* log2 buckets of transition latency in usec, the last one open ended */
+#define CPUQUIET_LAT_BUCKETS	20
+
+struct cpuquiet_lat_hist {
+	unsigned int bucket[CPUQUIET_LAT_BUCKETS];
+	unsigned int max_us;
+};
+
 struct cpuquiet_cpu_stat {
 	cputime64_t time_up_total;
 	u64 last_update;
 	unsigned int up_down_count;
+	struct cpuquiet_lat_hist up_latency;
+	struct cpuquiet_lat_hist down_latency;
+	struct cpuquiet_lat_hist soft_up_latency;
+	struct cpuquiet_lat_hist soft_down_latency;
 	struct kobject cpu_kobject;
 };
 
 struct cpu_attribute {
 	struct attribute attr;
-	enum { up_down_count, time_up_total } type;
+	enum { up_down_count, time_up_total, up_latency, down_latency,
+		soft_up_latency, soft_down_latency } type;
 };
 
 static struct cpuquiet_driver *cpuquiet_curr_driver;
 struct cpuquiet_cpu_stat *stats;
 
+/*
+ * With soft_quiesce set, cpus are quiesced by isolating them from the
+ * scheduler instead of taking them offline, see
+ * sched_set_cpu_soft_isolated(). Waking a soft quiesced cpu always
+ * takes the soft path back, whatever soft_quiesce is by then.
+ */
+bool cpuquiet_soft_quiesce;
+static DECLARE_BITMAP(soft_quiesced_bits, CONFIG_NR_CPUS);
+#define soft_quiesced_mask to_cpumask(soft_quiesced_bits)
+
 #define CPU_ATTRIBUTE(_name) \
 	static struct cpu_attribute _name ## _attr = {			\
 		.attr =  {.name = __stringify(_name), .mode = 0444 },	\
@@ -49,13 +74,53 @@ struct cpuquiet_cpu_stat *stats;
 
 CPU_ATTRIBUTE(up_down_count);
 CPU_ATTRIBUTE(time_up_total);
+CPU_ATTRIBUTE(up_latency);
+CPU_ATTRIBUTE(down_latency);
+CPU_ATTRIBUTE(soft_up_latency);
+CPU_ATTRIBUTE(soft_down_latency);
 
 static struct attribute *cpu_attributes[] = {
 	&up_down_count_attr.attr,
 	&time_up_total_attr.attr,
+	&up_latency_attr.attr,
+	&down_latency_attr.attr,
+	&soft_up_latency_attr.attr,
+	&soft_down_latency_attr.attr,
 	NULL,
 };
 
+static void lat_hist_add(struct cpuquiet_lat_hist *hist, ktime_t start)
+{
+	unsigned int us = ktime_us_delta(ktime_get(), start);
+	int i = fls(us);
+
+	if (i >= CPUQUIET_LAT_BUCKETS)
+		i = CPUQUIET_LAT_BUCKETS - 1;
+	hist->bucket[i]++;
+	if (us > hist->max_us)
+		hist->max_us = us;
+}
+
+/* One "<upper bound usec> <count>" line per bucket, then the maximum */
+static ssize_t lat_hist_show(struct cpuquiet_lat_hist *hist, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < CPUQUIET_LAT_BUCKETS - 1; i++)
+		len += sprintf(buf + len, "%u %u\n", 1U << i, hist->bucket[i]);
+	len += sprintf(buf + len, "inf %u\n", hist->bucket[i]);
+	len += sprintf(buf + len, "max %u\n", hist->max_us);
+
+	return len;
+}
+
+bool cpuquiet_soft_quiesced(unsigned int cpunumber)
+{
+	return cpumask_test_cpu(cpunumber, soft_quiesced_mask);
+}
+EXPORT_SYMBOL(cpuquiet_soft_quiesced);
+
 static void stats_update(struct cpuquiet_cpu_stat *stat, bool up)
 {
 	u64 cur_jiffies = get_jiffies_64();
@@ -74,12 +139,29 @@ static void stats_update(struct cpuquiet_cpu_stat *stat, bool up)
 int cpuquiet_quiesence_cpu(unsigned int cpunumber)
 {
 	int err = -EPERM;
+	bool soft = false;
+	ktime_t start = ktime_get();
+
+	if (cpunumber >= nr_cpu_ids || !cpuquiet_curr_driver)
+		return err;
 
-	if (cpuquiet_curr_driver && cpuquiet_curr_driver->quiesence_cpu)
+	if (cpuquiet_soft_quiesced(cpunumber))
+		return 0;
+
+	if (cpuquiet_soft_quiesce && cpu_online(cpunumber)) {
+		soft = true;
+		err = sched_set_cpu_soft_isolated(cpunumber, true);
+		if (!err)
+			cpumask_set_cpu(cpunumber, soft_quiesced_mask);
+	} else if (cpuquiet_curr_driver->quiesence_cpu) {
 		err = cpuquiet_curr_driver->quiesence_cpu(cpunumber);
+	}
 
-	if (!err)
+	if (!err) {
+		lat_hist_add(soft ? &stats[cpunumber].soft_down_latency :
+				    &stats[cpunumber].down_latency, start);
 		stats_update(stats + cpunumber, 0);
+	}
 
 	return err;
 }
@@ -88,12 +170,32 @@ EXPORT_SYMBOL(cpuquiet_quiesence_cpu);
 int cpuquiet_wake_cpu(unsigned int cpunumber)
 {
 	int err = -EPERM;
+	bool soft = false;
+	ktime_t start = ktime_get();
+
+	if (cpunumber >= nr_cpu_ids || !cpuquiet_curr_driver)
+		return err;
+
+	if (cpuquiet_soft_quiesced(cpunumber)) {
+		err = sched_set_cpu_soft_isolated(cpunumber, false);
+		if (err)
+			return err;
+		cpumask_clear_cpu(cpunumber, soft_quiesced_mask);
+		/* unless it was taken offline behind our back meanwhile */
+		soft = cpu_online(cpunumber);
+		err = -EPERM;
+	}
 
-	if (cpuquiet_curr_driver && cpuquiet_curr_driver->wake_cpu)
+	if (soft)
+		err = 0;
+	else if (cpuquiet_curr_driver->wake_cpu)
 		err = cpuquiet_curr_driver->wake_cpu(cpunumber);
 
-	if (!err)
+	if (!err) {
+		lat_hist_add(soft ? &stats[cpunumber].soft_up_latency :
+				    &stats[cpunumber].up_latency, start);
 		stats_update(stats + cpunumber, 1);
+	}
 
 	return err;
 }
@@ -118,6 +220,18 @@ static ssize_t stats_sysfs_show(struct kobject *kobj,
 	case time_up_total:
 		len =  sprintf(buf, "%llu\n", stat->time_up_total);
 		break;
+	case up_latency:
+		len = lat_hist_show(&stat->up_latency, buf);
+		break;
+	case down_latency:
+		len = lat_hist_show(&stat->down_latency, buf);
+		break;
+	case soft_up_latency:
+		len = lat_hist_show(&stat->soft_up_latency, buf);
+		break;
+	case soft_down_latency:
+		len = lat_hist_show(&stat->soft_down_latency, buf);
+		break;
 	}
 
 	return len;
@@ -189,6 +303,11 @@ void cpuquiet_unregister_driver(struct cpuquiet_driver *drv)
 	/* stop current governor first */
 	cpuquiet_switch_governor(NULL);
 
+	/* nobody is left to wake soft quiesced cpus */
+	for_each_cpu(cpu, soft_quiesced_mask)
+		if (!sched_set_cpu_soft_isolated(cpu, false))
+			cpumask_clear_cpu(cpu, soft_quiesced_mask);
+
 	mutex_lock(&cpuquiet_lock);
 	cpuquiet_curr_driver = NULL;
 
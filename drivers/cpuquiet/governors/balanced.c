@@ -29,6 +29,9 @@
 #include <linux/tick.h>
 #include <asm/cputime.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/cpuquiet.h>
+
 #define CPUNAMELEN 8
 
 typedef enum {
@@ -69,6 +72,16 @@ static struct delayed_work balanced_work;
 static BALANCED_STATE balanced_state;
 static struct kobject *balanced_kobject;
 
+/* event driven mode */
+static bool event_driven;
+static unsigned long up_hold;
+static unsigned long down_hold;
+static struct work_struct balanced_event_work;
+static struct sched_nr_avg balanced_nr_window;
+static bool sched_nr_nb_registered;
+static int pending_dir;
+static unsigned long pending_since;
+
 static void calculate_load_timer(unsigned long data)
 {
 	int i;
@@ -122,13 +135,46 @@ static void stop_load_timer(void)
 	del_timer(&load_timer);
 }
 
+/*
+ * Soft quiesced cpus are online but out of the scheduler's way: they
+ * neither count towards nor take part in the balance.
+ */
+#define for_each_active_cpu(cpu)				\
+	for_each_online_cpu(cpu)				\
+		if (cpuquiet_soft_quiesced(cpu)) {} else
+
+static unsigned int nr_active_cpus(void)
+{
+	unsigned int cnt = 0;
+	int i;
+
+	for_each_active_cpu(i)
+		cnt++;
+
+	return cnt;
+}
+
+/* Next cpu to bring up: offline or soft quiesced */
+static unsigned int get_inactive_cpu_n(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (cpu > 0 && (!cpu_online(cpu) ||
+				cpuquiet_soft_quiesced(cpu)))
+			return cpu;
+	}
+
+	return nr_cpu_ids;
+}
+
 static unsigned int get_slowest_cpu_n(void)
 {
 	unsigned int cpu = nr_cpu_ids;
 	unsigned long minload = ULONG_MAX;
 	int i;
 
-	for_each_online_cpu(i) {
+	for_each_active_cpu(i) {
 		unsigned int *load = &per_cpu(cpu_load, i);
 
 		if ((i > 0) && (minload > *load)) {
@@ -145,7 +191,7 @@ static unsigned int cpu_highest_speed(void)
 	unsigned int maxload = 0;
 	int i;
 
-	for_each_online_cpu(i) {
+	for_each_active_cpu(i) {
 		unsigned int *load = &per_cpu(cpu_load, i);
 
 		maxload = max(maxload, *load);
@@ -159,7 +205,7 @@ static unsigned int count_slow_cpus(unsigned int limit)
 	unsigned int cnt = 0;
 	int i;
 
-	for_each_online_cpu(i) {
+	for_each_active_cpu(i) {
 		unsigned int *load = &per_cpu(cpu_load, i);
 
 		if (*load <= limit)
@@ -177,14 +223,17 @@ static unsigned int nr_run_thresholds[] = {
 static unsigned int nr_run_hysteresis = 2;	/* 0.5 thread */
 static unsigned int nr_run_last;
 
-static CPU_SPEED_BALANCE balanced_speed_balance(void)
+/*
+ * @avg_nr_run is the average number of runnable threads, FSHIFT fixed
+ * point like avg_nr_running().
+ */
+static CPU_SPEED_BALANCE balanced_speed_balance(unsigned int avg_nr_run)
 {
 	unsigned long highest_speed = cpu_highest_speed();
 	unsigned long balanced_speed = highest_speed * balance_level / 100;
 	unsigned long skewed_speed = balanced_speed / 2;
-	unsigned int nr_cpus = num_online_cpus();
+	unsigned int nr_cpus = nr_active_cpus();
 	unsigned int max_cpus = pm_qos_request(PM_QOS_MAX_ONLINE_CPUS) ? : 4;
-	unsigned int avg_nr_run = avg_nr_running();
 	unsigned int nr_run;
 
 	/* balanced: freq targets for all CPUs are above 50% of highest speed
@@ -210,6 +259,132 @@ static CPU_SPEED_BALANCE balanced_speed_balance(void)
 	return CPU_SPEED_BALANCED;
 }
 
+/* cpu_load from the scheduler's decayed utilization instead of idle time */
+static void sample_sched_load(void)
+{
+	int i;
+
+	for_each_active_cpu(i)
+		per_cpu(cpu_load, i) =
+			(sched_cpu_util(i) * 100) >> SCHED_POWER_SHIFT;
+}
+
+/*
+ * Re-evaluate after @delay even if no event comes in, replacing any
+ * later evaluation already scheduled. Only called from balanced_wq.
+ */
+static void balanced_recheck(unsigned long delay)
+{
+	cancel_delayed_work(&balanced_work);
+	queue_delayed_work(balanced_wq, &balanced_work, delay);
+}
+
+/*
+ * Event driven mode: evaluated when the cpu frequency changes or a cpu
+ * starts queueing threads, rather than every up_delay off a sampling
+ * timer. The number of runnable threads is the larger of a short and a
+ * long term moving average of nr_running, so it rises fast and decays
+ * slowly, and a decision is only carried out once it has been wanted
+ * for up_hold (down_hold), down_delay still applying on top.
+ */
+static void balanced_event_evaluate(void)
+{
+	unsigned long now = jiffies;
+	unsigned long hold, wait = 0;
+	unsigned int avg_nr;
+	unsigned int cpu = nr_cpu_ids;
+	int dir = 0;
+
+	sched_nr_avg_update(&balanced_nr_window);
+	avg_nr = max(balanced_nr_window.avg_short, balanced_nr_window.avg_long);
+	sample_sched_load();
+
+	switch (balanced_state) {
+	case IDLE:
+		break;
+	case DOWN:
+		cpu = get_slowest_cpu_n();
+		if (cpu < nr_cpu_ids)
+			dir = -1;
+		break;
+	case UP:
+		switch (balanced_speed_balance(avg_nr * FIXED_1 / 100)) {
+		case CPU_SPEED_BALANCED:
+			cpu = get_inactive_cpu_n();
+			if (cpu < nr_cpu_ids)
+				dir = 1;
+			break;
+		case CPU_SPEED_SKEWED:
+			cpu = get_slowest_cpu_n();
+			if (cpu < nr_cpu_ids)
+				dir = -1;
+			break;
+		case CPU_SPEED_BIASED:
+		default:
+			break;
+		}
+		break;
+	default:
+		pr_err("%s: invalid cpuquiet balanced governor state %d\n",
+		       __func__, balanced_state);
+	}
+
+	if (dir != pending_dir) {
+		pending_dir = dir;
+		pending_since = now;
+	}
+	hold = dir > 0 ? up_hold : down_hold;
+
+	if (dir && time_before(now, pending_since + hold))
+		wait = pending_since + hold - now;
+	else if (dir < 0 && time_before(now, last_change_time + down_delay))
+		wait = last_change_time + down_delay - now;
+
+	trace_cpuquiet_balanced_decision(balanced_state, avg_nr,
+		cpu_highest_speed(), nr_active_cpus(), dir,
+		jiffies_to_msecs(now - pending_since),
+		dir && !wait ? cpu : -1);
+
+	if (dir && !wait) {
+		last_change_time = now;
+		/* a further step has to be held again */
+		pending_since = now;
+		if (dir > 0)
+			cpuquiet_wake_cpu(cpu);
+		else
+			cpuquiet_quiesence_cpu(cpu);
+		wait = hold;
+	}
+
+	/*
+	 * Nothing may move for a while once the load settles, so keep a
+	 * slow evaluation going while not idle.
+	 */
+	if (balanced_state != IDLE)
+		balanced_recheck(wait ? : down_hold);
+	else
+		pending_dir = 0;
+}
+
+static void balanced_event_func(struct work_struct *work)
+{
+	if (event_driven)
+		balanced_event_evaluate();
+}
+
+static int balanced_sched_nr_notify(struct notifier_block *nb,
+	unsigned long val, void *data)
+{
+	if (event_driven && balanced_state == UP)
+		queue_work(balanced_wq, &balanced_event_work);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block balanced_sched_nr_nb = {
+	.notifier_call = balanced_sched_nr_notify,
+};
+
 static void balanced_work_func(struct work_struct *work)
 {
 	bool up = false;
@@ -218,6 +393,11 @@ static void balanced_work_func(struct work_struct *work)
 
 	CPU_SPEED_BALANCE balance;
 
+	if (event_driven) {
+		balanced_event_evaluate();
+		return;
+	}
+
 	switch (balanced_state) {
 	case IDLE:
 		break;
@@ -231,12 +411,12 @@ static void balanced_work_func(struct work_struct *work)
 			stop_load_timer();
 		break;
 	case UP:
-		balance = balanced_speed_balance();
+		balance = balanced_speed_balance(avg_nr_running());
 		switch (balance) {
 
 		/* cpu speed is up and balanced - one more on-line */
 		case CPU_SPEED_BALANCED:
-			cpu = cpumask_next_zero(0, cpu_online_mask);
+			cpu = get_inactive_cpu_n();
 			if (cpu < nr_cpu_ids)
 				up = true;
 			break;
@@ -271,6 +451,21 @@ static void balanced_work_func(struct work_struct *work)
 	}
 }
 
+/*
+ * Start evaluating after a state change: right away in event driven
+ * mode, after @delay and off the load timer otherwise.
+ */
+static void balanced_kick(unsigned long delay)
+{
+	if (event_driven) {
+		queue_work(balanced_wq, &balanced_event_work);
+		return;
+	}
+
+	queue_delayed_work(balanced_wq, &balanced_work, delay);
+	start_load_timer();
+}
+
 static int balanced_cpufreq_transition(struct notifier_block *nb,
 	unsigned long state, void *data)
 {
@@ -284,37 +479,32 @@ static int balanced_cpufreq_transition(struct notifier_block *nb,
 		case IDLE:
 			if (cpu_freq >= idle_top_freq) {
 				balanced_state = UP;
-				queue_delayed_work(
-					balanced_wq, &balanced_work, up_delay);
-				start_load_timer();
+				balanced_kick(up_delay);
 			} else if (cpu_freq <= idle_bottom_freq) {
 				balanced_state = DOWN;
-				queue_delayed_work(
-					balanced_wq, &balanced_work,
-					down_delay);
-				start_load_timer();
+				balanced_kick(down_delay);
 			}
 			break;
 		case DOWN:
 			if (cpu_freq >= idle_top_freq) {
 				balanced_state = UP;
-				queue_delayed_work(
-					balanced_wq, &balanced_work, up_delay);
-				start_load_timer();
+				balanced_kick(up_delay);
 			}
 			break;
 		case UP:
 			if (cpu_freq <= idle_bottom_freq) {
 				balanced_state = DOWN;
-				queue_delayed_work(balanced_wq,
-					&balanced_work, up_delay);
-				start_load_timer();
+				balanced_kick(up_delay);
 			}
 			break;
 		default:
 			pr_err("%s: invalid cpuquiet balanced governor "
 				"state %d\n", __func__, balanced_state);
 		}
+
+		/* any frequency change is worth a look in event mode */
+		if (event_driven && balanced_state != IDLE)
+			queue_work(balanced_wq, &balanced_event_work);
 	}
 
 	return NOTIFY_OK;
@@ -334,12 +524,50 @@ static void delay_callback(struct cpuquiet_attribute *attr)
 	}
 }
 
+static void balanced_sched_nr_register(void)
+{
+	if (sched_nr_nb_registered)
+		return;
+
+	sched_nr_avg_init(&balanced_nr_window);
+	pending_dir = 0;
+	/* without it only cpufreq transitions and rechecks drive decisions */
+	sched_nr_nb_registered =
+		!sched_nr_register_notifier(&balanced_sched_nr_nb);
+}
+
+static void balanced_sched_nr_unregister(void)
+{
+	if (!sched_nr_nb_registered)
+		return;
+
+	sched_nr_unregister_notifier(&balanced_sched_nr_nb);
+	sched_nr_nb_registered = false;
+}
+
+static void event_driven_callback(struct cpuquiet_attribute *attr)
+{
+	if (event_driven) {
+		stop_load_timer();
+		balanced_sched_nr_register();
+		queue_work(balanced_wq, &balanced_event_work);
+	} else {
+		balanced_sched_nr_unregister();
+		if (balanced_state != IDLE)
+			balanced_kick(up_delay);
+	}
+}
+
 CPQ_BASIC_ATTRIBUTE(balance_level, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(idle_bottom_freq, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(idle_top_freq, 0644, uint);
 CPQ_BASIC_ATTRIBUTE(load_sample_rate, 0644, uint);
 CPQ_ATTRIBUTE(up_delay, 0644, ulong, delay_callback);
 CPQ_ATTRIBUTE(down_delay, 0644, ulong, delay_callback);
+CPQ_BASIC_ATTRIBUTE(nr_run_hysteresis, 0644, uint);
+CPQ_ATTRIBUTE(event_driven, 0644, bool, event_driven_callback);
+CPQ_ATTRIBUTE(up_hold, 0644, ulong, delay_callback);
+CPQ_ATTRIBUTE(down_hold, 0644, ulong, delay_callback);
 
 static struct attribute *balanced_attributes[] = {
 	&balance_level_attr.attr,
@@ -348,6 +576,10 @@ static struct attribute *balanced_attributes[] = {
 	&up_delay_attr.attr,
 	&down_delay_attr.attr,
 	&load_sample_rate_attr.attr,
+	&nr_run_hysteresis_attr.attr,
+	&event_driven_attr.attr,
+	&up_hold_attr.attr,
+	&down_hold_attr.attr,
 	NULL,
 };
 
@@ -388,9 +620,11 @@ static void balanced_stop(void)
 	*/
 	cpufreq_unregister_notifier(&balanced_cpufreq_nb,
 		CPUFREQ_TRANSITION_NOTIFIER);
+	balanced_sched_nr_unregister();
 
 	/* now we can force the governor to be idle */
 	balanced_state = IDLE;
+	cancel_work_sync(&balanced_event_work);
 	cancel_delayed_work_sync(&balanced_work);
 	destroy_workqueue(balanced_wq);
 	del_timer(&load_timer);
@@ -414,9 +648,12 @@ static int balanced_start(void)
 		return -ENOMEM;
 
 	INIT_DELAYED_WORK(&balanced_work, balanced_work_func);
+	INIT_WORK(&balanced_event_work, balanced_event_func);
 
 	up_delay = msecs_to_jiffies(100);
 	down_delay = msecs_to_jiffies(500);
+	up_hold = msecs_to_jiffies(4);
+	down_hold = msecs_to_jiffies(100);
 
 	table = cpufreq_frequency_get_table(0);
 	for (count = 0; table[count].frequency != CPUFREQ_TABLE_END; count++);
@@ -430,6 +667,9 @@ static int balanced_start(void)
 	init_timer(&load_timer);
 	load_timer.function = calculate_load_timer;
 
+	if (event_driven)
+		balanced_sched_nr_register();
+
 	/*FIXME: Kick start the state machine by faking a freq notification*/
 	initial_freq.new = cpufreq_get(0);
 	if (initial_freq.new != 0)
@@ -103,14 +103,38 @@ static ssize_t available_governors_show(char *buf)
 	return ret;
 }
 
+static ssize_t show_soft_quiesce(char *buf)
+{
+	return sprintf(buf, "%d\n", cpuquiet_soft_quiesce);
+}
+
+static ssize_t store_soft_quiesce(const char *buf, size_t count)
+{
+	int err, val;
+
+	err = kstrtoint(buf, 0, &val);
+	if (err < 0)
+		return err;
+
+	if (val < 0 || val > 1)
+		return -EINVAL;
+
+	cpuquiet_soft_quiesce = val;
+
+	return count;
+}
+
 struct cpuquiet_sysfs_attr attr_current_governor = __ATTR(current_governor,
 			0644, show_current_governor, store_current_governor);
 struct cpuquiet_sysfs_attr attr_governors = __ATTR_RO(available_governors);
+struct cpuquiet_sysfs_attr attr_soft_quiesce = __ATTR(soft_quiesce,
+			0644, show_soft_quiesce, store_soft_quiesce);
 
 
 static struct attribute *cpuquiet_default_attrs[] = {
 	&attr_current_governor.attr,
 	&attr_governors.attr,
+	&attr_soft_quiesce.attr,
 	NULL
 };
 
@@ -232,7 +256,8 @@ static ssize_t cpuquiet_state_store(struct kobject *kobj,
 
 static ssize_t show_active(unsigned int cpu, char *buf)
 {
-	return sprintf(buf, "%u\n", cpu_online(cpu));
+	return sprintf(buf, "%u\n",
+		       cpu_online(cpu) && !cpuquiet_soft_quiesced(cpu));
 }
 
 static ssize_t store_active(unsigned int cpu, const char *value, size_t count)
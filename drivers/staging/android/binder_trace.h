@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2012 Google, Inc.
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct binder_node;
+struct binder_transaction;
+
+TRACE_EVENT(binder_transaction,
+	TP_PROTO(bool reply, struct binder_transaction *t,
+		 struct binder_node *target_node),
+	TP_ARGS(reply, t, target_node),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, target_node)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->target_node = target_node ? target_node->debug_id : 0;
+		__entry->to_proc = t->to_proc->pid;
+		__entry->to_thread = t->to_thread ? t->to_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+	),
+	TP_printk("transaction=%d dest_node=%d dest_proc=%d dest_thread=%d "
+		  "reply=%d flags=0x%x code=0x%x",
+		  __entry->debug_id, __entry->target_node, __entry->to_proc,
+		  __entry->to_thread, __entry->reply, __entry->flags,
+		  __entry->code)
+);
+
+TRACE_EVENT(binder_transaction_received,
+	TP_PROTO(struct binder_transaction *t, int pid, s64 queue_ns),
+	TP_ARGS(t, pid, queue_ns),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, pid)
+		__field(s64, queue_ns)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->pid = pid;
+		__entry->queue_ns = queue_ns;
+	),
+	TP_printk("transaction=%d thread=%d queue_ns=%lld",
+		  __entry->debug_id, __entry->pid, __entry->queue_ns)
+);
+
+TRACE_EVENT(binder_transaction_completed,
+	TP_PROTO(struct binder_transaction *t, int pid, s64 handling_ns),
+	TP_ARGS(t, pid, handling_ns),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, pid)
+		__field(s64, handling_ns)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->pid = pid;
+		__entry->handling_ns = handling_ns;
+	),
+	TP_printk("transaction=%d thread=%d handling_ns=%lld",
+		  __entry->debug_id, __entry->pid, __entry->handling_ns)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
@@ -23,9 +23,11 @@
 #include <linux/module.h>
 #include <linux/fs.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
 #include <linux/uaccess.h>
 #include <linux/poll.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/time.h>
 #include <linux/vmalloc.h>
 #include "logger.h"
@@ -35,26 +37,39 @@
 /**
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  * @buffer:	The actual ring buffer
+ * @index:	The index page exported to mmap readers
  * @misc:	The "misc" device representing the log
  * @wq:		The wait queue for @readers
+ * @commit_wq:	The wait queue for writers waiting to commit or for space
  * @readers:	This log's readers
- * @mutex:	The mutex that protects the @buffer
- * @w_off:	The current write head offset
+ * @lock:	The spinlock that protects the offsets and @readers
+ * @w_off:	The current write head offset, up to which entries are committed
+ * @r_seq:	The next reservation ticket
+ * @reserve_off:	The offset at which the next writer reserves space
+ * @c_seq:	The ticket of the next writer allowed to commit
  * @head:	The head, or location that readers start reading at.
  * @size:	The size of the log
  * @logs:	The list of log channels
  *
+ * Writers reserve space for their entry under @lock, copy the entry in
+ * without holding it, and then commit in the order they reserved.  Readers
+ * only see the committed part of the log, up to @w_off.
+ *
  * This structure lives from module insertion until module removal, so it does
- * not need additional reference counting. The structure is protected by the
- * mutex 'mutex'.
+ * not need additional reference counting.
  */
 struct logger_log {
 	unsigned char		*buffer;/* the ring buffer itself */
+	struct logger_ring_index *index; /* positions for mmap readers */
 	struct miscdevice	misc;	/* misc device representing the log */
 	wait_queue_head_t	wq;	/* wait queue for readers */
+	wait_queue_head_t	commit_wq; /* wait queue for writers */
 	struct list_head	readers; /* this log's readers */
-	struct mutex		mutex;	/* mutex protecting buffer */
-	size_t			w_off;	/* current write head offset */
+	spinlock_t		lock;	/* lock protecting offsets */
+	size_t			w_off;	/* committed write head offset */
+	size_t			reserve_off; /* reserved write head offset */
+	unsigned long		r_seq;	/* next reservation ticket */
+	unsigned long		c_seq;	/* next ticket to commit */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
 	struct list_head	logs;
@@ -68,14 +83,16 @@ static LIST_HEAD(log_list);
  * @log:	The associated log
  * @list:	The associated entry in @logger_log's list
  * @r_off:	The current read head offset.
+ * @entry:	Bounce buffer holding the entry being read
  *
  * This object lives from open to release, so we don't need additional
- * reference counting. The structure is protected by log->mutex.
+ * reference counting. The structure is protected by log->lock.
  */
 struct logger_reader {
 	struct logger_log	*log;
 	struct list_head	list;
 	size_t			r_off;
+	unsigned char		*entry;
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
@@ -116,7 +133,7 @@ static inline struct logger_log *file_get_log(struct file *file)
  * In the log, the length does not include the size of the log entry structure.
  * This function returns the size including the log entry structure.
  *
- * Caller needs to hold log->mutex.
+ * Caller needs to hold log->lock.
  */
 static __u32 get_entry_len(struct logger_log *log, size_t off)
 {
@@ -135,15 +152,16 @@ static __u32 get_entry_len(struct logger_log *log, size_t off)
 }
 
 /*
- * do_read_log_to_user - reads exactly 'count' bytes from 'log' into the
- * user-space buffer 'buf'. Returns 'count' on success.
+ * do_read_log - copies exactly 'count' bytes from 'log' into the reader's
+ * bounce buffer, starting at the read head.
+ *
+ * Writers never touch committed entries that a reader has not been pulled
+ * past, so the copy is stable while log->lock is held.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
-static ssize_t do_read_log_to_user(struct logger_log *log,
-				   struct logger_reader *reader,
-				   char __user *buf,
-				   size_t count)
+static void do_read_log(struct logger_log *log, struct logger_reader *reader,
+			size_t count)
 {
 	size_t len;
 
@@ -153,20 +171,14 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	 * the log, whichever comes first.
 	 */
 	len = min(count, log->size - reader->r_off);
-	if (copy_to_user(buf, log->buffer + reader->r_off, len))
-		return -EFAULT;
+	memcpy(reader->entry, log->buffer + reader->r_off, len);
 
 	/*
 	 * Second, we read any remaining bytes, starting back at the head of
 	 * the log.
 	 */
 	if (count != len)
-		if (copy_to_user(buf + len, log->buffer, count - len))
-			return -EFAULT;
-
-	reader->r_off = logger_offset(log, reader->r_off + count);
-
-	return count;
+		memcpy(reader->entry + len, log->buffer, count - len);
 }
 
 /*
@@ -186,17 +198,18 @@ static ssize_t logger_read(struct file *file, char __user *buf,
 {
 	struct logger_reader *reader = file->private_data;
 	struct logger_log *log = reader->log;
+	size_t r_off;
 	ssize_t ret;
 	DEFINE_WAIT(wait);
 
 start:
 	while (1) {
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
 		ret = (log->w_off == reader->r_off);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		if (!ret)
 			break;
 
@@ -217,26 +230,43 @@ start:
 	if (ret)
 		return ret;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	/* is there still something to read or did we race? */
 	if (unlikely(log->w_off == reader->r_off)) {
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 		goto start;
 	}
 
 	/* get the size of the next entry */
 	ret = get_entry_len(log, reader->r_off);
+	if (unlikely(ret > LOGGER_ENTRY_MAX_LEN)) {
+		/* not an entry header, never copy it into the bounce buffer */
+		spin_unlock(&log->lock);
+		return -EIO;
+	}
 	if (count < ret) {
-		ret = -EINVAL;
-		goto out;
+		spin_unlock(&log->lock);
+		return -EINVAL;
 	}
 
 	/* get exactly one entry from the log */
-	ret = do_read_log_to_user(log, reader, buf, ret);
+	do_read_log(log, reader, ret);
+	r_off = reader->r_off;
 
-out:
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	if (copy_to_user(buf, reader->entry, ret))
+		return -EFAULT;
+
+	/*
+	 * Only now move past the entry, so that a fault does not lose it,
+	 * unless a writer lapped us and pulled us forward meanwhile.
+	 */
+	spin_lock(&log->lock);
+	if (reader->r_off == r_off)
+		reader->r_off = logger_offset(log, r_off + ret);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -245,7 +275,7 @@ out:
  * get_next_entry - return the offset of the first valid entry at least 'len'
  * bytes after 'off'.
  *
- * Caller must hold log->mutex.
+ * Caller must hold log->lock.
  */
 static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 {
@@ -260,6 +290,29 @@ static size_t get_next_entry(struct logger_log *log, size_t off, size_t len)
 	return off;
 }
 
+/*
+ * is_entry_start - does 'pos', which lies between the head and the write
+ * head, start an entry?  Walks the entries from the head to find out.
+ *
+ * Caller must hold log->lock.
+ */
+static int is_entry_start(struct logger_log *log, __u32 pos)
+{
+	__u32 count = pos - log->index->head_pos;
+	size_t off = log->head;
+
+	while (count) {
+		__u32 len = get_entry_len(log, off);
+
+		if (len > count)
+			return 0;
+		count -= len;
+		off = logger_offset(log, off + len);
+	}
+
+	return 1;
+}
+
 /*
  * is_between - is a < c < b, accounting for wrapping of a, b, and c
  *    positions in the buffer
@@ -293,18 +346,22 @@ static inline int is_between(size_t a, size_t b, size_t c)
  * fix_up_readers - walk the list of all readers and "fix up" any who were
  * lapped by the writer; also do the same for the default "start head".
  * We do this by "pulling forward" the readers and start head to the first
- * entry after the new write head.
+ * entry after the new reservation.
  *
- * The caller needs to hold log->mutex.
+ * The caller needs to hold log->lock.
  */
 static void fix_up_readers(struct logger_log *log, size_t len)
 {
-	size_t old = log->w_off;
+	size_t old = log->reserve_off;
 	size_t new = logger_offset(log, old + len);
 	struct logger_reader *reader;
 
-	if (is_between(old, new, log->head))
-		log->head = get_next_entry(log, log->head, len);
+	if (is_between(old, new, log->head)) {
+		size_t head = get_next_entry(log, log->head, len);
+
+		log->index->head_pos += logger_offset(log, head - log->head);
+		log->head = head;
+	}
 
 	list_for_each_entry(reader, &log->readers, list)
 		if (is_between(old, new, reader->r_off))
@@ -312,69 +369,135 @@ static void fix_up_readers(struct logger_log *log, size_t len)
 }
 
 /*
- * do_write_log - writes 'len' bytes from 'buf' to 'log'
+ * do_write_log - writes 'count' bytes from 'buf' to 'log' at offset 'off',
+ * which lies inside space reserved by the caller
  *
- * The caller needs to hold log->mutex.
+ * Returns the offset following the copied bytes.
  */
-static void do_write_log(struct logger_log *log, const void *buf, size_t count)
+static size_t do_write_log(struct logger_log *log, size_t off,
+			   const void *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	memcpy(log->buffer + log->w_off, buf, len);
+	len = min(count, log->size - off);
+	memcpy(log->buffer + off, buf, len);
 
 	if (count != len)
 		memcpy(log->buffer, buf + len, count - len);
 
-	log->w_off = logger_offset(log, log->w_off + count);
-
+	return logger_offset(log, off + count);
 }
 
 /*
- * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
- * the log 'log'
+ * do_write_log_user - writes 'count' bytes from the user-space buffer 'buf'
+ * to the log 'log' at offset 'off', which lies inside space reserved by the
+ * caller
  *
- * The caller needs to hold log->mutex.
- *
- * Returns 'count' on success, negative error code on failure.
+ * Returns 0 on success, -EFAULT on failure.
  */
-static ssize_t do_write_log_from_user(struct logger_log *log,
-				      const void __user *buf, size_t count)
+static int do_write_log_from_user(struct logger_log *log, size_t off,
+				  const void __user *buf, size_t count)
 {
 	size_t len;
 
-	len = min(count, log->size - log->w_off);
-	if (len && copy_from_user(log->buffer + log->w_off, buf, len))
+	len = min(count, log->size - off);
+	if (len && copy_from_user(log->buffer + off, buf, len))
 		return -EFAULT;
 
 	if (count != len)
 		if (copy_from_user(log->buffer, buf + len, count - len))
-			/*
-			 * Note that by not updating w_off, this abandons the
-			 * portion of the new entry that *was* successfully
-			 * copied, just above.  This is intentional to avoid
-			 * message corruption from missing fragments.
-			 */
 			return -EFAULT;
 
-	log->w_off = logger_offset(log, log->w_off + count);
+	return 0;
+}
 
-	return count;
+/*
+ * log_in_flight - returns the number of bytes reserved but not yet
+ * committed
+ *
+ * The caller needs to hold log->lock.
+ */
+static size_t log_in_flight(struct logger_log *log)
+{
+	return logger_offset(log, log->reserve_off - log->w_off);
+}
+
+/*
+ * log_reserve - reserves 'len' bytes at the write head for one entry
+ *
+ * Readers lapped by the reservation are pulled forward right away, so
+ * that nobody reads the space while it is being filled.  The reserved
+ * space may not lap entries that are still in flight; if it would, we
+ * wait for earlier writers to commit.
+ *
+ * Returns the offset of the reserved space and the commit ticket in 'seq'.
+ */
+static size_t log_reserve(struct logger_log *log, size_t len,
+			  unsigned long *seq)
+{
+	size_t off;
+
+	spin_lock(&log->lock);
+	while (unlikely(log_in_flight(log) + len >= log->size)) {
+		spin_unlock(&log->lock);
+		wait_event(log->commit_wq,
+			   log_in_flight(log) + len < log->size);
+		spin_lock(&log->lock);
+	}
+
+	fix_up_readers(log, len);
+	off = log->reserve_off;
+	log->reserve_off = logger_offset(log, off + len);
+	*seq = log->r_seq++;
+	log->index->reserve_pos += len;
+	/* mmap readers must see the claim before the data is overwritten */
+	smp_wmb();
+	spin_unlock(&log->lock);
+
+	return off;
+}
+
+/*
+ * log_commit - makes the entry reserved with ticket 'seq' visible to
+ * readers, after all entries reserved before it
+ */
+static void log_commit(struct logger_log *log, size_t end, unsigned long seq)
+{
+	wait_event(log->commit_wq, ACCESS_ONCE(log->c_seq) == seq);
+
+	spin_lock(&log->lock);
+	/* the entry must be visible to mmap readers before w_pos moves */
+	smp_wmb();
+	log->index->w_pos += logger_offset(log, end - log->w_off);
+	log->w_off = end;
+	log->c_seq++;
+	spin_unlock(&log->lock);
+
+	/* order the commit before the check, pairs with prepare_to_wait() */
+	smp_mb();
+	if (waitqueue_active(&log->commit_wq))
+		wake_up_all(&log->commit_wq);
 }
 
 /*
  * logger_aio_write - our write method, implementing support for write(),
  * writev(), and aio_write(). Writes are our fast path, and we try to optimize
  * them above all else.
+ *
+ * Concurrent writers copy their entries in parallel, and may sleep on page
+ * faults without holding up anybody but the writers that reserved after
+ * them.
  */
 static ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
 	struct logger_entry header;
 	struct timespec now;
+	unsigned long seq;
+	size_t off, end;
 	ssize_t ret = 0;
+	int err = 0;
 
 	now = current_kernel_time();
 
@@ -388,43 +511,48 @@ static ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
-	mutex_lock(&log->mutex);
-
-	/*
-	 * Fix up any readers, pulling them forward to the first readable
-	 * entry after (what will be) the new write offset. We do this now
-	 * because if we partially fail, we can end up with clobbered log
-	 * entries that encroach on readable buffer.
-	 */
-	fix_up_readers(log, sizeof(struct logger_entry) + header.len);
+	off = log_reserve(log, sizeof(struct logger_entry) + header.len, &seq);
+	end = logger_offset(log, off + sizeof(struct logger_entry) + header.len);
 
-	do_write_log(log, &header, sizeof(struct logger_entry));
+	off = do_write_log(log, off, &header, sizeof(struct logger_entry));
 
-	while (nr_segs-- > 0) {
+	while (nr_segs-- > 0 && ret < header.len) {
 		size_t len;
-		ssize_t nr;
 
 		/* figure out how much of this vector we can keep */
 		len = min_t(size_t, iov->iov_len, header.len - ret);
 
 		/* write out this segment's payload */
-		nr = do_write_log_from_user(log, iov->iov_base, len);
-		if (unlikely(nr < 0)) {
-			log->w_off = orig;
-			mutex_unlock(&log->mutex);
-			return nr;
-		}
+		err = do_write_log_from_user(log, off, iov->iov_base, len);
+		if (unlikely(err))
+			break;
 
+		off = logger_offset(log, off + len);
 		iov++;
-		ret += nr;
+		ret += len;
 	}
 
-	mutex_unlock(&log->mutex);
+	/*
+	 * The space is already claimed and later writers are queued behind
+	 * it, so a partially copied entry cannot be dropped.  Blank out the
+	 * rest of the payload instead, the same as a short writev would.
+	 */
+	if (unlikely(ret < header.len)) {
+		static const char zeroes[64];
+
+		while (off != end) {
+			size_t len = min_t(size_t, sizeof(zeroes),
+					   logger_offset(log, end - off));
+			off = do_write_log(log, off, zeroes, len);
+		}
+	}
+
+	log_commit(log, end, seq);
 
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
-	return ret;
+	return err ? err : ret;
 }
 
 static struct logger_log *get_log_from_minor(int minor)
@@ -462,13 +590,19 @@ static int logger_open(struct inode *inode, struct file *file)
 		if (!reader)
 			return -ENOMEM;
 
+		reader->entry = kmalloc(LOGGER_ENTRY_MAX_LEN, GFP_KERNEL);
+		if (!reader->entry) {
+			kfree(reader);
+			return -ENOMEM;
+		}
+
 		reader->log = log;
 		INIT_LIST_HEAD(&reader->list);
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		reader->r_off = log->head;
 		list_add_tail(&reader->list, &log->readers);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
 		file->private_data = reader;
 	} else
@@ -488,10 +622,11 @@ static int logger_release(struct inode *ignored, struct file *file)
 		struct logger_reader *reader = file->private_data;
 		struct logger_log *log = reader->log;
 
-		mutex_lock(&log->mutex);
+		spin_lock(&log->lock);
 		list_del(&reader->list);
-		mutex_unlock(&log->mutex);
+		spin_unlock(&log->lock);
 
+		kfree(reader->entry);
 		kfree(reader);
 	}
 
@@ -521,10 +656,10 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 
 	poll_wait(file, &log->wq, wait);
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
 
 	return ret;
 }
@@ -535,7 +670,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	struct logger_reader *reader;
 	long ret = -ENOTTY;
 
-	mutex_lock(&log->mutex);
+	spin_lock(&log->lock);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -571,11 +706,66 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		list_for_each_entry(reader, &log->readers, list)
 			reader->r_off = log->w_off;
 		log->head = log->w_off;
+		log->index->head_pos = log->index->w_pos;
+		ret = 0;
+		break;
+	case LOGGER_SET_READ_POS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		/* only positions between the head and the write head */
+		if ((__u32)(log->index->w_pos - arg) >
+		    (__u32)(log->index->w_pos - log->index->head_pos)) {
+			ret = -EINVAL;
+			break;
+		}
+		/* and only at the start of an entry */
+		if (!is_entry_start(log, arg)) {
+			ret = -EINVAL;
+			break;
+		}
+		reader = file->private_data;
+		reader->r_off = logger_offset(log, arg);
 		ret = 0;
 		break;
 	}
 
-	mutex_unlock(&log->mutex);
+	spin_unlock(&log->lock);
+
+	return ret;
+}
+
+/*
+ * logger_mmap - the log's mmap file operation
+ *
+ * Maps the index page followed by the ring, read-only.  See struct
+ * logger_ring_index for how to read entries through the mapping.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(file);
+	unsigned long addr = vma->vm_start;
+	size_t off;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE + log->size)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND;
+
+	ret = vm_insert_page(vma, addr, virt_to_page(log->index));
+	for (off = 0; !ret && off < log->size; off += PAGE_SIZE) {
+		addr += PAGE_SIZE;
+		ret = vm_insert_page(vma, addr,
+				     vmalloc_to_page(log->buffer + off));
+	}
 
 	return ret;
 }
@@ -583,6 +773,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 static const struct file_operations logger_fops = {
 	.owner = THIS_MODULE,
 	.read = logger_read,
+	.mmap = logger_mmap,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
 	.unlocked_ioctl = logger_ioctl,
@@ -601,7 +792,8 @@ static int __init create_log(char *log_name, int size)
 	struct logger_log *log;
 	unsigned char *buffer;
 
-	buffer = vmalloc(size);
+	/* zeroed, as the ring is exported to user space through mmap */
+	buffer = vmalloc_user(size);
 	if (buffer == NULL)
 		return -ENOMEM;
 
@@ -612,20 +804,31 @@ static int __init create_log(char *log_name, int size)
 	}
 	log->buffer = buffer;
 
+	log->index = (struct logger_ring_index *)get_zeroed_page(GFP_KERNEL);
+	if (log->index == NULL) {
+		ret = -ENOMEM;
+		goto out_free_log;
+	}
+	log->index->size = size;
+
 	log->misc.minor = MISC_DYNAMIC_MINOR;
 	log->misc.name = kstrdup(log_name, GFP_KERNEL);
 	if (log->misc.name == NULL) {
 		ret = -ENOMEM;
-		goto out_free_log;
+		goto out_free_index;
 	}
 
 	log->misc.fops = &logger_fops;
 	log->misc.parent = NULL;
 
 	init_waitqueue_head(&log->wq);
+	init_waitqueue_head(&log->commit_wq);
 	INIT_LIST_HEAD(&log->readers);
-	mutex_init(&log->mutex);
+	spin_lock_init(&log->lock);
 	log->w_off = 0;
+	log->reserve_off = 0;
+	log->r_seq = 0;
+	log->c_seq = 0;
 	log->head = 0;
 	log->size = size;
 
@@ -637,7 +840,7 @@ static int __init create_log(char *log_name, int size)
 	if (unlikely(ret)) {
 		pr_err("failed to register misc device for log '%s'!\n",
 				log->misc.name);
-		goto out_free_log;
+		goto out_free_index;
 	}
 
 	pr_info("created %luK log '%s'\n",
@@ -645,6 +848,9 @@ static int __init create_log(char *log_name, int size)
 
 	return 0;
 
+out_free_index:
+	free_page((unsigned long)log->index);
+
 out_free_log:
 	kfree(log);
 
@@ -685,6 +891,7 @@ static void __exit logger_exit(void)
 		/* we have to delete all the entry inside log_list */
 		misc_deregister(&current_log->misc);
 		vfree(current_log->buffer);
+		free_page((unsigned long)current_log->index);
 		kfree(current_log->misc.name);
 		list_del(&current_log->logs);
 		kfree(current_log);
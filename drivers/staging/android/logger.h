@@ -40,6 +40,33 @@ struct logger_entry {
 	char		msg[0];
 };
 
+/**
+ * struct logger_ring_index - the first page of a mapped log
+ * @size:	The size of the ring, which follows this page in the mapping
+ * @w_pos:	The position up to which entries are committed
+ * @reserve_pos: The position up to which writers have claimed space
+ * @head_pos:	The position of the oldest entry still in the ring
+ *
+ * A log may be mapped read-only, PAGE_SIZE + @size bytes at offset 0, to
+ * drain entries without a read() per entry.  Positions are free-running
+ * byte counts modulo 2^32, and the byte at position p lives at offset
+ * (p & (@size - 1)) of the ring.  Entries are laid out as for read(), but
+ * may wrap around the end of the ring.
+ *
+ * A reader starts at @head_pos and parses entries up to @w_pos, reading
+ * @w_pos before the entries.  Once done with them it reads @reserve_pos;
+ * if that is more than @size past the first position it parsed, writers
+ * may have overwritten the data and the reader must start over from
+ * @head_pos.  LOGGER_SET_READ_POS hands the position back to the kernel so
+ * that poll() waits for entries after it.
+ */
+struct logger_ring_index {
+	__u32		size;
+	__u32		w_pos;
+	__u32		reserve_pos;
+	__u32		head_pos;
+};
+
 #define LOGGER_LOG_RADIO	"log_radio"	/* radio-related messages */
 #define LOGGER_LOG_EVENTS	"log_events"	/* system/hardware events */
 #define LOGGER_LOG_SYSTEM	"log_system"	/* system/framework messages */
@@ -55,5 +82,6 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_READ_POS		_IO(__LOGGERIO, 5) /* set read pos */
 
 #endif /* _LINUX_LOGGER_H */
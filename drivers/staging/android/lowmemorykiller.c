@@ -16,6 +16,10 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With CONFIG_ANDROID_LMK_ADJ_BUCKETS, processes are kept in one list per
+ * oom_adj value, so that finding a victim only looks at the processes with
+ * the highest oom_adj allowed to be killed, instead of the whole task list.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +39,7 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/spinlock.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -79,6 +84,87 @@ task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 	return NOTIFY_OK;
 }
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+/*
+ * Thread group leaders, hashed by their signal->oom_adj. Buckets are only
+ * changed with lowmem_adj_lock held, and a task is removed from its bucket
+ * in release_task() before its signal and sighand go away, so the shrinker
+ * may look at and signal any task it finds here while holding the lock.
+ *
+ * Lock order: lowmem_adj_lock nests inside tasklist_lock, which
+ * release_task() and de_thread() hold with interrupts off, and outside
+ * task_lock() and siglock, so the hooks must not be called with either of
+ * the latter held.  An interrupt may take tasklist_lock for reading, so
+ * lowmem_adj_lock is always taken with interrupts off.
+ */
+#define LOWMEM_ADJ_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+
+static DEFINE_SPINLOCK(lowmem_adj_lock);
+static struct hlist_head lowmem_adj_buckets[LOWMEM_ADJ_BUCKETS];
+
+static struct hlist_head *lowmem_adj_bucket(int oom_adj)
+{
+	oom_adj = clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX);
+	return &lowmem_adj_buckets[oom_adj - OOM_DISABLE];
+}
+
+/* Called on fork of a new thread group, after it is on the task list */
+void lowmem_adj_bucket_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (p->flags & PF_KTHREAD)
+		return;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	hlist_add_head(&p->lowmem_adj_node,
+		       lowmem_adj_bucket(p->signal->oom_adj));
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* Called from release_task(), with tasklist_lock held */
+void lowmem_adj_bucket_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!hlist_unhashed(&p->lowmem_adj_node))
+		hlist_del_init(&p->lowmem_adj_node);
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* Called from de_thread() when a thread takes over as group leader */
+void lowmem_adj_bucket_replace(struct task_struct *old,
+			       struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	if (!hlist_unhashed(&old->lowmem_adj_node)) {
+		hlist_del_init(&old->lowmem_adj_node);
+		hlist_add_head(&new->lowmem_adj_node,
+			       lowmem_adj_bucket(new->signal->oom_adj));
+	}
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+
+/* Called after oom_adj of the thread group of p changed */
+void lowmem_adj_bucket_update(struct task_struct *p)
+{
+	struct task_struct *leader;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	leader = p->group_leader;
+	if (!hlist_unhashed(&leader->lowmem_adj_node)) {
+		hlist_del(&leader->lowmem_adj_node);
+		hlist_add_head(&leader->lowmem_adj_node,
+			       lowmem_adj_bucket(leader->signal->oom_adj));
+	}
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+}
+#endif
+
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *p;
@@ -89,6 +175,9 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int min_adj = OOM_ADJUST_MAX + 1;
 	int selected_tasksize = 0;
 	int selected_oom_adj;
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+	unsigned long flags;
+#endif
 	int array_size = ARRAY_SIZE(lowmem_adj);
 	int other_free = global_page_state(NR_FREE_PAGES);
 	int other_file = global_page_state(NR_FILE_PAGES) -
@@ -131,6 +220,38 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	selected_oom_adj = min_adj;
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+	/*
+	 * The process with the highest oom_adj wins, so the first bucket
+	 * holding a candidate ends the search; within it the largest one
+	 * is picked.
+	 */
+	spin_lock_irqsave(&lowmem_adj_lock, flags);
+	for (i = OOM_ADJUST_MAX; i >= min_adj && i >= OOM_DISABLE && !selected;
+	     i--) {
+		struct hlist_node *node;
+
+		hlist_for_each_entry(p, node, lowmem_adj_bucket(i),
+				     lowmem_adj_node) {
+			task_lock(p);
+			if (!p->mm) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(p->mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected && tasksize <= selected_tasksize)
+				continue;
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = i;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, i, tasksize);
+		}
+	}
+#else
 	read_lock(&tasklist_lock);
 	for_each_process(p) {
 		struct mm_struct *mm;
@@ -169,6 +290,7 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
 			     p->pid, p->comm, oom_adj, tasksize);
 	}
+#endif
 	if (selected) {
 		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
 			     selected->pid, selected->comm,
@@ -180,7 +302,11 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	}
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+	spin_unlock_irqrestore(&lowmem_adj_lock, flags);
+#else
 	read_unlock(&tasklist_lock);
+#endif
 	return rem;
 }
 
@@ -0,0 +1,211 @@
+/*
+ * Compressed RAM block device - compression backends
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com
+ */
+
+#include <linux/kernel.h>
+#include <linux/lzo.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#ifdef CONFIG_ZRAM_SNAPPY
+#include "../snappy/csnappy.h"
+#endif
+
+#include "zram_drv.h"
+
+static int zram_lzo_compress(const unsigned char *src, unsigned char *dst,
+			     size_t *dst_len, void *workmem)
+{
+	int ret;
+
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, dst_len, workmem);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static int zram_lzo_decompress(const unsigned char *src, size_t src_len,
+			       unsigned char *dst)
+{
+	int ret;
+	size_t dst_len = PAGE_SIZE;
+
+	ret = lzo1x_decompress_safe(src, src_len, dst, &dst_len);
+	return ret == LZO_E_OK ? 0 : ret;
+}
+
+static const struct zram_compressor zram_comp_lzo = {
+	.name		= "lzo",
+	.workmem_size	= LZO1X_MEM_COMPRESS,
+	.compress	= zram_lzo_compress,
+	.decompress	= zram_lzo_decompress,
+};
+
+#ifdef CONFIG_ZRAM_SNAPPY
+static int zram_snappy_compress(const unsigned char *src, unsigned char *dst,
+				size_t *dst_len, void *workmem)
+{
+	uint32_t clen;
+
+	csnappy_compress((const char *)src, PAGE_SIZE, (char *)dst, &clen,
+			 workmem, CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+	*dst_len = clen;
+
+	return 0;
+}
+
+static int zram_snappy_decompress(const unsigned char *src, size_t src_len,
+				  unsigned char *dst)
+{
+	return csnappy_decompress((const char *)src, src_len,
+				  (char *)dst, PAGE_SIZE);
+}
+
+static const struct zram_compressor zram_comp_snappy = {
+	.name		= "snappy",
+	.workmem_size	= CSNAPPY_WORKMEM_BYTES,
+	.compress	= zram_snappy_compress,
+	.decompress	= zram_snappy_decompress,
+};
+#endif
+
+/* The first entry is the default backend for new devices */
+static const struct zram_compressor *zram_compressors[] = {
+	&zram_comp_lzo,
+#ifdef CONFIG_ZRAM_SNAPPY
+	&zram_comp_snappy,
+#endif
+};
+
+const struct zram_compressor *zram_default_compressor(void)
+{
+	return zram_compressors[0];
+}
+
+const struct zram_compressor *zram_find_compressor(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_compressors); i++) {
+		if (sysfs_streq(name, zram_compressors[i]->name))
+			return zram_compressors[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * List all available backends, the currently selected one in brackets,
+ * the same way the block layer lists I/O schedulers.
+ */
+ssize_t zram_show_compressors(const struct zram_compressor *cur, char *buf)
+{
+	int i;
+	ssize_t len = 0;
+
+	for (i = 0; i < ARRAY_SIZE(zram_compressors); i++) {
+		if (zram_compressors[i] == cur)
+			len += sprintf(buf + len, "[%s] ",
+				       zram_compressors[i]->name);
+		else
+			len += sprintf(buf + len, "%s ",
+				       zram_compressors[i]->name);
+	}
+	len += sprintf(buf + len, "\n");
+
+	return len;
+}
+
+static void zram_strm_free(struct zram_strm *strm)
+{
+	kfree(strm->workmem);
+	free_pages((unsigned long)strm->buffer, 1);
+	kfree(strm);
+}
+
+static struct zram_strm *zram_strm_alloc(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	strm = kzalloc(sizeof(*strm), GFP_KERNEL);
+	if (!strm)
+		return NULL;
+
+	strm->workmem = kzalloc(zram->comp->workmem_size, GFP_KERNEL);
+	strm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	if (!strm->workmem || !strm->buffer) {
+		zram_strm_free(strm);
+		return NULL;
+	}
+
+	return strm;
+}
+
+void zram_destroy_streams(struct zram *zram)
+{
+	struct zram_strm *strm, *tmp;
+
+	list_for_each_entry_safe(strm, tmp, &zram->idle_strm, list) {
+		list_del(&strm->list);
+		zram_strm_free(strm);
+	}
+}
+
+int zram_create_streams(struct zram *zram)
+{
+	int i;
+	struct zram_strm *strm;
+
+	for (i = 0; i < zram->max_strm; i++) {
+		strm = zram_strm_alloc(zram);
+		if (!strm) {
+			zram_destroy_streams(zram);
+			return -ENOMEM;
+		}
+		list_add(&strm->list, &zram->idle_strm);
+	}
+
+	return 0;
+}
+
+/*
+ * Get an idle compression stream, sleeping until another writer
+ * releases one if all of them are busy.
+ */
+struct zram_strm *zram_strm_find(struct zram *zram)
+{
+	struct zram_strm *strm;
+
+	for (;;) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			strm = list_first_entry(&zram->idle_strm,
+						struct zram_strm, list);
+			list_del(&strm->list);
+			spin_unlock(&zram->strm_lock);
+			return strm;
+		}
+		spin_unlock(&zram->strm_lock);
+
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+void zram_strm_release(struct zram *zram, struct zram_strm *strm)
+{
+	spin_lock(&zram->strm_lock);
+	list_add(&strm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+
+	wake_up(&zram->strm_wait);
+}
@@ -23,13 +23,13 @@
 #include <linux/kernel.h>
 #include <linux/bio.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/blkdev.h>
 #include <linux/buffer_head.h>
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
 
@@ -39,18 +39,16 @@
 static int zram_major;
 struct zram *zram_devices;
 
-/* Module params (documentation at end) */
-static unsigned int num_devices;
+/* Runs per-page work items of bios handled in ZRAM_IO_ASYNC mode */
+static struct workqueue_struct *zram_wq;
 
-static void zram_stat_inc(u32 *v)
-{
-	*v = *v + 1;
-}
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Reads of written back pages, which reclaim may wait for */
+static struct workqueue_struct *zram_bdev_wq;
+#endif
 
-static void zram_stat_dec(u32 *v)
-{
-	*v = *v - 1;
-}
+/* Module params (documentation at end) */
+static unsigned int num_devices;
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
 {
@@ -74,36 +72,82 @@ static void zram_stat64_inc(struct zram *zram, u64 *v)
 static int zram_test_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	return zram->table[index].flags & BIT(flag);
+	return zram->table[index].value & BIT(flag);
 }
 
 static void zram_set_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags |= BIT(flag);
+	zram->table[index].value |= BIT(flag);
 }
 
 static void zram_clear_flag(struct zram *zram, u32 index,
 			enum zram_pageflags flag)
 {
-	zram->table[index].flags &= ~BIT(flag);
+	zram->table[index].value &= ~BIT(flag);
+}
+
+static size_t zram_get_obj_size(struct zram *zram, u32 index)
+{
+	return zram->table[index].value & (BIT(ZRAM_FLAG_SHIFT) - 1);
+}
+
+static void zram_set_obj_size(struct zram *zram, u32 index, size_t size)
+{
+	unsigned long flags = zram->table[index].value >> ZRAM_FLAG_SHIFT;
+
+	zram->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
+}
+
+/*
+ * Table entries are protected by a bit spinlock in the entry itself, so
+ * that reads and writes of different pages never contend with each other.
+ */
+static void zram_lock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_ACCESS, &zram->table[index].value);
+}
+
+static void zram_unlock_slot(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->table[index].value);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos != PAGE_SIZE / sizeof(*page); pos++) {
+		if (page[pos] != val)
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
+static void zram_fill_page(void *ptr, unsigned long len,
+			   unsigned long element)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	WARN_ON_ONCE(!IS_ALIGNED(len, sizeof(*page)));
+
+	if (!element) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (pos = 0; pos != len / sizeof(*page); pos++)
+		page[pos] = element;
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,46 +177,197 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Max number of pages written back to the backing device by one bio */
+#define ZRAM_WB_BATCH	16
+
+/*
+ * Allocate a free block on the backing device, preferring the one given
+ * by hint so that consecutive pages of a writeback batch stay contiguous.
+ * Returns zram->nr_bdev_pages if the backing device is full.
+ */
+static unsigned long zram_alloc_block(struct zram *zram, unsigned long hint)
+{
+	unsigned long blk;
+
+	if (hint < zram->nr_bdev_pages && !test_and_set_bit(hint, zram->bitmap))
+		return hint;
+
+	do {
+		blk = find_first_zero_bit(zram->bitmap, zram->nr_bdev_pages);
+		if (blk >= zram->nr_bdev_pages)
+			return zram->nr_bdev_pages;
+	} while (test_and_set_bit(blk, zram->bitmap));
+
+	return blk;
+}
+
+static void zram_free_block(struct zram *zram, unsigned long blk)
+{
+	WARN_ON_ONCE(!test_and_clear_bit(blk, zram->bitmap));
+}
+
+static void zram_bdev_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/* Synchronously transfer nr pages starting at block blk of the backing dev */
+static int zram_bdev_rw(struct zram *zram, struct page **pages, int nr,
+			unsigned long blk, int rw)
+{
+	int i, ret = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(done);
+
+	bio = bio_alloc(GFP_NOIO, nr);
+	if (!bio)
+		return -ENOMEM;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = (sector_t)blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bdev_end_io;
+	bio->bi_private = &done;
+
+	for (i = 0; i < nr; i++) {
+		if (!bio_add_page(bio, pages[i], PAGE_SIZE, 0)) {
+			bio_put(bio);
+			return -EIO;
+		}
+	}
+
+	submit_bio(rw | REQ_SYNC, bio);
+	wait_for_completion(&done);
+
+	if (!test_bit(BIO_UPTODATE, &bio->bi_flags))
+		ret = -EIO;
+	bio_put(bio);
+
+	if (!ret) {
+		if (rw == READ)
+			zram_stat64_add(zram, &zram->stats.bd_reads, nr);
+		else
+			zram_stat64_add(zram, &zram->stats.bd_writes, nr);
+	}
+	return ret;
+}
+
+struct zram_bdev_read {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_work(struct work_struct *work)
+{
+	struct zram_bdev_read *req =
+		container_of(work, struct zram_bdev_read, work);
+
+	req->ret = zram_bdev_rw(req->zram, &req->page, 1, req->blk, READ);
+}
+
+/*
+ * Read a written back page into mem. We are called from zram's
+ * make_request function, where bios submitted to another device are only
+ * dispatched once we return, so the read is issued from a worker. Swap-in
+ * under reclaim waits for it, so it runs on a WQ_MEM_RECLAIM workqueue of
+ * its own rather than on system_wq.
+ */
+static int zram_read_from_bdev(struct zram *zram, unsigned char *mem,
+			       unsigned long blk)
+{
+	void *src;
+	struct zram_bdev_read req;
+
+	req.page = alloc_page(GFP_NOIO);
+	if (!req.page)
+		return -ENOMEM;
+
+	req.zram = zram;
+	req.blk = blk;
+	INIT_WORK_ONSTACK(&req.work, zram_bdev_read_work);
+	queue_work(zram_bdev_wq, &req.work);
+	flush_work(&req.work);
+	destroy_work_on_stack(&req.work);
+
+	if (!req.ret) {
+		src = kmap_atomic(req.page);
+		memcpy(mem, src, PAGE_SIZE);
+		kunmap_atomic(src);
+	}
+	__free_page(req.page);
+
+	return req.ret;
+}
+#else
+static void zram_free_block(struct zram *zram, unsigned long blk) {}
+
+static int zram_read_from_bdev(struct zram *zram, unsigned char *mem,
+			       unsigned long blk)
+{
+	return -EIO;
+}
+#endif
+
+/* Must be called with the slot locked */
 static void zram_free_page(struct zram *zram, size_t index)
 {
 	unsigned long handle = zram->table[index].handle;
-	u16 size = zram->table[index].size;
+	size_t size = zram_get_obj_size(zram, index);
+
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_HUGE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+	/* Page was written back, only the block on the backing device is used */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_free_block(zram, zram->table[index].element);
+		atomic_dec(&zram->stats.bd_count);
+		zram->table[index].element = 0;
+		return;
+	}
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		if (!zram->table[index].element)
+			atomic_dec(&zram->stats.pages_zero);
+		atomic_dec(&zram->stats.pages_same);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (unlikely(!handle))
+		return;
+
 	if (unlikely(size > max_zpage_size))
-		zram_stat_dec(&zram->stats.bad_compress);
+		atomic_dec(&zram->stats.bad_compress);
 
 	zs_free(zram->mem_pool, handle);
 
 	if (size <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+		atomic_dec(&zram->stats.good_compress);
 
-	zram_stat64_sub(zram, &zram->stats.compr_size,
-			zram->table[index].size);
-	zram_stat_dec(&zram->stats.pages_stored);
+	zram_stat64_sub(zram, &zram->stats.compr_size, size);
+	atomic_dec(&zram->stats.pages_stored);
 
 	zram->table[index].handle = 0;
-	zram->table[index].size = 0;
+	zram_set_obj_size(zram, index, 0);
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
@@ -183,28 +378,58 @@ static inline int is_partial_io(struct bio_vec *bvec)
 	return bvec->bv_len != PAGE_SIZE;
 }
 
-static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
+/*
+ * Pages on the backing device can only be read back by sleeping, so if
+ * !may_sleep this returns -EAGAIN for them without touching mem.
+ */
+static int zram_decompress_page(struct zram *zram, unsigned char *mem,
+				u32 index, int may_sleep)
 {
-	int ret = LZO_E_OK;
-	size_t clen = PAGE_SIZE;
+	int ret = 0;
+	size_t size;
 	unsigned char *cmem;
-	unsigned long handle = zram->table[index].handle;
+	unsigned long handle;
+
+	zram_lock_slot(zram, index);
+	handle = zram->table[index].handle;
+	size = zram_get_obj_size(zram, index);
+
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		unsigned long blk = zram->table[index].element;
 
-	if (!handle || zram_test_flag(zram, index, ZRAM_ZERO)) {
-		memset(mem, 0, PAGE_SIZE);
+		zram_unlock_slot(zram, index);
+		if (!may_sleep)
+			return -EAGAIN;
+
+		ret = zram_read_from_bdev(zram, mem, blk);
+		if (unlikely(ret)) {
+			pr_err("Backing device read failed! err=%d, page=%u\n",
+				ret, index);
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+		}
+		return ret;
+	}
+
+	if (!handle || zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = 0;
+
+		if (zram_test_flag(zram, index, ZRAM_SAME))
+			element = zram->table[index].element;
+		zram_unlock_slot(zram, index);
+		zram_fill_page(mem, PAGE_SIZE, element);
 		return 0;
 	}
 
 	cmem = zs_map_object(zram->mem_pool, handle, ZS_MM_RO);
-	if (zram->table[index].size == PAGE_SIZE)
+	if (size == PAGE_SIZE)
 		memcpy(mem, cmem, PAGE_SIZE);
 	else
-		ret = lzo1x_decompress_safe(cmem, zram->table[index].size,
-						mem, &clen);
+		ret = zram->comp->decompress(cmem, size, mem);
 	zs_unmap_object(zram->mem_pool, handle);
+	zram_unlock_slot(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
 		zram_stat64_inc(zram, &zram->stats.failed_reads);
 		return ret;
@@ -217,50 +442,64 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 			  u32 index, int offset, struct bio *bio)
 {
 	int ret;
+	int bounce;
 	struct page *page;
-	unsigned char *user_mem, *uncmem = NULL;
+	unsigned char *user_mem, *uncmem;
 
 	page = bvec->bv_page;
 
-	if (unlikely(!zram->table[index].handle) ||
-			zram_test_flag(zram, index, ZRAM_ZERO)) {
-		handle_zero_page(bvec);
+	zram_lock_slot(zram, index);
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		unsigned long element = zram->table[index].element;
+
+		zram_unlock_slot(zram, index);
+		handle_same_page(bvec, element);
 		return 0;
 	}
+	/* written back pages keep their block there, which may be 0 */
+	if (unlikely(!zram->table[index].handle &&
+		     !zram_test_flag(zram, index, ZRAM_WB))) {
+		zram_unlock_slot(zram, index);
+		handle_same_page(bvec, 0);
+		return 0;
+	}
+	bounce = is_partial_io(bvec) || zram_test_flag(zram, index, ZRAM_WB);
+	zram_unlock_slot(zram, index);
 
-	if (is_partial_io(bvec))
-		/* Use  a temporary buffer to decompress the page */
-		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
+	if (!bounce) {
+		user_mem = kmap_atomic(page);
+		ret = zram_decompress_page(zram, user_mem, index, 0);
+		kunmap_atomic(user_mem);
 
-	user_mem = kmap_atomic(page);
-	if (!is_partial_io(bvec))
-		uncmem = user_mem;
+		/* Written back meanwhile, read it through a bounce buffer */
+		if (ret != -EAGAIN)
+			goto out;
+	}
 
+	/* Use  a temporary buffer to decompress the page */
+	uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 	if (!uncmem) {
 		pr_info("Unable to allocate temp memory\n");
-		ret = -ENOMEM;
-		goto out_cleanup;
+		return -ENOMEM;
 	}
 
-	ret = zram_decompress_page(zram, uncmem, index);
-	/* Should NEVER happen. Return bio error if it does. */
-	if (unlikely(ret != LZO_E_OK)) {
-		pr_err("Decompression failed! err=%d, page=%u\n", ret, index);
-		zram_stat64_inc(zram, &zram->stats.failed_reads);
-		goto out_cleanup;
-	}
-
-	if (is_partial_io(bvec))
+	ret = zram_decompress_page(zram, uncmem, index, 1);
+	if (!ret) {
+		user_mem = kmap_atomic(page);
 		memcpy(user_mem + bvec->bv_offset, uncmem + offset,
 				bvec->bv_len);
+		kunmap_atomic(user_mem);
+	}
+	kfree(uncmem);
+
+out:
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret))
+		return ret;
 
 	flush_dcache_page(page);
-	ret = 0;
-out_cleanup:
-	kunmap_atomic(user_mem);
-	if (is_partial_io(bvec))
-		kfree(uncmem);
-	return ret;
+	return 0;
 }
 
 static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
@@ -268,12 +507,12 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 {
 	int ret = 0;
 	size_t clen;
-	unsigned long handle;
+	unsigned long handle, element;
 	struct page *page;
+	struct zram_strm *strm = NULL;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 
 	page = bvec->bv_page;
-	src = zram->compress_buffer;
 
 	if (is_partial_io(bvec)) {
 		/*
@@ -286,18 +525,13 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			ret = -ENOMEM;
 			goto out;
 		}
-		ret = zram_decompress_page(zram, uncmem, index);
+		ret = zram_decompress_page(zram, uncmem, index, 1);
 		if (ret)
 			goto out;
 	}
 
-	/*
-	 * System overwrites unused sectors. Free memory associated
-	 * with this sector now.
-	 */
-	if (zram->table[index].handle ||
-	    zram_test_flag(zram, index, ZRAM_ZERO))
-		zram_free_page(zram, index);
+	strm = zram_strm_find(zram);
+	src = strm->buffer;
 
 	user_mem = kmap_atomic(page);
 
@@ -310,17 +544,26 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		if (!is_partial_io(bvec))
 			kunmap_atomic(user_mem);
-		zram_stat_inc(&zram->stats.pages_zero);
-		zram_set_flag(zram, index, ZRAM_ZERO);
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_lock_slot(zram, index);
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram->table[index].element = element;
+		zram_unlock_slot(zram, index);
+		if (!element)
+			atomic_inc(&zram->stats.pages_zero);
+		atomic_inc(&zram->stats.pages_same);
 		ret = 0;
 		goto out;
 	}
 
-	ret = lzo1x_1_compress(uncmem, PAGE_SIZE, src, &clen,
-			       zram->compress_workmem);
+	ret = zram->comp->compress(uncmem, src, &clen, strm->workmem);
 
 	if (!is_partial_io(bvec)) {
 		kunmap_atomic(user_mem);
@@ -328,13 +571,12 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = NULL;
 	}
 
-	if (unlikely(ret != LZO_E_OK)) {
+	if (unlikely(ret)) {
 		pr_err("Compression failed! err=%d\n", ret);
 		goto out;
 	}
 
 	if (unlikely(clen > max_zpage_size)) {
-		zram_stat_inc(&zram->stats.bad_compress);
 		clen = PAGE_SIZE;
 		src = NULL;
 		if (is_partial_io(bvec))
@@ -358,16 +600,32 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 
 	zs_unmap_object(zram->mem_pool, handle);
 
+	zram_strm_release(zram, strm);
+	strm = NULL;
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_lock_slot(zram, index);
+	zram_free_page(zram, index);
 	zram->table[index].handle = handle;
-	zram->table[index].size = clen;
+	zram_set_obj_size(zram, index, clen);
+	if (clen == PAGE_SIZE)
+		zram_set_flag(zram, index, ZRAM_HUGE);
+	zram_unlock_slot(zram, index);
 
 	/* Update stats */
 	zram_stat64_add(zram, &zram->stats.compr_size, clen);
-	zram_stat_inc(&zram->stats.pages_stored);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_inc(&zram->stats.good_compress);
+	atomic_inc(&zram->stats.pages_stored);
+	if (clen == PAGE_SIZE)
+		atomic_inc(&zram->stats.bad_compress);
+	else if (clen <= PAGE_SIZE / 2)
+		atomic_inc(&zram->stats.good_compress);
 
 out:
+	if (strm)
+		zram_strm_release(zram, strm);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 
@@ -376,24 +634,255 @@ out:
 	return ret;
 }
 
-static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
-			int offset, struct bio *bio, int rw)
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Mark every page stored in RAM idle; any access clears the mark again */
+void zram_mark_idle(struct zram *zram)
 {
-	int ret;
+	size_t index;
 
-	if (rw == READ) {
-		down_read(&zram->lock);
-		ret = zram_bvec_read(zram, bvec, index, offset, bio);
-		up_read(&zram->lock);
-	} else {
-		down_write(&zram->lock);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-		up_write(&zram->lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		zram_lock_slot(zram, index);
+		if (zram->table[index].handle &&
+		    !zram_test_flag(zram, index, ZRAM_SAME) &&
+		    !zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		zram_unlock_slot(zram, index);
 	}
+}
+
+/*
+ * Write the batch out and release the RAM copies of pages that were not
+ * freed or overwritten while the I/O was in flight.
+ */
+static int zram_writeback_batch(struct zram *zram, struct page **pages,
+				u32 *idx, int nr, unsigned long blk)
+{
+	int i, ret;
+
+	ret = zram_bdev_rw(zram, pages, nr, blk, WRITE);
+
+	for (i = 0; i < nr; i++) {
+		zram_lock_slot(zram, idx[i]);
+		if (ret || !zram_test_flag(zram, idx[i], ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, idx[i], ZRAM_UNDER_WB);
+			zram_unlock_slot(zram, idx[i]);
+			zram_free_block(zram, blk + i);
+			continue;
+		}
+
+		zram_free_page(zram, idx[i]);
+		zram_set_flag(zram, idx[i], ZRAM_WB);
+		zram->table[idx[i]].element = blk + i;
+		atomic_inc(&zram->stats.bd_count);
+		zram_unlock_slot(zram, idx[i]);
+	}
+
+	return ret;
+}
+
+static void zram_cancel_wb(struct zram *zram, size_t index)
+{
+	zram_lock_slot(zram, index);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+	zram_unlock_slot(zram, index);
+}
+
+/*
+ * Move pages selected by mode (ZRAM_WB_IDLE, ZRAM_WB_HUGE) from RAM to
+ * the backing device, stopping at the first error. Caller must hold
+ * init_lock for read.
+ */
+int zram_writeback(struct zram *zram, int mode)
+{
+	int i, nr = 0, ret = 0, err;
+	size_t index;
+	unsigned long blk = 0, next;
+	void *mem;
+	u32 idx[ZRAM_WB_BATCH];
+	struct page *pages[ZRAM_WB_BATCH];
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			while (i)
+				__free_page(pages[--i]);
+			return -ENOMEM;
+		}
+	}
+
+	mutex_lock(&zram->wb_lock);
+	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
+		int eligible;
+
+		cond_resched();
+
+		zram_lock_slot(zram, index);
+		eligible = zram->table[index].handle &&
+			!zram_test_flag(zram, index, ZRAM_SAME) &&
+			!zram_test_flag(zram, index, ZRAM_WB) &&
+			(((mode & ZRAM_WB_HUGE) &&
+			  zram_test_flag(zram, index, ZRAM_HUGE)) ||
+			 ((mode & ZRAM_WB_IDLE) &&
+			  zram_test_flag(zram, index, ZRAM_IDLE)));
+		if (eligible)
+			zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_unlock_slot(zram, index);
+
+		if (!eligible)
+			continue;
+
+		next = zram_alloc_block(zram, nr ? blk + nr : 0);
+		if (next == zram->nr_bdev_pages) {
+			zram_cancel_wb(zram, index);
+			ret = -ENOSPC;
+			break;
+		}
+
+		/* Only contiguous blocks can share a bio */
+		if (nr && next != blk + nr) {
+			ret = zram_writeback_batch(zram, pages, idx, nr, blk);
+			nr = 0;
+			if (ret) {
+				zram_cancel_wb(zram, index);
+				zram_free_block(zram, next);
+				break;
+			}
+		}
+		if (!nr)
+			blk = next;
+
+		mem = kmap(pages[nr]);
+		ret = zram_decompress_page(zram, mem, index, 1);
+		kunmap(pages[nr]);
+		if (ret) {
+			zram_cancel_wb(zram, index);
+			zram_free_block(zram, next);
+			break;
+		}
+
+		idx[nr++] = index;
+		if (nr == ZRAM_WB_BATCH) {
+			ret = zram_writeback_batch(zram, pages, idx, nr, blk);
+			nr = 0;
+			if (ret)
+				break;
+		}
+	}
+
+	/* Pages already taken off RAM for the last batch still go out */
+	if (nr) {
+		err = zram_writeback_batch(zram, pages, idx, nr, blk);
+		if (!ret)
+			ret = err;
+	}
+	mutex_unlock(&zram->wb_lock);
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++)
+		__free_page(pages[i]);
 
 	return ret;
 }
 
+/*
+ * Periodic writeback: pages that stayed idle for a whole interval and
+ * incompressible pages are moved to the backing device.
+ */
+static void zram_wb_work_func(struct work_struct *work)
+{
+	struct zram *zram = container_of(to_delayed_work(work),
+					 struct zram, wb_work);
+	unsigned int interval;
+
+	/*
+	 * Do not block a reset or a writeback_interval store, which cancel
+	 * us with init_lock held for write. wb_interval is only written
+	 * under it, and a re-arm racing with the cancel is undone by it.
+	 */
+	if (!down_read_trylock(&zram->init_lock)) {
+		interval = ACCESS_ONCE(zram->wb_interval);
+		if (interval)
+			schedule_delayed_work(&zram->wb_work, interval * HZ);
+		return;
+	}
+
+	if (zram->init_done && zram->bdev) {
+		zram_writeback(zram, ZRAM_WB_IDLE | ZRAM_WB_HUGE);
+		zram_mark_idle(zram);
+		if (zram->wb_interval)
+			schedule_delayed_work(&zram->wb_work,
+					      zram->wb_interval * HZ);
+	}
+	up_read(&zram->init_lock);
+}
+
+void zram_reset_bdev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	zram->bdev = NULL;
+	vfree(zram->bitmap);
+	zram->bitmap = NULL;
+	zram->nr_bdev_pages = 0;
+	kfree(zram->backing_dev);
+	zram->backing_dev = NULL;
+}
+
+/* Caller must hold init_lock for write, device must not be initialized */
+int zram_set_bdev(struct zram *zram, const char *path)
+{
+	char *name;
+	unsigned long nr_pages, *bitmap;
+	struct block_device *bdev;
+
+	name = kstrdup(path, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	bdev = blkdev_get_by_path(name, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				  zram);
+	if (IS_ERR(bdev)) {
+		kfree(name);
+		return PTR_ERR(bdev);
+	}
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!nr_pages || !bitmap) {
+		vfree(bitmap);
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		kfree(name);
+		return nr_pages ? -ENOMEM : -EINVAL;
+	}
+
+	zram_reset_bdev(zram);
+	zram->bdev = bdev;
+	zram->bitmap = bitmap;
+	zram->nr_bdev_pages = nr_pages;
+	zram->backing_dev = name;
+
+	pr_info("Using %s (%lu pages) as backing device\n", name, nr_pages);
+	return 0;
+}
+#endif
+
+/*
+ * Neither path takes a device-wide lock: table entries are protected by
+ * their own ZRAM_ACCESS bit and writers compress into private streams.
+ */
+static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
+			int offset, struct bio *bio, int rw)
+{
+	if (rw == READ)
+		return zram_bvec_read(zram, bvec, index, offset, bio);
+
+	return zram_bvec_write(zram, bvec, index, offset);
+}
+
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 {
 	if (*offset + bvec->bv_len >= PAGE_SIZE)
@@ -401,6 +890,107 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
+/* Per-bio state of a write split into per-page work items */
+struct zram_bio_ctx {
+	struct bio *bio;
+	atomic_t pending;	/* work items still running, plus submitter */
+	int error;
+	struct zram_work {
+		struct work_struct work;
+		struct zram *zram;
+		struct zram_bio_ctx *ctx;
+		struct bio_vec *bvec;
+		u32 index;
+	} works[0];
+};
+
+static void zram_bio_ctx_put(struct zram_bio_ctx *ctx)
+{
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+
+	if (ctx->error) {
+		bio_io_error(ctx->bio);
+	} else {
+		set_bit(BIO_UPTODATE, &ctx->bio->bi_flags);
+		bio_endio(ctx->bio, 0);
+	}
+	kfree(ctx);
+}
+
+static void zram_write_work_func(struct work_struct *work)
+{
+	struct zram_work *zw = container_of(work, struct zram_work, work);
+
+	if (zram_bvec_write(zw->zram, zw->bvec, zw->index, 0) < 0)
+		zw->ctx->error = -EIO;
+
+	zram_bio_ctx_put(zw->ctx);
+}
+
+/*
+ * Only writes of whole, page aligned pages are split, so that no two work
+ * items ever touch the same zram page.
+ */
+static int zram_can_split_bio(struct zram *zram, struct bio *bio, int rw)
+{
+	int i;
+	struct bio_vec *bvec;
+
+	if (zram->io_mode != ZRAM_IO_ASYNC || rw != WRITE ||
+	    bio_segments(bio) < 2)
+		return 0;
+
+	if (bio->bi_sector & (SECTORS_PER_PAGE - 1))
+		return 0;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvec->bv_len != PAGE_SIZE)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Queue one work item per page so that the pages of a large write are
+ * compressed in parallel on idle CPUs. The bio completes when the last
+ * item is done. Returns -ENOMEM if the caller has to fall back to
+ * processing the bio synchronously.
+ */
+static int zram_split_bio(struct zram *zram, struct bio *bio)
+{
+	int i, nr = 0;
+	u32 index;
+	struct bio_vec *bvec;
+	struct zram_bio_ctx *ctx;
+
+	ctx = kmalloc(sizeof(*ctx) + bio_segments(bio) * sizeof(ctx->works[0]),
+		      GFP_NOIO | __GFP_NOWARN);
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->bio = bio;
+	ctx->error = 0;
+	/* Hold a reference so the bio can't complete while we queue */
+	atomic_set(&ctx->pending, bio_segments(bio) + 1);
+
+	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
+	bio_for_each_segment(bvec, bio, i) {
+		struct zram_work *zw = &ctx->works[nr++];
+
+		INIT_WORK(&zw->work, zram_write_work_func);
+		zw->zram = zram;
+		zw->ctx = ctx;
+		zw->bvec = bvec;
+		zw->index = index++;
+		queue_work(zram_wq, &zw->work);
+	}
+
+	zram_bio_ctx_put(ctx);
+	return 0;
+}
+
 static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 {
 	int i, offset;
@@ -416,6 +1006,9 @@ static void __zram_make_request(struct zram *zram, struct bio *bio, int rw)
 		break;
 	}
 
+	if (zram_can_split_bio(zram, bio, rw) && !zram_split_bio(zram, bio))
+		return;
+
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 	offset = (bio->bi_sector & (SECTORS_PER_PAGE - 1)) << SECTOR_SHIFT;
 
@@ -517,17 +1110,21 @@ void __zram_reset_device(struct zram *zram)
 
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	cancel_delayed_work_sync(&zram->wb_work);
+#endif
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Wait for the pages of async writes still being compressed */
+	flush_workqueue(zram_wq);
+
+	/* Free various per-device buffers */
+	zram_destroy_streams(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
 		unsigned long handle = zram->table[index].handle;
-		if (!handle)
+		if (!handle || zram_test_flag(zram, index, ZRAM_SAME) ||
+		    zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
 		zs_free(zram->mem_pool, handle);
@@ -543,12 +1140,22 @@ void __zram_reset_device(struct zram *zram)
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
 	zram->disksize = 0;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_bdev(zram);
+#endif
 }
 
 void zram_reset_device(struct zram *zram)
 {
 	down_write(&zram->init_lock);
-	__zram_reset_device(zram);
+	if (zram->init_done)
+		__zram_reset_device(zram);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	else
+		/* a backing device may be set before the disksize */
+		zram_reset_bdev(zram);
+#endif
 	up_write(&zram->init_lock);
 }
 
@@ -566,18 +1173,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail_no_table;
-	}
-
-	zram->compress_buffer =
-		(void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_create_streams(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams!\n");
 		goto fail_no_table;
 	}
 
@@ -594,7 +1192,8 @@ int zram_init_device(struct zram *zram)
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = zs_create_pool("zram", GFP_NOIO | __GFP_HIGHMEM);
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name,
+					 GFP_NOIO | __GFP_HIGHMEM);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -602,6 +1201,10 @@ int zram_init_device(struct zram *zram)
 	}
 
 	zram->init_done = 1;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram->bdev && zram->wb_interval)
+		schedule_delayed_work(&zram->wb_work, zram->wb_interval * HZ);
+#endif
 	up_write(&zram->init_lock);
 
 	pr_debug("Initialization done!\n");
@@ -622,7 +1225,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_lock_slot(zram, index);
 	zram_free_page(zram, index);
+	zram_unlock_slot(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -635,9 +1240,19 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	init_rwsem(&zram->lock);
 	init_rwsem(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+
+	zram->comp = zram_default_compressor();
+	zram->max_strm = num_online_cpus();
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	mutex_init(&zram->wb_lock);
+	INIT_DELAYED_WORK(&zram->wb_work, zram_wb_work_func);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
@@ -725,11 +1340,25 @@ static int __init zram_init(void)
 		goto out;
 	}
 
+	zram_wq = alloc_workqueue("zram", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!zram_wq) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_bdev_wq = alloc_workqueue("zram_bdev", WQ_MEM_RECLAIM, 0);
+	if (!zram_bdev_wq) {
+		ret = -ENOMEM;
+		goto destroy_wq;
+	}
+#endif
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warn("Unable to get major number\n");
 		ret = -EBUSY;
-		goto out;
+		goto destroy_bdev_wq;
 	}
 
 	if (!num_devices) {
@@ -759,6 +1388,12 @@ free_devices:
 	kfree(zram_devices);
 unregister:
 	unregister_blkdev(zram_major, "zram");
+destroy_bdev_wq:
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
+destroy_wq:
+	destroy_workqueue(zram_wq);
 out:
 	return ret;
 }
@@ -773,12 +1408,15 @@ static void __exit zram_exit(void)
 
 		get_disk(zram->disk);
 		destroy_device(zram);
-		if (zram->init_done)
-			zram_reset_device(zram);
+		zram_reset_device(zram);
 		put_disk(zram->disk);
 	}
 
 	unregister_blkdev(zram_major, "zram");
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
+	destroy_workqueue(zram_wq);
 
 	kfree(zram_devices);
 	pr_debug("Cleanup done!\n");
@@ -17,6 +17,8 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include "../zsmalloc/zsmalloc.h"
 
@@ -54,23 +56,59 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define ZRAM_SECTOR_PER_LOGICAL_BLOCK	\
 	(1 << (ZRAM_LOGICAL_BLOCK_SHIFT - SECTOR_SHIFT))
 
-/* Flags for zram pages (table[page_no].flags) */
+/*
+ * The lower ZRAM_FLAG_SHIFT bits of table[page_no].value hold the object
+ * size (excluding header), the upper bits hold the page flags below.
+ */
+#define ZRAM_FLAG_SHIFT 24
+
+/* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page consists of one repeated word, stored in table.element */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
+	/* Bit spinlock protecting this table entry */
+	ZRAM_ACCESS,
+	/* Page is on the backing device, block index in table.element */
+	ZRAM_WB,
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+	/* Page is stored uncompressed */
+	ZRAM_HUGE,
+	/* Page was not accessed since it was last marked idle */
+	ZRAM_IDLE,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Compression backend, selected per device through sysfs */
+struct zram_compressor {
+	const char *name;
+	size_t workmem_size;	/* bytes of scratch memory for compress() */
+	/* Compress one PAGE_SIZE page; returns 0 on success */
+	int (*compress)(const unsigned char *src, unsigned char *dst,
+			size_t *dst_len, void *workmem);
+	/* Decompress into a PAGE_SIZE buffer; returns 0 on success */
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst);
+};
+
 /* Allocated for each disk page */
 struct table {
-	unsigned long handle;
-	u16 size;	/* object size (excluding header) */
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
-} __aligned(4);
+	union {
+		unsigned long handle;
+		unsigned long element;	/* ZRAM_SAME fill word or ZRAM_WB block */
+	};
+	unsigned long value;	/* object size and flags, see above */
+};
+
+/* Compression stream: private scratch buffers for one writer */
+struct zram_strm {
+	void *workmem;		/* backend working memory */
+	void *buffer;		/* compression output, two pages */
+	struct list_head list;
+};
 
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
@@ -80,20 +118,40 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 bad_compress;	/* % of pages with compression ratio>=75% */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of same element filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t bad_compress;	/* % of pages with compression ratio>=75% */
+	atomic_t bd_count;	/* no. of pages on the backing device */
+	u64 bd_reads;		/* no. of pages read from the backing device */
+	u64 bd_writes;		/* no. of pages written back */
 };
 
+/* How multi-page writes are processed, see io_mode in zram.txt */
+enum zram_io_mode {
+	ZRAM_IO_SYNC,	/* all pages on the submitting CPU */
+	ZRAM_IO_ASYNC,	/* one work item per page, in parallel */
+};
+
+/* Writeback modes, which pages zram_writeback() moves to the backing dev */
+#define ZRAM_WB_IDLE	(1 << 0)
+#define ZRAM_WB_HUGE	(1 << 1)
+
 struct zram {
 	struct zs_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
-	struct table *table;
+	const struct zram_compressor *comp;
+	/*
+	 * Idle compression streams. Writers take one for the duration of
+	 * a compression so that up to max_strm pages compress in parallel.
+	 */
+	struct list_head idle_strm;
+	spinlock_t strm_lock;	/* protect idle_strm */
+	wait_queue_head_t strm_wait;
+	int max_strm;
+	enum zram_io_mode io_mode;
+	struct table *table;	/* entries are locked with ZRAM_ACCESS */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct rw_semaphore lock; /* protect compression buffers and table
-				   * against concurrent read and writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -105,6 +163,17 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Optional backing device for idle and incompressible pages */
+	struct block_device *bdev;
+	char *backing_dev;		/* path given through sysfs */
+	unsigned long *bitmap;		/* used blocks on the backing device */
+	unsigned long nr_bdev_pages;
+	struct mutex wb_lock;		/* serialize writeback passes */
+	struct delayed_work wb_work;
+	unsigned int wb_interval;	/* seconds, 0 disables periodic wb */
+#endif
+
 	struct zram_stats stats;
 };
 
@@ -114,7 +183,23 @@ unsigned int zram_get_num_devices(void);
 extern struct attribute_group zram_disk_attr_group;
 #endif
 
+const struct zram_compressor *zram_default_compressor(void);
+const struct zram_compressor *zram_find_compressor(const char *name);
+ssize_t zram_show_compressors(const struct zram_compressor *cur, char *buf);
+int zram_create_streams(struct zram *zram);
+void zram_destroy_streams(struct zram *zram);
+struct zram_strm *zram_strm_find(struct zram *zram);
+void zram_strm_release(struct zram *zram, struct zram_strm *strm);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+int zram_set_bdev(struct zram *zram, const char *path);
+void zram_reset_bdev(struct zram *zram);
+void zram_mark_idle(struct zram *zram);
+int zram_writeback(struct zram *zram, int mode);
+#endif
+
 extern int zram_init_device(struct zram *zram);
 extern void __zram_reset_device(struct zram *zram);
+extern void zram_reset_device(struct zram *zram);
 
 #endif
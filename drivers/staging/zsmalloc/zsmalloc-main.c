@@ -45,7 +45,9 @@
  *		component page after the first page
  *	page->freelist: points to the first free object in zspage.
  *		Free objects are linked together using in-place
- *		metadata.
+ *		metadata. For huge classes, which have a single object
+ *		per zspage, page->index holds the handle of that object
+ *		while it is allocated.
  *	page->objects: maximum number of objects we can store in this
  *		zspage (class->zspage_order * PAGE_SIZE / class->size)
  *	page->lru: links together first pages of various zspages.
@@ -56,6 +58,14 @@
  *	PG_private: identifies the first component page
  *	PG_private2: identifies the last component page
  *
+ * Handles returned to users point to a word holding the current location
+ * of the object, and allocated objects start with their handle. This lets
+ * compaction (zs_compact) move objects out of sparsely used zspages and
+ * free them.
+ *
+ * With CONFIG_DEBUG_FS, zsmalloc/<pool name>/classes in debugfs reports,
+ * for every size class in use, its zspages per fullness group and the
+ * objects allocated versus used, which shows where memory is wasted.
  */
 
 #ifdef CONFIG_ZSMALLOC_DEBUG
@@ -65,6 +75,7 @@
 #include <linux/module.h>
 #include <linux/kernel.h>
 #include <linux/bitops.h>
+#include <linux/bit_spinlock.h>
 #include <linux/errno.h>
 #include <linux/highmem.h>
 #include <linux/init.h>
@@ -76,6 +87,8 @@
 #include <linux/cpu.h>
 #include <linux/vmalloc.h>
 #include <linux/hardirq.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "zsmalloc.h"
 #include "zsmalloc_int.h"
@@ -92,6 +105,9 @@
 /* per-cpu VM mapping areas for zspage accesses that cross page boundaries */
 static DEFINE_PER_CPU(struct mapping_area, zs_map_area);
 
+/* Backing store of the handles given out by zs_malloc() */
+static struct kmem_cache *zs_handle_cachep;
+
 static int is_first_page(struct page *page)
 {
 	return PagePrivate(page);
@@ -163,6 +179,9 @@ static void insert_zspage(struct page *page, struct size_class *class,
 
 	BUG_ON(!is_first_page(page));
 
+	if (fullness != ZS_EMPTY)
+		class->fullness_count[fullness]++;
+
 	if (fullness >= _ZS_NR_FULLNESS_GROUPS)
 		return;
 
@@ -180,6 +199,9 @@ static void remove_zspage(struct page *page, struct size_class *class,
 
 	BUG_ON(!is_first_page(page));
 
+	if (fullness != ZS_EMPTY)
+		class->fullness_count[fullness]--;
+
 	if (fullness >= _ZS_NR_FULLNESS_GROUPS)
 		return;
 
@@ -279,28 +301,58 @@ static struct page *get_next_page(struct page *page)
 	return next;
 }
 
-/* Encode <page, obj_idx> as a single handle value */
-static void *obj_location_to_handle(struct page *page, unsigned long obj_idx)
+/* Encode <page, obj_idx> as a single object location value */
+static void *location_to_obj(struct page *page, unsigned long obj_idx)
 {
-	unsigned long handle;
+	unsigned long obj;
 
 	if (!page) {
 		BUG_ON(obj_idx);
 		return NULL;
 	}
 
-	handle = page_to_pfn(page) << OBJ_INDEX_BITS;
-	handle |= (obj_idx & OBJ_INDEX_MASK);
+	obj = page_to_pfn(page) << OBJ_INDEX_BITS;
+	obj |= (obj_idx & OBJ_INDEX_MASK);
+	obj <<= OBJ_TAG_BITS;
 
-	return (void *)handle;
+	return (void *)obj;
 }
 
-/* Decode <page, obj_idx> pair from the given object handle */
-static void obj_handle_to_location(unsigned long handle, struct page **page,
+/* Decode <page, obj_idx> pair from the given object location */
+static void obj_to_location(unsigned long obj, struct page **page,
 				unsigned long *obj_idx)
 {
-	*page = pfn_to_page(handle >> OBJ_INDEX_BITS);
-	*obj_idx = handle & OBJ_INDEX_MASK;
+	obj >>= OBJ_TAG_BITS;
+	*page = pfn_to_page(obj >> OBJ_INDEX_BITS);
+	*obj_idx = obj & OBJ_INDEX_MASK;
+}
+
+static unsigned long handle_to_obj(unsigned long handle)
+{
+	return *(unsigned long *)handle & ~BIT(HANDLE_PIN_BIT);
+}
+
+/* Point a live handle at a new location, keeping the pin bit as it is */
+static void record_obj(unsigned long handle, unsigned long obj)
+{
+	unsigned long *ptr = (unsigned long *)handle;
+
+	*ptr = obj | (*ptr & BIT(HANDLE_PIN_BIT));
+}
+
+static void pin_tag(unsigned long handle)
+{
+	bit_spin_lock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static int trypin_tag(unsigned long handle)
+{
+	return bit_spin_trylock(HANDLE_PIN_BIT, (unsigned long *)handle);
+}
+
+static void unpin_tag(unsigned long handle)
+{
+	bit_spin_unlock(HANDLE_PIN_BIT, (unsigned long *)handle);
 }
 
 static unsigned long obj_idx_to_offset(struct page *page,
@@ -377,7 +429,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		for (i = 1; i <= objs_on_page; i++) {
 			off += class->size;
 			if (off < PAGE_SIZE) {
-				link->next = obj_location_to_handle(page, i);
+				link->next = location_to_obj(page, i);
 				link += class->size / sizeof(*link);
 			}
 		}
@@ -388,7 +440,7 @@ static void init_zspage(struct page *first_page, struct size_class *class)
 		 * page (if present)
 		 */
 		next_page = get_next_page(page);
-		link->next = obj_location_to_handle(next_page, 0);
+		link->next = location_to_obj(next_page, 0);
 		kunmap_atomic(link);
 		page = next_page;
 		off = (off + class->size) % PAGE_SIZE;
@@ -442,9 +494,9 @@ static struct page *alloc_zspage(struct size_class *class, gfp_t flags)
 
 	init_zspage(first_page, class);
 
-	first_page->freelist = obj_location_to_handle(first_page, 0);
+	first_page->freelist = location_to_obj(first_page, 0);
 	/* Maximum number of objects we can store in this zspage */
-	first_page->objects = class->pages_per_zspage * PAGE_SIZE / class->size;
+	first_page->objects = class->objs_per_zspage;
 
 	error = 0; /* Success */
 
@@ -471,16 +523,140 @@ static struct page *find_get_zspage(struct size_class *class)
 	return page;
 }
 
-static void zs_copy_map_object(char *buf, struct page *page,
-				int off, int size)
+/*
+ * Take the first free object of first_page and store handle in it.
+ * Caller must hold class->lock.
+ */
+static unsigned long obj_malloc(struct size_class *class,
+				struct page *first_page, unsigned long handle)
+{
+	unsigned long obj;
+	struct link_free *link;
+	struct page *m_page;
+	unsigned long m_objidx, m_offset;
+
+	obj = (unsigned long)first_page->freelist;
+	obj_to_location(obj, &m_page, &m_objidx);
+	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
+
+	link = (struct link_free *)kmap_atomic(m_page) +
+					m_offset / sizeof(*link);
+	first_page->freelist = link->next;
+	if (!class->huge)
+		link->handle = handle | OBJ_ALLOCATED_TAG;
+	else
+		/* The only object of this zspage, freelist is now empty */
+		first_page->index = handle;
+	kunmap_atomic(link);
+
+	first_page->inuse++;
+	class->obj_used++;
+
+	return obj;
+}
+
+/* Caller must hold class->lock */
+static void obj_free(struct size_class *class, unsigned long obj)
+{
+	struct link_free *link;
+	struct page *first_page, *f_page;
+	unsigned long f_objidx, f_offset;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
+
+	if (class->huge)
+		first_page->freelist = NULL;
+
+	/* Insert this object in containing zspage's freelist */
+	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
+							+ f_offset);
+	link->next = first_page->freelist;
+	kunmap_atomic(link);
+	first_page->freelist = (void *)obj;
+
+	first_page->inuse--;
+	class->obj_used--;
+}
+
+#ifdef CONFIG_ZSMALLOC_PGTABLE_MAPPING
+
+/*
+ * Objects spanning two pages are mapped contiguously by pointing the page
+ * table entries of a per-cpu vm area at both pages. This avoids copying
+ * the object in and out, at the cost of a TLB flush per unmap.
+ */
+static inline int __zs_cpu_up(struct mapping_area *area)
+{
+	/*
+	 * Make sure we don't leak memory if a cpu UP notification
+	 * and zs_init() race and both call zs_cpu_up() on the same cpu
+	 */
+	if (area->vm)
+		return 0;
+	area->vm = alloc_vm_area(PAGE_SIZE * 2);
+	if (!area->vm)
+		return -ENOMEM;
+	return 0;
+}
+
+static inline void __zs_cpu_down(struct mapping_area *area)
+{
+	if (area->vm)
+		free_vm_area(area->vm);
+	area->vm = NULL;
+}
+
+static inline void *__zs_map_object(struct mapping_area *area,
+				struct page *pages[2], int off, int size)
+{
+	struct page **page_array = pages;
+
+	BUG_ON(map_vm_area(area->vm, PAGE_KERNEL, &page_array));
+	area->vm_addr = area->vm->addr;
+	return area->vm_addr + off;
+}
+
+static inline void __zs_unmap_object(struct mapping_area *area,
+				struct page *pages[2], int off, int size)
+{
+	unmap_kernel_range((unsigned long)area->vm_addr, PAGE_SIZE * 2);
+}
+
+#else /* CONFIG_ZSMALLOC_PGTABLE_MAPPING */
+
+static inline int __zs_cpu_up(struct mapping_area *area)
+{
+	/*
+	 * Make sure we don't leak memory if a cpu UP notification
+	 * and zs_init() race and both call zs_cpu_up() on the same cpu
+	 */
+	if (area->vm_buf)
+		return 0;
+	area->vm_buf = (char *)__get_free_page(GFP_KERNEL);
+	if (!area->vm_buf)
+		return -ENOMEM;
+	return 0;
+}
+
+static inline void __zs_cpu_down(struct mapping_area *area)
+{
+	if (area->vm_buf)
+		free_page((unsigned long)area->vm_buf);
+	area->vm_buf = NULL;
+}
+
+static void *__zs_map_object(struct mapping_area *area,
+			struct page *pages[2], int off, int size)
 {
-	struct page *pages[2];
 	int sizes[2];
 	void *addr;
+	char *buf = area->vm_buf;
 
-	pages[0] = page;
-	pages[1] = get_next_page(page);
-	BUG_ON(!pages[1]);
+	/* no read fastpath */
+	if (area->vm_mm == ZS_MM_WO)
+		goto out;
 
 	sizes[0] = PAGE_SIZE - off;
 	sizes[1] = size - sizes[0];
@@ -492,18 +668,20 @@ static void zs_copy_map_object(char *buf, struct page *page,
 	addr = kmap_atomic(pages[1]);
 	memcpy(buf + sizes[0], addr, sizes[1]);
 	kunmap_atomic(addr);
+out:
+	return area->vm_buf;
 }
 
-static void zs_copy_unmap_object(char *buf, struct page *page,
-				int off, int size)
+static void __zs_unmap_object(struct mapping_area *area,
+			struct page *pages[2], int off, int size)
 {
-	struct page *pages[2];
 	int sizes[2];
 	void *addr;
+	char *buf = area->vm_buf;
 
-	pages[0] = page;
-	pages[1] = get_next_page(page);
-	BUG_ON(!pages[1]);
+	/* no write fastpath */
+	if (area->vm_mm == ZS_MM_RO)
+		return;
 
 	sizes[0] = PAGE_SIZE - off;
 	sizes[1] = size - sizes[0];
@@ -517,6 +695,414 @@ static void zs_copy_unmap_object(char *buf, struct page *page,
 	kunmap_atomic(addr);
 }
 
+#endif /* CONFIG_ZSMALLOC_PGTABLE_MAPPING */
+
+/* Copy the object at src into the just allocated object at dst */
+static void zs_object_copy(struct size_class *class, unsigned long dst,
+				unsigned long src)
+{
+	struct page *s_page, *d_page;
+	unsigned long s_objidx, d_objidx;
+	unsigned long s_off, d_off;
+	void *s_addr, *d_addr;
+	int len, written = 0;
+
+	obj_to_location(src, &s_page, &s_objidx);
+	obj_to_location(dst, &d_page, &d_objidx);
+	s_off = obj_idx_to_offset(s_page, s_objidx, class->size);
+	d_off = obj_idx_to_offset(d_page, d_objidx, class->size);
+
+	s_addr = kmap_atomic(s_page);
+	d_addr = kmap_atomic(d_page);
+	for (;;) {
+		len = min3(class->size - written, (int)(PAGE_SIZE - s_off),
+			   (int)(PAGE_SIZE - d_off));
+		memcpy(d_addr + d_off, s_addr + s_off, len);
+		written += len;
+		if (written == class->size)
+			break;
+
+		s_off += len;
+		d_off += len;
+		/* kmap_atomic() mappings must be released in reverse order */
+		if (s_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			kunmap_atomic(s_addr);
+			s_page = get_next_page(s_page);
+			s_addr = kmap_atomic(s_page);
+			d_addr = kmap_atomic(d_page);
+			s_off = 0;
+		}
+		if (d_off >= PAGE_SIZE) {
+			kunmap_atomic(d_addr);
+			d_page = get_next_page(d_page);
+			d_addr = kmap_atomic(d_page);
+			d_off = 0;
+		}
+	}
+	kunmap_atomic(d_addr);
+	kunmap_atomic(s_addr);
+}
+
+/* Return the handle of the object at offset off of page, 0 if it is free */
+static unsigned long obj_handle_at(struct size_class *class,
+				struct page *first_page, struct page *page,
+				unsigned long off)
+{
+	unsigned long head;
+	void *addr;
+
+	if (class->huge)
+		return first_page->inuse ? first_page->index : 0;
+
+	addr = kmap_atomic(page);
+	head = *(unsigned long *)(addr + off);
+	kunmap_atomic(addr);
+
+	if (!(head & OBJ_ALLOCATED_TAG))
+		return 0;
+	return head & ~OBJ_ALLOCATED_TAG;
+}
+
+/*
+ * Move objects from src to dst until src is empty (returns 0) or dst is
+ * full (returns -EAGAIN). Objects pinned by a user are skipped, if any
+ * remain in src -EBUSY is returned. Caller must hold class->lock and
+ * have both zspages isolated from the fullness lists.
+ */
+static int migrate_zspage(struct size_class *class, struct page *src,
+				struct page *dst)
+{
+	struct page *page;
+	unsigned long handle, used_obj, free_obj, off;
+	int nr = 0;
+
+	for (page = src; page; page = get_next_page(page)) {
+		off = is_first_page(page) ? 0 : page->index;
+		for (; off < PAGE_SIZE && nr < src->objects;
+		     off += class->size, nr++) {
+			handle = obj_handle_at(class, src, page, off);
+			if (!handle)
+				continue;
+
+			if (dst->inuse == dst->objects)
+				return -EAGAIN;
+
+			/* Mapped or being freed, leave it where it is */
+			if (!trypin_tag(handle))
+				continue;
+
+			used_obj = handle_to_obj(handle);
+			free_obj = obj_malloc(class, dst, handle);
+			zs_object_copy(class, free_obj, used_obj);
+			record_obj(handle, free_obj);
+			unpin_tag(handle);
+			obj_free(class, used_obj);
+
+			if (!src->inuse)
+				return 0;
+		}
+	}
+
+	return src->inuse ? -EBUSY : 0;
+}
+
+/*
+ * Take a zspage off the fullness lists: the emptiest one as source of a
+ * migration, the fullest one as its destination.
+ */
+static struct page *isolate_zspage(struct size_class *class, bool source)
+{
+	int i;
+	struct page *page;
+	enum fullness_group fg[2] = { ZS_ALMOST_EMPTY, ZS_ALMOST_FULL };
+
+	if (!source) {
+		fg[0] = ZS_ALMOST_FULL;
+		fg[1] = ZS_ALMOST_EMPTY;
+	}
+
+	for (i = 0; i < 2; i++) {
+		page = class->fullness_list[fg[i]];
+		if (page) {
+			remove_zspage(page, class, fg[i]);
+			return page;
+		}
+	}
+
+	return NULL;
+}
+
+static void putback_zspage(struct size_class *class, struct page *first_page)
+{
+	enum fullness_group fg;
+
+	fg = get_fullness_group(first_page);
+	insert_zspage(first_page, class, fg);
+	set_zspage_mapping(first_page, class->index, fg);
+}
+
+/* Number of pages compaction of this class could give back at most */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	unsigned long obj_allocated, obj_wasted;
+
+	if (class->huge)
+		return 0;
+
+	obj_allocated = class->pages_allocated / class->pages_per_zspage *
+				class->objs_per_zspage;
+	obj_wasted = obj_allocated - class->obj_used;
+
+	return obj_wasted / class->objs_per_zspage * class->pages_per_zspage;
+}
+
+static unsigned long zs_compact_class(struct size_class *class)
+{
+	unsigned long pages_freed = 0;
+	struct page *src, *dst = NULL;
+	int ret;
+
+	spin_lock(&class->lock);
+	while (zs_can_compact(class)) {
+		src = isolate_zspage(class, true);
+		if (!src)
+			break;
+
+		ret = -EAGAIN;
+		while (ret == -EAGAIN) {
+			if (!dst)
+				dst = isolate_zspage(class, false);
+			if (!dst)
+				break;
+
+			ret = migrate_zspage(class, src, dst);
+			if (ret == -EAGAIN) {
+				putback_zspage(class, dst);
+				dst = NULL;
+			}
+		}
+
+		if (src->inuse) {
+			/* Pinned objects left, or nowhere to move them */
+			putback_zspage(class, src);
+			break;
+		}
+
+		if (dst) {
+			putback_zspage(class, dst);
+			dst = NULL;
+		}
+		class->pages_allocated -= class->pages_per_zspage;
+		pages_freed += class->pages_per_zspage;
+		spin_unlock(&class->lock);
+
+		free_zspage(src);
+		cond_resched();
+		spin_lock(&class->lock);
+	}
+	if (dst)
+		putback_zspage(class, dst);
+	spin_unlock(&class->lock);
+
+	return pages_freed;
+}
+
+/**
+ * zs_compact - Migrate objects to free sparsely used zspages.
+ * @pool: pool to compact
+ *
+ * Within each size class, objects are moved out of the least used zspages
+ * into the most used ones, and zspages that become empty are freed.
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	int i;
+	unsigned long pages_freed = 0;
+	struct size_class *class;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = &pool->size_class[i];
+		class->compact_before = class->pages_allocated /
+						class->pages_per_zspage;
+		pages_freed += zs_compact_class(class);
+		class->compact_after = class->pages_allocated /
+						class->pages_per_zspage;
+	}
+
+	return pages_freed;
+}
+EXPORT_SYMBOL_GPL(zs_compact);
+
+/**
+ * zs_compact_report - Describe the effect of the last zs_compact().
+ * @pool: pool that was compacted
+ * @buf: buffer to print to
+ * @size: size of buf
+ *
+ * Prints one line per size class whose number of zspages changed, with
+ * the zspages used before and after compaction. Returns the length of the
+ * text in buf.
+ */
+ssize_t zs_compact_report(struct zs_pool *pool, char *buf, size_t size)
+{
+	int i;
+	ssize_t len;
+	struct size_class *class;
+
+	len = scnprintf(buf, size, "%5s %5s %14s %13s %9s\n", "class",
+			"size", "zspages_before", "zspages_after", "obj_used");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = &pool->size_class[i];
+		if (class->compact_before == class->compact_after)
+			continue;
+
+		len += scnprintf(buf + len, size - len,
+				"%5d %5d %14lu %13lu %9lu\n", i, class->size,
+				class->compact_before, class->compact_after,
+				class->obj_used);
+	}
+
+	return len;
+}
+EXPORT_SYMBOL_GPL(zs_compact_report);
+
+static int zs_shrink(struct shrinker *shrinker, struct shrink_control *sc)
+{
+	int i;
+	unsigned long nr = 0;
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					    shrinker);
+
+	if (sc->nr_to_scan)
+		zs_compact(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++)
+		nr += zs_can_compact(&pool->size_class[i]);
+
+	return min_t(unsigned long, nr, INT_MAX);
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static struct dentry *zs_stat_root;
+
+static int zs_stats_size_show(struct seq_file *s, void *v)
+{
+	int i;
+	struct zs_pool *pool = s->private;
+	struct size_class *class;
+	unsigned long almost_full, almost_empty, full;
+	unsigned long obj_allocated, obj_used, pages_used;
+	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
+
+	seq_printf(s, " %5s %5s %11s %12s %8s %13s %10s %10s %16s\n",
+			"class", "size", "almost_full", "almost_empty", "full",
+			"obj_allocated", "obj_used", "pages_used",
+			"pages_per_zspage");
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		almost_full = class->fullness_count[ZS_ALMOST_FULL];
+		almost_empty = class->fullness_count[ZS_ALMOST_EMPTY];
+		full = class->fullness_count[ZS_FULL];
+		obj_used = class->obj_used;
+		pages_used = class->pages_allocated;
+		spin_unlock(&class->lock);
+
+		if (!pages_used)
+			continue;
+
+		obj_allocated = pages_used / class->pages_per_zspage *
+					class->objs_per_zspage;
+
+		seq_printf(s, " %5d %5d %11lu %12lu %8lu %13lu %10lu %10lu %16d\n",
+			i, class->size, almost_full, almost_empty, full,
+			obj_allocated, obj_used, pages_used,
+			class->pages_per_zspage);
+
+		total_objs += obj_allocated;
+		total_used_objs += obj_used;
+		total_pages += pages_used;
+	}
+
+	seq_printf(s, " %5s %5s %11s %12s %8s %13lu %10lu %10lu\n",
+			"Total", "", "", "", "", total_objs, total_used_objs,
+			total_pages);
+
+	return 0;
+}
+
+static int zs_stats_size_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, zs_stats_size_show, inode->i_private);
+}
+
+static const struct file_operations zs_stat_size_ops = {
+	.open		= zs_stats_size_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void zs_stat_init(void)
+{
+	zs_stat_root = debugfs_create_dir("zsmalloc", NULL);
+	if (!zs_stat_root)
+		pr_warn("debugfs 'zsmalloc' stat dir creation failed\n");
+}
+
+static void zs_stat_exit(void)
+{
+	debugfs_remove_recursive(zs_stat_root);
+}
+
+static void zs_pool_stat_create(struct zs_pool *pool)
+{
+	if (!zs_stat_root)
+		return;
+
+	pool->stat_dentry = debugfs_create_dir(pool->name, zs_stat_root);
+	if (!pool->stat_dentry) {
+		pr_warn("debugfs dir <%s> creation failed\n", pool->name);
+		return;
+	}
+
+	if (!debugfs_create_file("classes", S_IFREG | S_IRUGO,
+				 pool->stat_dentry, pool, &zs_stat_size_ops))
+		pr_warn("%s: debugfs file entry <classes> creation failed\n",
+			pool->name);
+}
+
+static void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+	debugfs_remove_recursive(pool->stat_dentry);
+}
+
+#else /* CONFIG_DEBUG_FS */
+
+static inline void zs_stat_init(void)
+{
+}
+
+static inline void zs_stat_exit(void)
+{
+}
+
+static inline void zs_pool_stat_create(struct zs_pool *pool)
+{
+}
+
+static inline void zs_pool_stat_destroy(struct zs_pool *pool)
+{
+}
+
+#endif
+
 static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
 				void *pcpu)
 {
@@ -526,23 +1112,11 @@ static int zs_cpu_notifier(struct notifier_block *nb, unsigned long action,
 	switch (action) {
 	case CPU_UP_PREPARE:
 		area = &per_cpu(zs_map_area, cpu);
-		/*
-		 * Make sure we don't leak memory if a cpu UP notification
-		 * and zs_init() race and both call zs_cpu_up() on the same cpu
-		 */
-		if (area->vm_buf)
-			return 0;
-		area->vm_buf = (char *)__get_free_page(GFP_KERNEL);
-		if (!area->vm_buf)
-			return -ENOMEM;
-		return 0;
-		break;
+		return __zs_cpu_up(area);
 	case CPU_DEAD:
 	case CPU_UP_CANCELED:
 		area = &per_cpu(zs_map_area, cpu);
-		if (area->vm_buf)
-			free_page((unsigned long)area->vm_buf);
-		area->vm_buf = NULL;
+		__zs_cpu_down(area);
 		break;
 	}
 
@@ -560,12 +1134,22 @@ static void zs_exit(void)
 	for_each_online_cpu(cpu)
 		zs_cpu_notifier(NULL, CPU_DEAD, (void *)(long)cpu);
 	unregister_cpu_notifier(&zs_cpu_nb);
+
+	zs_stat_exit();
+	kmem_cache_destroy(zs_handle_cachep);
 }
 
 static int zs_init(void)
 {
 	int cpu, ret;
 
+	zs_handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
+					     0, 0, NULL);
+	if (!zs_handle_cachep)
+		return -ENOMEM;
+
+	zs_stat_init();
+
 	register_cpu_notifier(&zs_cpu_nb);
 	for_each_online_cpu(cpu) {
 		ret = zs_cpu_notifier(NULL, CPU_UP_PREPARE, (void *)(long)cpu);
@@ -604,12 +1188,20 @@ struct zs_pool *zs_create_pool(const char *name, gfp_t flags)
 		class->index = i;
 		spin_lock_init(&class->lock);
 		class->pages_per_zspage = get_pages_per_zspage(size);
-
+		class->objs_per_zspage = class->pages_per_zspage *
+						PAGE_SIZE / size;
+		class->huge = class->objs_per_zspage == 1;
 	}
 
 	pool->flags = flags;
 	pool->name = name;
 
+	pool->shrinker.shrink = zs_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	zs_pool_stat_create(pool);
+
 	return pool;
 }
 EXPORT_SYMBOL_GPL(zs_create_pool);
@@ -618,6 +1210,9 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	unregister_shrinker(&pool->shrinker);
+	zs_pool_stat_destroy(pool);
+
 	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
 		int fg;
 		struct size_class *class = &pool->size_class[i];
@@ -645,18 +1240,22 @@ EXPORT_SYMBOL_GPL(zs_destroy_pool);
  */
 unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 {
-	unsigned long obj;
-	struct link_free *link;
+	unsigned long handle, obj;
 	int class_idx;
 	struct size_class *class;
-
-	struct page *first_page, *m_page;
-	unsigned long m_objidx, m_offset;
+	struct page *first_page;
 
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
-	class_idx = get_size_class_index(size);
+	handle = (unsigned long)kmem_cache_alloc(zs_handle_cachep,
+					pool->flags & ~__GFP_HIGHMEM);
+	if (!handle)
+		return 0;
+
+	/* extra space in chunk to keep the handle */
+	size += ZS_HANDLE_SIZE;
+	class_idx = min_t(int, get_size_class_index(size), ZS_SIZE_CLASSES - 1);
 	class = &pool->size_class[class_idx];
 	BUG_ON(class_idx != class->index);
 
@@ -666,72 +1265,61 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 	if (!first_page) {
 		spin_unlock(&class->lock);
 		first_page = alloc_zspage(class, pool->flags);
-		if (unlikely(!first_page))
+		if (unlikely(!first_page)) {
+			kmem_cache_free(zs_handle_cachep, (void *)handle);
 			return 0;
+		}
 
 		set_zspage_mapping(first_page, class->index, ZS_EMPTY);
 		spin_lock(&class->lock);
 		class->pages_allocated += class->pages_per_zspage;
 	}
 
-	obj = (unsigned long)first_page->freelist;
-	obj_handle_to_location(obj, &m_page, &m_objidx);
-	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
-
-	link = (struct link_free *)kmap_atomic(m_page) +
-					m_offset / sizeof(*link);
-	first_page->freelist = link->next;
-	memset(link, POISON_INUSE, sizeof(*link));
-	kunmap_atomic(link);
-
-	first_page->inuse++;
+	obj = obj_malloc(class, first_page, handle);
 	/* Now move the zspage to another fullness group, if required */
 	fix_fullness_group(pool, first_page);
+	/* the handle is fresh from the slab, whatever is in it is garbage */
+	*(unsigned long *)handle = obj;
 	spin_unlock(&class->lock);
 
-	return obj;
+	return handle;
 }
 EXPORT_SYMBOL_GPL(zs_malloc);
 
-void zs_free(struct zs_pool *pool, unsigned long obj)
+void zs_free(struct zs_pool *pool, unsigned long handle)
 {
-	struct link_free *link;
 	struct page *first_page, *f_page;
-	unsigned long f_objidx, f_offset;
-
+	unsigned long obj, f_objidx;
 	int class_idx;
 	struct size_class *class;
 	enum fullness_group fullness;
 
-	if (unlikely(!obj))
+	if (unlikely(!handle))
 		return;
 
-	obj_handle_to_location(obj, &f_page, &f_objidx);
+	/* Keep compaction from moving the object under us */
+	pin_tag(handle);
+	obj = handle_to_obj(handle);
+	obj_to_location(obj, &f_page, &f_objidx);
 	first_page = get_first_page(f_page);
 
 	get_zspage_mapping(first_page, &class_idx, &fullness);
 	class = &pool->size_class[class_idx];
-	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
 
 	spin_lock(&class->lock);
-
-	/* Insert this object in containing zspage's freelist */
-	link = (struct link_free *)((unsigned char *)kmap_atomic(f_page)
-							+ f_offset);
-	link->next = first_page->freelist;
-	kunmap_atomic(link);
-	first_page->freelist = (void *)obj;
-
-	first_page->inuse--;
+	obj_free(class, obj);
 	fullness = fix_fullness_group(pool, first_page);
 
 	if (fullness == ZS_EMPTY)
 		class->pages_allocated -= class->pages_per_zspage;
 
 	spin_unlock(&class->lock);
+	unpin_tag(handle);
 
 	if (fullness == ZS_EMPTY)
 		free_zspage(first_page);
+
+	kmem_cache_free(zs_handle_cachep, (void *)handle);
 }
 EXPORT_SYMBOL_GPL(zs_free);
 
@@ -754,6 +1342,8 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	enum fullness_group fg;
 	struct size_class *class;
 	struct mapping_area *area;
+	struct page *pages[2];
+	void *ret;
 
 	BUG_ON(!handle);
 
@@ -764,25 +1354,39 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	 */
 	BUG_ON(in_interrupt());
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	/* The object stays pinned in place until zs_unmap_object() */
+	pin_tag(handle);
+
+	obj_to_location(handle_to_obj(handle), &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
 
 	area = &get_cpu_var(zs_map_area);
+	area->vm_mm = mm;
 	if (off + class->size <= PAGE_SIZE) {
 		/* this object is contained entirely within a page */
 		area->vm_addr = kmap_atomic(page);
-		return area->vm_addr + off;
+		ret = area->vm_addr + off;
+		goto out;
 	}
 
+	/* this object spans two pages */
+	pages[0] = page;
+	pages[1] = get_next_page(page);
+	BUG_ON(!pages[1]);
+
 	/* disable page faults to match kmap_atomic() return conditions */
 	pagefault_disable();
 
-	if (mm != ZS_MM_WO)
-		zs_copy_map_object(area->vm_buf, page, off, class->size);
-	area->vm_addr = NULL;
-	return area->vm_buf;
+	ret = __zs_map_object(area, pages, off, class->size);
+	if (mm == ZS_MM_WO && !class->huge)
+		/* the handle is written back along with the object */
+		*(unsigned long *)ret = handle | OBJ_ALLOCATED_TAG;
+out:
+	if (!class->huge)
+		ret += ZS_HANDLE_SIZE;
+	return ret;
 }
 EXPORT_SYMBOL_GPL(zs_map_object);
 
@@ -795,32 +1399,30 @@ void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
 	enum fullness_group fg;
 	struct size_class *class;
 	struct mapping_area *area;
-
-	area = &__get_cpu_var(zs_map_area);
-	/* single-page object fastpath */
-	if (area->vm_addr) {
-		kunmap_atomic(area->vm_addr);
-		goto out;
-	}
-
-	/* no write fastpath */
-	if (area->vm_mm == ZS_MM_RO)
-		goto pfenable;
+	struct page *pages[2];
 
 	BUG_ON(!handle);
 
-	obj_handle_to_location(handle, &page, &obj_idx);
+	obj_to_location(handle_to_obj(handle), &page, &obj_idx);
 	get_zspage_mapping(get_first_page(page), &class_idx, &fg);
 	class = &pool->size_class[class_idx];
 	off = obj_idx_to_offset(page, obj_idx, class->size);
 
-	zs_copy_unmap_object(area->vm_buf, page, off, class->size);
-
-pfenable:
-	/* enable page faults to match kunmap_atomic() return conditions */
-	pagefault_enable();
-out:
+	area = &__get_cpu_var(zs_map_area);
+	if (off + class->size <= PAGE_SIZE) {
+		/* single-page object fastpath */
+		kunmap_atomic(area->vm_addr);
+	} else {
+		pages[0] = page;
+		pages[1] = get_next_page(page);
+		BUG_ON(!pages[1]);
+
+		__zs_unmap_object(area, pages, off, class->size);
+		/* enable page faults to match kunmap_atomic() return conditions */
+		pagefault_enable();
+	}
 	put_cpu_var(zs_map_area);
+	unpin_tag(handle);
 }
 EXPORT_SYMBOL_GPL(zs_unmap_object);
 
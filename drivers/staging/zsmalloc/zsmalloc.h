@@ -40,4 +40,7 @@ void zs_unmap_object(struct zs_pool *pool, unsigned long handle);
 
 u64 zs_get_total_size_bytes(struct zs_pool *pool);
 
+unsigned long zs_compact(struct zs_pool *pool);
+ssize_t zs_compact_report(struct zs_pool *pool, char *buf, size_t size);
+
 #endif
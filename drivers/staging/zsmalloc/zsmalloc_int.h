@@ -14,6 +14,7 @@
 #define _ZS_MALLOC_INT_H_
 
 #include <linux/kernel.h>
+#include <linux/shrinker.h>
 #include <linux/spinlock.h>
 #include <linux/types.h>
 
@@ -34,7 +35,7 @@
 
 /*
  * Object location (<PFN>, <obj_idx>) is encoded as
- * as single (void *) handle value.
+ * as single (void *) value, shifted left by OBJ_TAG_BITS.
  *
  * Note that object index <obj_idx> is relative to system
  * page <PFN> it is stored in, so for each sub-page belonging
@@ -55,9 +56,27 @@
 #endif
 #endif
 #define _PFN_BITS		(MAX_PHYSMEM_BITS - PAGE_SHIFT)
-#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS)
+/*
+ * The lowest bit of an encoded object location is kept clear: the
+ * first word of an allocated object holds its handle with
+ * OBJ_ALLOCATED_TAG set, which tells it apart from the location of the
+ * next free object held there by free objects. Handles themselves are
+ * word aligned, so their lowest bit is free for OBJ_ALLOCATED_TAG too.
+ */
+#define OBJ_TAG_BITS		1
+#define OBJ_ALLOCATED_TAG	1
+#define OBJ_INDEX_BITS	(BITS_PER_LONG - _PFN_BITS - OBJ_TAG_BITS)
 #define OBJ_INDEX_MASK	((_AC(1, UL) << OBJ_INDEX_BITS) - 1)
 
+/*
+ * A handle points to a word holding the current location of its object,
+ * so that compaction can move objects without their users noticing.
+ * Bit HANDLE_PIN_BIT of that word is a lock keeping the object in place
+ * while it is mapped or being freed.
+ */
+#define HANDLE_PIN_BIT		0
+#define ZS_HANDLE_SIZE		(sizeof(unsigned long))
+
 #define MAX(a, b) ((a) >= (b) ? (a) : (b))
 /* ZS_MIN_ALLOC_SIZE must be multiple of ZS_ALIGN */
 #define ZS_MIN_ALLOC_SIZE \
@@ -110,7 +129,11 @@ enum fullness_group {
 static const int fullness_threshold_frac = 4;
 
 struct mapping_area {
+#ifdef CONFIG_ZSMALLOC_PGTABLE_MAPPING
+	struct vm_struct *vm; /* vm area for mapping objects that span pages */
+#else
 	char *vm_buf; /* copy buffer for objects that span pages */
+#endif
 	char *vm_addr; /* address of kmap_atomic()'ed pages */
 	enum zs_mapmode vm_mm; /* mapping mode */
 };
@@ -125,11 +148,26 @@ struct size_class {
 
 	/* Number of PAGE_SIZE sized pages to combine to form a 'zspage' */
 	int pages_per_zspage;
+	int objs_per_zspage;
+
+	/*
+	 * Huge classes hold a single object per zspage. Their objects have
+	 * no in-object handle, it is kept in first_page->index instead, so
+	 * that a whole PAGE_SIZE object still fits one page.
+	 */
+	bool huge;
 
 	spinlock_t lock;
 
-	/* stats */
+	/* stats, updated under lock */
 	u64 pages_allocated;
+	unsigned long obj_used;
+	/* zspages per fullness group, ZS_EMPTY ones are freed right away */
+	unsigned long fullness_count[ZS_FULL + 1];
+
+	/* zspages used before and after the last compaction of the pool */
+	unsigned long compact_before;
+	unsigned long compact_after;
 
 	struct page *fullness_list[_ZS_NR_FULLNESS_GROUPS];
 };
@@ -141,8 +179,12 @@ struct size_class {
  * This must be power of 2 and less than or equal to ZS_ALIGN
  */
 struct link_free {
-	/* Handle of next free chunk (encodes <PFN, obj_idx>) */
-	void *next;
+	union {
+		/* Location of next free chunk (encodes <PFN, obj_idx>) */
+		void *next;
+		/* Handle of allocated object, tagged with OBJ_ALLOCATED_TAG */
+		unsigned long handle;
+	};
 };
 
 struct zs_pool {
@@ -150,6 +192,13 @@ struct zs_pool {
 
 	gfp_t flags;	/* allocation flags used when growing pool */
 	const char *name;
+
+	/* Compacts the pool under memory pressure */
+	struct shrinker shrinker;
+
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *stat_dentry;
+#endif
 };
 
 #endif
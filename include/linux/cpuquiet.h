@@ -45,6 +45,7 @@ extern int cpuquiet_register_governor(struct cpuquiet_governor *gov);
 extern void cpuquiet_unregister_governor(struct cpuquiet_governor *gov);
 extern int cpuquiet_quiesence_cpu(unsigned int cpunumber);
 extern int cpuquiet_wake_cpu(unsigned int cpunumber);
+extern bool cpuquiet_soft_quiesced(unsigned int cpunumber);
 extern int cpuquiet_register_driver(struct cpuquiet_driver *drv);
 extern void cpuquiet_unregister_driver(struct cpuquiet_driver *drv);
 extern int cpuquiet_add_group(struct attribute_group *attrs);
@@ -66,6 +66,31 @@ static inline void oom_killer_enable(void)
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+extern void lowmem_adj_bucket_add(struct task_struct *p);
+extern void lowmem_adj_bucket_del(struct task_struct *p);
+extern void lowmem_adj_bucket_replace(struct task_struct *old,
+				      struct task_struct *new);
+extern void lowmem_adj_bucket_update(struct task_struct *p);
+#else
+static inline void lowmem_adj_bucket_add(struct task_struct *p)
+{
+}
+
+static inline void lowmem_adj_bucket_del(struct task_struct *p)
+{
+}
+
+static inline void lowmem_adj_bucket_replace(struct task_struct *old,
+					     struct task_struct *new)
+{
+}
+
+static inline void lowmem_adj_bucket_update(struct task_struct *p)
+{
+}
+#endif
+
 /* sysctls */
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
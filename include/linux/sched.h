@@ -144,8 +144,48 @@ extern unsigned long avg_nr_running(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
 
+/**
+ * struct sched_nr_avg - averaging window over the system nr_running
+ * @last_time: start of the current window (sched_clock)
+ * @last_sum: nr_running integral at @last_time
+ * @samples: number of closed windows
+ * @avg: average nr_running * 100 over the last closed window
+ * @avg_short: short term moving average of @avg
+ * @avg_long: long term moving average of @avg
+ */
+struct sched_nr_avg {
+	u64 last_time;
+	u64 last_sum;
+	unsigned long samples;
+	unsigned int avg;
+	unsigned int avg_short;
+	unsigned int avg_long;
+};
+
 extern void sched_update_nr_prod(int cpu, unsigned long nr, bool inc);
 extern void sched_get_nr_running_avg(int *avg);
+extern void sched_nr_avg_init(struct sched_nr_avg *w);
+extern unsigned int sched_nr_avg_update(struct sched_nr_avg *w);
+
+struct notifier_block;
+extern int sched_nr_register_notifier(struct notifier_block *nb);
+extern int sched_nr_unregister_notifier(struct notifier_block *nb);
+extern void sched_nr_notify_tick(int cpu);
+
+/* decayed cfs utilization of @cpu, 0..SCHED_POWER_SCALE */
+extern unsigned long sched_cpu_util(int cpu);
+
+#ifdef CONFIG_CPU_FREQ_GOV_SCHED
+extern void cpufreq_sched_update_util(int cpu, unsigned long util);
+extern void cpufreq_sched_kick(int cpu);
+#else
+static inline void cpufreq_sched_update_util(int cpu, unsigned long util)
+{
+}
+static inline void cpufreq_sched_kick(int cpu)
+{
+}
+#endif
 
 extern void calc_global_load(unsigned long ticks);
 
@@ -1028,6 +1068,8 @@ extern void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 cpumask_var_t *alloc_sched_domains(unsigned int ndoms);
 void free_sched_domains(cpumask_var_t doms[], unsigned int ndoms);
 
+extern int sched_set_cpu_soft_isolated(int cpu, bool isolated);
+
 /* Test a flag in parent sched domain */
 static inline int test_sd_parent(struct sched_domain *sd, int flag)
 {
@@ -1049,6 +1091,11 @@ partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 			struct sched_domain_attr *dattr_new)
 {
 }
+
+static inline int sched_set_cpu_soft_isolated(int cpu, bool isolated)
+{
+	return -EINVAL;
+}
 #endif	/* !CONFIG_SMP */
 
 
@@ -1171,6 +1218,16 @@ struct sched_statistics {
 };
 #endif
 
+/*
+ * Decayed runnable/running time of a scheduling entity or runqueue,
+ * see the per-entity load tracking in kernel/sched_fair.c.
+ */
+struct sched_avg {
+	u32 runnable_avg_sum, running_avg_sum, runnable_avg_period;
+	u64 last_runnable_update;
+	unsigned long load_avg_contrib, util_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1184,6 +1241,8 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	struct sched_avg	avg;
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1288,6 +1347,10 @@ struct task_struct {
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 #endif
+#ifdef CONFIG_ANDROID_LMK_ADJ_BUCKETS
+	/* thread group leaders only, see drivers/staging/android/lowmemorykiller.c */
+	struct hlist_node lowmem_adj_node;
+#endif
 
 	struct mm_struct *mm, *active_mm;
 #ifdef CONFIG_COMPAT_BRK
@@ -0,0 +1,50 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM cpuquiet
+
+#if !defined(_TRACE_CPUQUIET_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CPUQUIET_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One evaluation of the balanced governor in event driven mode: the
+ * inputs it saw, the direction it wanted (1 up, -1 down, 0 none), for
+ * how long that direction has been wanted, and the cpu it acted on
+ * (-1 if it did not act).
+ */
+TRACE_EVENT(cpuquiet_balanced_decision,
+	TP_PROTO(int state, unsigned int avg_nr, unsigned int max_load,
+		 unsigned int online, int dir, unsigned int held_ms, int cpu),
+	TP_ARGS(state, avg_nr, max_load, online, dir, held_ms, cpu),
+
+	TP_STRUCT__entry(
+		__field(int,		state)
+		__field(unsigned int,	avg_nr)
+		__field(unsigned int,	max_load)
+		__field(unsigned int,	online)
+		__field(int,		dir)
+		__field(unsigned int,	held_ms)
+		__field(int,		cpu)
+	),
+
+	TP_fast_assign(
+		__entry->state = state;
+		__entry->avg_nr = avg_nr;
+		__entry->max_load = max_load;
+		__entry->online = online;
+		__entry->dir = dir;
+		__entry->held_ms = held_ms;
+		__entry->cpu = cpu;
+	),
+
+	TP_printk("state=%d avg_nr=%u.%02u max_load=%u online=%u dir=%d "
+		  "held=%ums cpu=%d",
+		  __entry->state, __entry->avg_nr / 100, __entry->avg_nr % 100,
+		  __entry->max_load, __entry->online, __entry->dir,
+		  __entry->held_ms, __entry->cpu)
+);
+
+#endif /* _TRACE_CPUQUIET_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -178,6 +178,7 @@ repeat:
 
 	write_lock_irq(&tasklist_lock);
 	ptrace_release_task(p);
+	lowmem_adj_bucket_del(p);
 	__exit_signal(p);
 
 	/*
@@ -483,6 +483,10 @@ struct rq {
 	u64 nr_switches;
 
 	struct cfs_rq cfs;
+	/* decayed cfs load and utilization, see sched_fair.c */
+	struct sched_avg avg;
+	unsigned long cfs_load_avg;
+	unsigned long cfs_util_avg;
 	struct rt_rq rt;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -2453,6 +2457,34 @@ EXPORT_SYMBOL_GPL(kick_process);
 #endif /* CONFIG_SMP */
 
 #ifdef CONFIG_SMP
+/*
+ * cpus kept online but out of every sched domain and of wakeup
+ * placement, see sched_set_cpu_soft_isolated().
+ */
+static DECLARE_BITMAP(cpu_soft_isolated_bits, CONFIG_NR_CPUS);
+#define cpu_soft_isolated_mask to_cpumask(cpu_soft_isolated_bits)
+
+static inline int cpu_soft_isolated(int cpu)
+{
+	return cpumask_test_cpu(cpu, cpu_soft_isolated_mask);
+}
+
+/*
+ * Somewhere other than the soft isolated @cpu for @p to run, or @cpu
+ * itself if @p is not allowed anywhere else (per-cpu kthreads).
+ */
+static int select_soft_isolated_fallback(int cpu, struct task_struct *p)
+{
+	int dest_cpu;
+
+	for_each_cpu_and(dest_cpu, tsk_cpus_allowed(p), cpu_active_mask) {
+		if (!cpu_soft_isolated(dest_cpu))
+			return dest_cpu;
+	}
+
+	return cpu;
+}
+
 /*
  * ->cpus_allowed is protected by both rq->lock and p->pi_lock
  */
@@ -2537,6 +2569,8 @@ int select_task_rq(struct task_struct *p, int sd_flags, int wake_flags)
 	if (unlikely(!cpumask_test_cpu(cpu, &p->cpus_allowed) ||
 		     !cpu_online(cpu)))
 		cpu = select_fallback_rq(task_cpu(p), p);
+	else if (unlikely(cpu_soft_isolated(cpu)))
+		cpu = select_soft_isolated_fallback(cpu, p);
 
 	return cpu;
 }
@@ -2929,6 +2963,8 @@ static void __sched_fork(struct task_struct *p)
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
 
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
+
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
 #endif
@@ -3245,6 +3281,7 @@ asmlinkage void schedule_tail(struct task_struct *prev)
 	 * task_switch?
 	 */
 	post_schedule(rq);
+	cpufreq_sched_kick(cpu_of(rq));
 
 #ifdef __ARCH_WANT_UNLOCKED_CTXSW
 	/* In this case, finish_task_switch does not reenable preemption */
@@ -4276,6 +4313,8 @@ void scheduler_tick(void)
 	curr->sched_class->task_tick(rq, curr, 0);
 	raw_spin_unlock(&rq->lock);
 
+	sched_nr_notify_tick(cpu);
+	cpufreq_sched_kick(cpu);
 	perf_event_task_tick();
 
 #ifdef CONFIG_SMP
@@ -4493,6 +4532,7 @@ need_resched:
 		raw_spin_unlock_irq(&rq->lock);
 
 	post_schedule(rq);
+	cpufreq_sched_kick(cpu);
 
 	preempt_enable_no_resched();
 	if (need_resched())
@@ -7870,6 +7910,10 @@ void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 
 	n = doms_new ? ndoms_new : 0;
 
+	/* Soft isolated cpus stay out of every domain, whoever asks */
+	for (i = 0; i < n; i++)
+		cpumask_andnot(doms_new[i], doms_new[i], cpu_soft_isolated_mask);
+
 	/* Destroy deleted domains */
 	for (i = 0; i < ndoms_cur; i++) {
 		for (j = 0; j < n && !new_topology; j++) {
@@ -7887,6 +7931,7 @@ match1:
 		ndoms_cur = 0;
 		doms_new = &fallback_doms;
 		cpumask_andnot(doms_new[0], cpu_active_mask, cpu_isolated_map);
+		cpumask_andnot(doms_new[0], doms_new[0], cpu_soft_isolated_mask);
 		WARN_ON_ONCE(dattr_new);
 	}
 
@@ -7898,6 +7943,8 @@ match1:
 				goto match2;
 		}
 		/* no match - add a new doms_new */
+		if (cpumask_empty(doms_new[i]))
+			continue;
 		build_sched_domains(doms_new[i], dattr_new ? dattr_new + i : NULL);
 match2:
 		;
@@ -7916,6 +7963,98 @@ match2:
 	mutex_unlock(&sched_domains_mutex);
 }
 
+/*
+ * Push the queued tasks that may run elsewhere off the soft isolated
+ * @cpu. Each pass drops tasklist_lock to wait for the stopper, so the
+ * number of passes is bounded by what was queued to begin with.
+ */
+static void sched_evacuate_cpu(int cpu)
+{
+	struct task_struct *g, *p, *found;
+	unsigned long passes = cpu_rq(cpu)->nr_running;
+	struct migration_arg arg;
+	int dest_cpu = cpu;
+
+	while (passes--) {
+		found = NULL;
+
+		read_lock(&tasklist_lock);
+		do_each_thread(g, p) {
+			if (task_cpu(p) != cpu || !p->on_rq ||
+			    p->rt.nr_cpus_allowed <= 1)
+				continue;
+			dest_cpu = select_soft_isolated_fallback(cpu, p);
+			if (dest_cpu != cpu) {
+				found = p;
+				get_task_struct(found);
+				goto unlock;
+			}
+		} while_each_thread(g, p);
+unlock:
+		read_unlock(&tasklist_lock);
+
+		if (!found)
+			break;
+
+		arg.task = found;
+		arg.dest_cpu = dest_cpu;
+		stop_one_cpu(cpu, migration_cpu_stop, &arg);
+		put_task_struct(found);
+	}
+}
+
+/**
+ * sched_set_cpu_soft_isolated - take an online cpu out of scheduling
+ * @cpu: the cpu
+ * @isolated: whether to isolate @cpu or give it back
+ *
+ * A soft isolated cpu stays online but is left out of every sched
+ * domain, like an isolcpus= one, no task is placed on it at wakeup
+ * unless it may run nowhere else, and the tasks queued on it when it
+ * is isolated are pushed away. Only per-cpu kthreads and what is
+ * explicitly bound to it run there, so it mostly sits in idle, and
+ * giving it back is a domain rebuild instead of a cpu_up().
+ */
+int sched_set_cpu_soft_isolated(int cpu, bool isolated)
+{
+	static DEFINE_MUTEX(soft_isolate_mutex);
+	int ret = 0;
+
+	mutex_lock(&soft_isolate_mutex);
+	get_online_cpus();
+
+	/* an inactive cpu can only be given back, for when it returns */
+	if (isolated && !cpu_active(cpu)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	if (!!cpu_soft_isolated(cpu) == isolated)
+		goto out;
+
+	if (isolated) {
+		/* keep one cpu to schedule on */
+		cpumask_set_cpu(cpu, cpu_soft_isolated_mask);
+		if (cpumask_subset(cpu_active_mask, cpu_soft_isolated_mask)) {
+			cpumask_clear_cpu(cpu, cpu_soft_isolated_mask);
+			ret = -EBUSY;
+			goto out;
+		}
+	} else {
+		cpumask_clear_cpu(cpu, cpu_soft_isolated_mask);
+	}
+
+	rebuild_sched_domains();
+
+	if (isolated)
+		sched_evacuate_cpu(cpu);
+out:
+	put_online_cpus();
+	mutex_unlock(&soft_isolate_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sched_set_cpu_soft_isolated);
+
 #if defined(CONFIG_SCHED_MC) || defined(CONFIG_SCHED_SMT)
 static void reinit_sched_domains(void)
 {
@@ -18,12 +18,118 @@
 #include <linux/hrtimer.h>
 #include <linux/sched.h>
 #include <linux/math64.h>
+#include <linux/seqlock.h>
+#include <linux/spinlock.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/init.h>
+#include <linux/notifier.h>
 
-static DEFINE_PER_CPU(u64, nr_prod_sum);
-static DEFINE_PER_CPU(u64, last_time);
-static DEFINE_PER_CPU(u64, nr);
-static DEFINE_PER_CPU(spinlock_t, nr_lock) = __SPIN_LOCK_UNLOCKED(nr_lock);
-static s64 last_get_time;
+/*
+ * Per-CPU integral of nr_running over time (nr_running * ns). It only
+ * ever grows, so any number of consumers can average it over their own
+ * windows by sampling it, see sched_nr_avg_update(). Updates for a CPU
+ * are serialized by its runqueue lock, readers use the seqcount.
+ */
+struct nr_stats {
+	seqcount_t seq;
+	u64 prod_sum;
+	u64 last_time;
+	unsigned long nr;
+};
+
+static DEFINE_PER_CPU(struct nr_stats, nr_stats);
+
+/*
+ * Integral of nr_running on @cpu up to @now; @nr gets its nr_running.
+ */
+static u64 nr_prod_sum_cpu(int cpu, u64 now, unsigned long *nr)
+{
+	struct nr_stats *st = &per_cpu(nr_stats, cpu);
+	u64 sum, last;
+	unsigned seq;
+
+	do {
+		seq = read_seqcount_begin(&st->seq);
+		sum = st->prod_sum;
+		last = st->last_time;
+		*nr = st->nr;
+	} while (read_seqcount_retry(&st->seq, seq));
+
+	if (now > last)
+		sum += *nr * (now - last);
+
+	return sum;
+}
+
+/*
+ * Integral of nr_running over all CPUs up to @now.
+ */
+static u64 sched_nr_prod_sum(u64 now)
+{
+	unsigned long nr;
+	u64 total = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		total += nr_prod_sum_cpu(cpu, now, &nr);
+
+	return total;
+}
+
+/**
+ * sched_nr_avg_init
+ * @w: Averaging window of the caller.
+ *
+ * Start a new averaging window at the current time.
+ */
+void sched_nr_avg_init(struct sched_nr_avg *w)
+{
+	memset(w, 0, sizeof(*w));
+	w->last_time = sched_clock();
+	w->last_sum = sched_nr_prod_sum(w->last_time);
+}
+EXPORT_SYMBOL(sched_nr_avg_init);
+
+/**
+ * sched_nr_avg_update
+ * @w: Averaging window of the caller.
+ * @return: Average nr_running since the last update of @w, * 100.
+ *
+ * Close the current window of @w and start a new one. The result is
+ * also stored in w->avg and folded into the short and long term moving
+ * averages w->avg_short (weight 1/2) and w->avg_long (weight 1/8).
+ *
+ * Each consumer owns its window; a window must not be updated
+ * concurrently with itself, different windows can.
+ */
+unsigned int sched_nr_avg_update(struct sched_nr_avg *w)
+{
+	u64 curr_time = sched_clock();
+	u64 sum = sched_nr_prod_sum(curr_time);
+	u64 diff = curr_time - w->last_time;
+
+	if (!diff || curr_time < w->last_time)
+		return w->avg;
+
+	w->avg = (unsigned int)div64_u64((sum - w->last_sum) * 100, diff);
+	w->last_time = curr_time;
+	w->last_sum = sum;
+
+	if (!w->samples++) {
+		w->avg_short = w->avg;
+		w->avg_long = w->avg;
+	} else {
+		w->avg_short = (w->avg_short + w->avg) >> 1;
+		w->avg_long = ((w->avg_long << 3) - w->avg_long + w->avg) >> 3;
+	}
+
+	return w->avg;
+}
+EXPORT_SYMBOL(sched_nr_avg_update);
+
+static struct sched_nr_avg legacy_window;
+static DEFINE_SPINLOCK(legacy_lock);
 
 /**
  * sched_get_nr_running_avg
@@ -31,38 +137,86 @@ static s64 last_get_time;
  *	    Returns the avg * 100 to return up to two decimal points
  *	    of accuracy.
  *
- * Obtains the average nr_running value since the last poll.
- * This function may not be called concurrently with itself
+ * Obtains the average nr_running value since the last poll. All callers
+ * share one window, new users should keep their own with
+ * sched_nr_avg_update().
  */
 void sched_get_nr_running_avg(int *avg)
 {
-	int cpu;
-	u64 curr_time = sched_clock();
-	u64 diff = curr_time - last_get_time;
-	u64 tmp_avg = 0;
+	unsigned long flags;
+
+	spin_lock_irqsave(&legacy_lock, flags);
+	*avg = sched_nr_avg_update(&legacy_window);
+	spin_unlock_irqrestore(&legacy_lock, flags);
+}
+EXPORT_SYMBOL(sched_get_nr_running_avg);
 
-	*avg = 0;
+/*
+ * Consumers that want to react to load rather than poll for it are
+ * notified when a CPU starts queueing, i.e. its nr_running rises to
+ * SCHED_NR_NOTIFY_THRESH. sched_update_nr_prod() runs under a runqueue
+ * lock, where neither the notifier chain nor anything waking a worker
+ * may run, and irq_work cannot be relied on to interrupt an idle ARM
+ * CPU. So it only marks the CPU, and the chain is called from the next
+ * scheduler tick on it, outside the runqueue lock. A CPU with runnable
+ * tasks queued keeps its tick, so that is at most a jiffy later.
+ */
+#define SCHED_NR_NOTIFY_THRESH	2
+
+static ATOMIC_NOTIFIER_HEAD(sched_nr_notifier_list);
+static atomic_t sched_nr_notifiers = ATOMIC_INIT(0);
+static DEFINE_PER_CPU(int, nr_notify_pending);
+
+static inline void sched_nr_notify_check(int cpu, unsigned long nr)
+{
+	if (nr == SCHED_NR_NOTIFY_THRESH && atomic_read(&sched_nr_notifiers))
+		per_cpu(nr_notify_pending, cpu) = 1;
+}
 
-	if (!diff)
+/**
+ * sched_nr_notify_tick
+ * @cpu: The cpu the scheduler tick runs on.
+ *
+ * Calls the notifier chain if @cpu started queueing since its last tick.
+ * Called from scheduler_tick() without the runqueue lock held.
+ */
+void sched_nr_notify_tick(int cpu)
+{
+	if (!per_cpu(nr_notify_pending, cpu))
 		return;
 
-	last_get_time = curr_time;
-	/* read and reset nr_running counts */
-	for_each_possible_cpu(cpu) {
-		unsigned long flags;
-
-		spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
-		tmp_avg += per_cpu(nr_prod_sum, cpu);
-		tmp_avg += per_cpu(nr, cpu) *
-			(curr_time - per_cpu(last_time, cpu));
-		per_cpu(last_time, cpu) = curr_time;
-		per_cpu(nr_prod_sum, cpu) = 0;
-		spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
-	}
+	per_cpu(nr_notify_pending, cpu) = 0;
+	atomic_notifier_call_chain(&sched_nr_notifier_list, 0, NULL);
+}
+
+/**
+ * sched_nr_register_notifier
+ * @nb: Notifier to call, from the scheduler tick in hard irq context,
+ *	when a CPU starts queueing runnable tasks.
+ */
+int sched_nr_register_notifier(struct notifier_block *nb)
+{
+	int ret;
+
+	ret = atomic_notifier_chain_register(&sched_nr_notifier_list, nb);
+	if (!ret)
+		atomic_inc(&sched_nr_notifiers);
 
-	*avg = (int)div64_u64(tmp_avg * 100, diff);
+	return ret;
 }
-EXPORT_SYMBOL(sched_get_nr_running_avg);
+EXPORT_SYMBOL(sched_nr_register_notifier);
+
+int sched_nr_unregister_notifier(struct notifier_block *nb)
+{
+	int ret;
+
+	ret = atomic_notifier_chain_unregister(&sched_nr_notifier_list, nb);
+	if (!ret)
+		atomic_dec(&sched_nr_notifiers);
+
+	return ret;
+}
+EXPORT_SYMBOL(sched_nr_unregister_notifier);
 
 /**
  * sched_update_nr_prod
@@ -71,21 +225,66 @@ EXPORT_SYMBOL(sched_get_nr_running_avg);
  * @inc: Whether we are increasing or decreasing the count
  * @return: N/A
  *
- * Update average with latest nr_running value for CPU
+ * Update average with latest nr_running value for CPU. Must be called
+ * with the runqueue lock of @cpu held.
  */
 void sched_update_nr_prod(int cpu, unsigned long nr_running, bool inc)
 {
-	int diff;
-	s64 curr_time;
-	unsigned long flags;
+	struct nr_stats *st = &per_cpu(nr_stats, cpu);
+	u64 curr_time = sched_clock();
+
+	write_seqcount_begin(&st->seq);
+	if (curr_time > st->last_time)
+		st->prod_sum += nr_running * (curr_time - st->last_time);
+	st->last_time = curr_time;
+	st->nr = nr_running + (inc ? 1 : -1);
+	write_seqcount_end(&st->seq);
+
+	if (inc)
+		sched_nr_notify_check(cpu, st->nr);
+}
+EXPORT_SYMBOL(sched_update_nr_prod);
+
+#ifdef CONFIG_PROC_FS
+/*
+ * /proc/sched_nr_avg: the current time and, per CPU, nr_running and its
+ * integral over time (both in ns). Averages over any window are the
+ * difference of two samples of the integral divided by the time between
+ * them.
+ */
+static int sched_nr_avg_show(struct seq_file *m, void *v)
+{
+	u64 curr_time = sched_clock();
+	int cpu;
+
+	seq_printf(m, "time %llu\n", (unsigned long long)curr_time);
+	for_each_possible_cpu(cpu) {
+		unsigned long nr;
+		u64 sum = nr_prod_sum_cpu(cpu, curr_time, &nr);
 
-	spin_lock_irqsave(&per_cpu(nr_lock, cpu), flags);
-	curr_time = sched_clock();
-	diff = curr_time - per_cpu(last_time, cpu);
-	per_cpu(last_time, cpu) = curr_time;
-	per_cpu(nr, cpu) = nr_running + (inc ? 1 : -1);
+		seq_printf(m, "cpu%d %lu %llu\n", cpu, nr,
+			   (unsigned long long)sum);
+	}
+
+	return 0;
+}
 
-	per_cpu(nr_prod_sum, cpu) += nr_running * diff;
-	spin_unlock_irqrestore(&per_cpu(nr_lock, cpu), flags);
+static int sched_nr_avg_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_nr_avg_show, NULL);
+}
+
+static const struct file_operations sched_nr_avg_fops = {
+	.open		= sched_nr_avg_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init sched_nr_avg_proc_init(void)
+{
+	proc_create("sched_nr_avg", 0444, NULL, &sched_nr_avg_fops);
+	return 0;
 }
-EXPORT_SYMBOL(sched_update_nr_prod);
\ No newline at end of file
+__initcall(sched_nr_avg_proc_init);
+#endif
@@ -1299,6 +1299,251 @@ static inline void hrtick_update(struct rq *rq)
 }
 #endif
 
+/**************************************************
+ * Per-entity load tracking:
+ *
+ * Every CFS task, and the cfs side of every runqueue, keeps a geometric
+ * series of the time it was runnable (and running), in 1024us periods.
+ * A period that is n periods old contributes y^n of its value, with y
+ * chosen such that y^32 == 1/2, so a contribution halves every ~32ms.
+ *
+ * Unlike the timer-sampled idle time used by the cpufreq governors, the
+ * sums are updated at enqueue, dequeue and tick, so a task migrating to
+ * or waking up on a cpu carries its history along and a governor can
+ * react to it immediately.  A task's sums are also updated when it is
+ * switched in and out, so that only the time it was current counts as
+ * running.
+ */
+
+#define LOAD_AVG_PERIOD	32
+#define LOAD_AVG_MAX	47742	/* maximum possible load avg */
+#define LOAD_AVG_MAX_N	345	/* number of full periods to produce LOAD_MAX_AVG */
+
+/* Precomputed fixed inverse multiplies for multiplication by y^n */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2da, 0xf5257d14, 0xefe4b99a, 0xeac0c6e6, 0xe5b906e6,
+	0xe0ccdeeb, 0xdbfbb796, 0xd744fcc9, 0xd2a81d91, 0xce248c14, 0xc9b9bd85,
+	0xc5672a10, 0xc12c4cc9, 0xbd08a39e, 0xb8fbaf46, 0xb504f333, 0xb123f581,
+	0xad583ee9, 0xa9a15ab4, 0xa5fed6a9, 0xa2704302, 0x9ef5325f, 0x9b8d39b9,
+	0x9837f050, 0x94f4efa8, 0x91c3d373, 0x8ea4398a, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/*
+ * Precomputed \Sum y^k { 1<=k<=n }.  These are floor(true_value) to prevent
+ * over-estimates when re-combining.
+ */
+static const u32 runnable_avg_yN_sum[] = {
+	    0, 1002, 1982, 2941, 3880, 4798, 5697, 6576, 7437, 8279, 9103,
+	 9909,10698,11470,12226,12966,13690,14398,15091,15769,16433,17082,
+	17718,18340,18949,19545,20128,20698,21256,21802,22336,22859,23371,
+};
+
+/*
+ * Approximate:
+ *   val * y^n,    where y^32 ~= 0.5 (~1 scheduling period)
+ */
+static __always_inline u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	/* after bounds checking we can collapse to 32-bit */
+	local_n = n;
+
+	/*
+	 * As y^PERIOD = 1/2, we can combine
+	 *    y^n = 1/2^(n/PERIOD) * k^(n%PERIOD)
+	 * With a look-up table which covers k^n (n<PERIOD)
+	 */
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	val *= runnable_avg_yN_inv[local_n];
+	/* We don't use SRR here since we always want to round down. */
+	return val >> 32;
+}
+
+/*
+ * For updates fully spanning n periods, the contribution to runnable
+ * average will be: \Sum 1024*y^n
+ *
+ * We can compute this reasonably efficiently by combining:
+ *   y^PERIOD = 1/2 with precomputed \Sum 1024*y^n {for  n <PERIOD}
+ */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	/* Compute \Sum k^n combining precomputed values for k^i, \Sum k^j */
+	do {
+		contrib /= 2; /* y^LOAD_AVG_PERIOD = 1/2 */
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+/*
+ * Accumulate the time since the last update into @sa, as runnable
+ * and/or running according to the state the entity was in over that
+ * interval.  Returns non-zero when a period boundary was crossed and
+ * the sums were decayed.
+ */
+static __always_inline int __update_entity_runnable_avg(u64 now,
+							struct sched_avg *sa,
+							int runnable,
+							int running)
+{
+	u64 delta, periods;
+	u32 contrib;
+	int delta_w, decayed = 0;
+
+	delta = now - sa->last_runnable_update;
+	/*
+	 * This should only happen when time goes backwards, which it
+	 * unfortunately does across cpus when a task migrates.
+	 */
+	if ((s64)delta < 0) {
+		sa->last_runnable_update = now;
+		return 0;
+	}
+
+	/*
+	 * Use 1024ns as the unit of measurement since it's a reasonable
+	 * approximation of 1us and fast to compute.
+	 */
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_runnable_update = now;
+
+	/* delta_w is the amount already accumulated against our next period */
+	delta_w = sa->runnable_avg_period % 1024;
+	if (delta + delta_w >= 1024) {
+		/* period roll-over */
+		decayed = 1;
+
+		/*
+		 * Now that we know we're crossing a period boundary, figure
+		 * out how much from delta we need to complete the current
+		 * period and accrue it.
+		 */
+		delta_w = 1024 - delta_w;
+		if (runnable)
+			sa->runnable_avg_sum += delta_w;
+		if (running)
+			sa->running_avg_sum += delta_w;
+		sa->runnable_avg_period += delta_w;
+
+		delta -= delta_w;
+
+		/* Figure out how many additional periods this update spans */
+		periods = delta / 1024;
+		delta %= 1024;
+
+		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
+						  periods + 1);
+		sa->running_avg_sum = decay_load(sa->running_avg_sum,
+						 periods + 1);
+		sa->runnable_avg_period = decay_load(sa->runnable_avg_period,
+						     periods + 1);
+
+		/* Efficiently calculate \sum (1..n_period) 1024*y^i */
+		contrib = __compute_runnable_contrib(periods);
+		if (runnable)
+			sa->runnable_avg_sum += contrib;
+		if (running)
+			sa->running_avg_sum += contrib;
+		sa->runnable_avg_period += contrib;
+	}
+
+	/* Remainder of delta accrued against u_0` */
+	if (runnable)
+		sa->runnable_avg_sum += delta;
+	if (running)
+		sa->running_avg_sum += delta;
+	sa->runnable_avg_period += delta;
+
+	return decayed;
+}
+
+static inline unsigned long __sched_avg_util(struct sched_avg *sa)
+{
+	return div_u64((u64)sa->running_avg_sum << SCHED_POWER_SHIFT,
+		       sa->runnable_avg_period + 1);
+}
+
+/*
+ * Refresh the contribution of a task entity and fold the change into
+ * the per-runqueue sums.  Only task entities are tracked: the rq sums
+ * are flat across the group hierarchy.
+ */
+static void update_entity_load_avg(struct rq *rq, struct sched_entity *se,
+				   int runnable, int running, int queued)
+{
+	struct sched_avg *sa = &se->avg;
+	unsigned long load_contrib, util_contrib;
+
+	__update_entity_runnable_avg(rq->clock_task, sa, runnable, running);
+
+	load_contrib = div_u64((u64)sa->runnable_avg_sum *
+			       scale_load_down(se->load.weight),
+			       sa->runnable_avg_period + 1);
+	util_contrib = __sched_avg_util(sa);
+
+	if (queued) {
+		rq->cfs_load_avg += load_contrib - sa->load_avg_contrib;
+		rq->cfs_util_avg += util_contrib - sa->util_avg_contrib;
+	}
+	sa->load_avg_contrib = load_contrib;
+	sa->util_avg_contrib = util_contrib;
+}
+
+static inline void update_rq_runnable_avg(struct rq *rq, int runnable)
+{
+	__update_entity_runnable_avg(rq->clock_task, &rq->avg,
+				     runnable, runnable);
+}
+
+/*
+ * Utilization of @rq in SCHED_POWER_SCALE units: the larger of the
+ * decayed busy time of the cpu and the sum of what its queued tasks
+ * used wherever they ran before, so a task waking up or migrating
+ * here is accounted for right away.
+ */
+static unsigned long rq_cpu_util(struct rq *rq)
+{
+	unsigned long util = max(__sched_avg_util(&rq->avg),
+				 rq->cfs_util_avg);
+
+	return min_t(unsigned long, util, SCHED_POWER_SCALE);
+}
+
+static inline void update_sched_freq(struct rq *rq)
+{
+	cpufreq_sched_update_util(cpu_of(rq), rq_cpu_util(rq));
+}
+
+unsigned long sched_cpu_util(int cpu)
+{
+	return rq_cpu_util(cpu_rq(cpu));
+}
+
 /*
  * The enqueue_task method is called before nr_running is
  * increased. Here we update the fair scheduling stats and
@@ -1310,6 +1555,15 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &p->se;
 
+	/*
+	 * A waking task was blocked since its last update, anything else
+	 * (migration, class or priority change) was runnable.
+	 */
+	update_rq_runnable_avg(rq, rq->cfs.nr_running);
+	update_entity_load_avg(rq, se, !(flags & ENQUEUE_WAKEUP), 0, 0);
+	rq->cfs_load_avg += se->avg.load_avg_contrib;
+	rq->cfs_util_avg += se->avg.util_avg_contrib;
+
 	for_each_sched_entity(se) {
 		if (se->on_rq)
 			break;
@@ -1325,6 +1579,7 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_sched_freq(rq);
 	hrtick_update(rq);
 }
 
@@ -1341,6 +1596,11 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 	struct sched_entity *se = &p->se;
 	int task_sleep = flags & DEQUEUE_SLEEP;
 
+	update_rq_runnable_avg(rq, 1);
+	update_entity_load_avg(rq, se, 1, se == cfs_rq_of(se)->curr, 1);
+	rq->cfs_load_avg -= se->avg.load_avg_contrib;
+	rq->cfs_util_avg -= se->avg.util_avg_contrib;
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		dequeue_entity(cfs_rq, se, flags);
@@ -1368,6 +1628,7 @@ static void dequeue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 		update_cfs_shares(cfs_rq);
 	}
 
+	update_sched_freq(rq);
 	hrtick_update(rq);
 }
 
@@ -2001,6 +2262,9 @@ static struct task_struct *pick_next_task_fair(struct rq *rq)
 		cfs_rq = group_cfs_rq(se);
 	} while (cfs_rq);
 
+	/* it was waiting since its last update */
+	update_entity_load_avg(rq, se, 1, 0, 1);
+
 	p = task_of(se);
 	hrtick_start_fair(rq, p);
 
@@ -2015,6 +2279,10 @@ static void put_prev_task_fair(struct rq *rq, struct task_struct *prev)
 	struct sched_entity *se = &prev->se;
 	struct cfs_rq *cfs_rq;
 
+	/* a sleeping task was accounted up to now by its dequeue */
+	if (se->on_rq)
+		update_entity_load_avg(rq, se, 1, 1, 1);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		put_prev_entity(cfs_rq, se);
@@ -4195,10 +4463,15 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 	struct cfs_rq *cfs_rq;
 	struct sched_entity *se = &curr->se;
 
+	update_rq_runnable_avg(rq, 1);
+	update_entity_load_avg(rq, se, 1, 1, 1);
+
 	for_each_sched_entity(se) {
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	update_sched_freq(rq);
 }
 
 /*
@@ -4318,6 +4591,9 @@ static void set_curr_task_fair(struct rq *rq)
 {
 	struct sched_entity *se = &rq->curr->se;
 
+	if (se->on_rq)
+		update_entity_load_avg(rq, se, 1, 0, 1);
+
 	for_each_sched_entity(se)
 		set_next_entity(cfs_rq_of(se), se);
 }
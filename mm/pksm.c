@@ -60,112 +60,49 @@
 
 #define CONFIG_PKSM_RHASH
 
-#ifdef CONFIG_X86
-#undef memcmp
-
-#ifdef CONFIG_X86_32
-#define memcmp memcmpx86_32
 /*
- * Compare 4-byte-aligned address s1 and s2, with length n
+ * Page compares only need to tell equal from different pages: xor eight
+ * words at a time and or the differences together, so there is one
+ * branch per 32/64 bytes and the loads of both pages can be pipelined.
+ * Kernel mode NEON is not available here and SSE would need
+ * kernel_fpu_begin() per page, so plain word compares it is.
  */
-int memcmpx86_32(void *s1, void *s2, size_t n)
-{
-	size_t num = n / 4;
-	register int res;
-
-	__asm__ __volatile__
-	(
-	 "testl %3,%3\n\t"
-	 "repe; cmpsd\n\t"
-	 "je        1f\n\t"
-	 "sbbl      %0,%0\n\t"
-	 "orl       $1,%0\n"
-	 "1:"
-	 : "=&a" (res), "+&S" (s1), "+&D" (s2), "+&c" (num)
-	 : "0" (0)
-	 : "cc");
+#define PKSM_CMP_WORDS	8
 
-	return res;
-}
-
-/*
- * Check the page is all zero ?
- */
-static int is_full_zero(const void *s1, size_t len)
+static int pksm_pages_equal(const void *s1, const void *s2)
 {
-	unsigned char same;
-
-	len /= 4;
+	const unsigned long *a = s1, *b = s2;
+	int i;
 
-	__asm__ __volatile__
-	("repe; scasl;"
-	 "sete %0"
-	 : "=qm" (same), "+D" (s1), "+c" (len)
-	 : "a" (0)
-	 : "cc");
+	for (i = 0; i < PAGE_SIZE / sizeof(long); i += PKSM_CMP_WORDS) {
+		if ((a[i] ^ b[i]) | (a[i + 1] ^ b[i + 1]) |
+		    (a[i + 2] ^ b[i + 2]) | (a[i + 3] ^ b[i + 3]) |
+		    (a[i + 4] ^ b[i + 4]) | (a[i + 5] ^ b[i + 5]) |
+		    (a[i + 6] ^ b[i + 6]) | (a[i + 7] ^ b[i + 7]))
+			return 0;
+	}
 
-	return same;
+	return 1;
 }
 
-
-#elif defined(CONFIG_X86_64)
-#define memcmp memcmpx86_64
 /*
- * Compare 8-byte-aligned address s1 and s2, with length n
+ * Check the page is all zero ?
  */
-int memcmpx86_64(void *s1, void *s2, size_t n)
-{
-	size_t num = n / 8;
-	register int res;
-
-	__asm__ __volatile__
-	(
-	 "testq %q3,%q3\n\t"
-	 "repe; cmpsq\n\t"
-	 "je        1f\n\t"
-	 "sbbq      %q0,%q0\n\t"
-	 "orq       $1,%q0\n"
-	 "1:"
-	 : "=&a" (res), "+&S" (s1), "+&D" (s2), "+&c" (num)
-	 : "0" (0)
-	 : "cc");
-
-	return res;
-}
-
 static int is_full_zero(const void *s1, size_t len)
 {
-	unsigned char same;
-
-	len /= 8;
-
-	__asm__ __volatile__
-	("repe; scasq;"
-	 "sete %0"
-	 : "=qm" (same), "+D" (s1), "+c" (len)
-	 : "a" (0)
-	 : "cc");
-
-	return same;
-}
-
-#endif
-#else
-static int is_full_zero(const void *s1, size_t len)
-{
-	unsigned long *src = s1;
+	const unsigned long *src = s1;
 	int i;
 
 	len /= sizeof(*src);
 
-	for (i = 0; i < len; i++) {
-		if (src[i])
+	for (i = 0; i < len; i += PKSM_CMP_WORDS) {
+		if (src[i] | src[i + 1] | src[i + 2] | src[i + 3] |
+		    src[i + 4] | src[i + 5] | src[i + 6] | src[i + 7])
 			return 0;
 	}
 
 	return 1;
 }
-#endif
 
 struct stable_node_anon {
 	struct hlist_node hlist;
@@ -178,7 +115,8 @@ struct stable_node_anon {
  * @anon_vma: pointer to anon_vma for this mm,address, when in stable tree
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
- * @oldchecksum: previous checksum of the page at that virtual address
+ * @checksum: sampled checksum of the page at that virtual address
+ * @full_checksum: checksum of the whole page, valid with FULLHASH_FLAG
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -195,6 +133,7 @@ struct rmap_item {
 	};
 	atomic_t _mapcount;
 	unsigned long checksum;
+	u32 full_checksum;
 	struct list_head update_list; /*list for unstable page checksum update*/
 };
 
@@ -239,6 +178,7 @@ struct ksm_scan {
 #define CHECKSUM_LIST_FLAG (1<<5)  /*rmap_item in checksum list*/
 #define INITCHECKSUM_FLAG (1<<6)
 #define RESCAN_LIST_FLAG (1<<7)  /*rmap_item in pksm_rescan_page_list*/
+#define FULLHASH_FLAG (1<<8)	/* full_checksum is valid */
 
 
 #define PKSM_FAULT_SUCCESS 	0  
@@ -280,13 +220,29 @@ static unsigned long ksm_rmap_items;
 
 static unsigned long ksm_stable_nodes;
 
+/* Stable tree lookups rejected by the checksum filter */
+static unsigned long pksm_filter_rejects;
+
+/* Full page checksums computed on sampled checksum hits */
+static unsigned long pksm_full_hashes;
+
+/* Sampled checksum hits told apart by the full checksum */
+static unsigned long pksm_hash_collisions;
+
+/* Full page compares before merging, and how many of them differed */
+static unsigned long pksm_page_compares;
+static unsigned long pksm_compare_mismatches;
+
 unsigned long ksm_pages_zero_sharing;
 
+#define KSM_DEFAULT_PAGES_TO_SCAN	100
+#define KSM_DEFAULT_SLEEP_MILLISECS	50
+
 /* Number of pages ksmd should scan in one batch */
-static unsigned int ksm_thread_pages_to_scan = 100;
+static unsigned int ksm_thread_pages_to_scan = KSM_DEFAULT_PAGES_TO_SCAN;
 
 /* Milliseconds ksmd should sleep between batches */
-static unsigned int ksm_thread_sleep_millisecs = 50;
+static unsigned int ksm_thread_sleep_millisecs = KSM_DEFAULT_SLEEP_MILLISECS;
 
 /*Seconds pksm should update all unshared_pages by one period*/
 static unsigned int pksm_unshared_page_update_period = 10;
@@ -294,6 +250,45 @@ static unsigned int pksm_unshared_page_update_period = 10;
 /* Boolean to indicate whether to use deferred timer or not */
 static bool use_deferred_timer;
 
+/*
+ * Adaptive scan rate: after every batch pksmd looks at the merge yield
+ * of its recent batches (merged pages per 1000 scanned, smoothed) and
+ * at the free memory. It scans faster while merging pays off, or while
+ * free memory is close to the watermarks and the yield is not poor, and
+ * backs off towards a few pages every max_sleep_millisecs while the
+ * yield is poor. pages_to_scan and sleep_millisecs are the starting
+ * point and the fastest sleep; the batch grows up to
+ * PKSM_ADAPT_MAX_SCALE times pages_to_scan and shrinks down to
+ * 1/PKSM_ADAPT_MIN_DIV of it.
+ */
+#define PKSM_ADAPT_MAX_SCALE	4
+#define PKSM_ADAPT_MIN_DIV	16
+#define PKSM_YIELD_GOOD		20	/* per 1000 scanned pages */
+#define PKSM_YIELD_POOR		2
+#define PKSM_PRESSURE_WMARK_SCALE	2	/* free < 2 * high watermarks */
+
+static bool pksm_adaptive = true;
+static unsigned int pksm_max_sleep_millisecs = 10000;
+
+/**
+ * struct pksm_adapt - state of the scan rate controller
+ * @pages_to_scan: pages to scan in the next batch
+ * @sleep_millisecs: sleep before the next batch
+ * @yield: smoothed merge yield, merged pages per 1000 scanned
+ * @pressure: free memory was close to the zone watermarks
+ */
+struct pksm_adapt {
+	unsigned int pages_to_scan;
+	unsigned int sleep_millisecs;
+	unsigned int yield;
+	bool pressure;
+};
+
+static struct pksm_adapt pksm_adapt = {
+	.pages_to_scan = KSM_DEFAULT_PAGES_TO_SCAN,
+	.sleep_millisecs = KSM_DEFAULT_SLEEP_MILLISECS,
+};
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -306,6 +301,37 @@ static unsigned int ksm_run = KSM_RUN_STOP;
 static u32 *pksm_random_table;
 static u32 pksm_zero_random_checksum;
 
+/*
+ * Counting filter over the sampled checksums of the stable tree nodes:
+ * a page whose counter is zero has no identical page in the stable tree,
+ * so its lookup can be skipped without descending the tree. Counters
+ * that saturate stay saturated.
+ */
+#define PKSM_FILTER_SHIFT	12
+static u16 pksm_stable_filter[1 << PKSM_FILTER_SHIFT];
+
+static inline u16 *pksm_filter_slot(struct rmap_item *rmap_item)
+{
+	return &pksm_stable_filter[hash_32(rmap_item->checksum,
+					   PKSM_FILTER_SHIFT)];
+}
+
+static inline void pksm_filter_add(struct rmap_item *rmap_item)
+{
+	u16 *slot = pksm_filter_slot(rmap_item);
+
+	if (*slot != USHRT_MAX)
+		(*slot)++;
+}
+
+static inline void pksm_filter_del(struct rmap_item *rmap_item)
+{
+	u16 *slot = pksm_filter_slot(rmap_item);
+
+	if (*slot != USHRT_MAX)
+		(*slot)--;
+}
+
 /*   32/3 < they < 32/2 */
 #define shiftl	8
 #define shiftr	12
@@ -756,6 +782,7 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item, int free_ano
 			rmap_item->address &=~ STABLE_FLAG;
 			rb_erase(&rmap_item->node, &root_stable_tree);
 			RB_CLEAR_NODE(&rmap_item->node);
+			pksm_filter_del(rmap_item);
 			ksm_pages_shared--;
 		}
 	} else if (rmap_item->address & UNSTABLE_FLAG) {
@@ -931,13 +958,34 @@ static u32 calc_checksum(struct page *page)
 {
 	u32 checksum;
 	void *addr = kmap_atomic(page);
-	//checksum = jhash2(addr, PAGE_SIZE / 4, 17);
 	checksum = pksm_calc_checksum(addr, RSAD_STRENGTH_FULL >> 4);
 	kunmap_atomic(addr);
 	return checksum;
 }
 
+/*
+ * The sampled checksum only covers 1/16th of the page. When it matches
+ * a tree node, both sides are upgraded to a checksum of the whole page
+ * before the pages are considered candidates for merging. The full
+ * checksum is computed once and kept until the page is scanned again.
+ */
+static u32 full_checksum(struct rmap_item *rmap_item, struct page *page)
+{
+	void *addr;
+
+	if (rmap_item->address & FULLHASH_FLAG)
+		return rmap_item->full_checksum;
+
+	addr = kmap_atomic(page);
+	rmap_item->full_checksum = jhash2(addr, PAGE_SIZE / 4, 17);
+	kunmap_atomic(addr);
+	rmap_item->address |= FULLHASH_FLAG;
+	pksm_full_hashes++;
+
+	return rmap_item->full_checksum;
+}
 
+#ifndef CONFIG_PKSM_RHASH
 static int memcmp_pages(struct page *page1, struct page *page2)
 {
 	char *addr1, *addr2;
@@ -950,10 +998,23 @@ static int memcmp_pages(struct page *page1, struct page *page2)
 	kunmap_atomic(addr1);
 	return ret;
 }
+#endif
 
 static inline int pages_identical(struct page *page1, struct page *page2)
 {
-	return !memcmp_pages(page1, page2);
+	char *addr1, *addr2;
+	int ret;
+
+	addr1 = kmap_atomic(page1);
+	addr2 = kmap_atomic(page2);
+	ret = pksm_pages_equal(addr1, addr2);
+	kunmap_atomic(addr2);
+	kunmap_atomic(addr1);
+
+	pksm_page_compares++;
+	if (!ret)
+		pksm_compare_mismatches++;
+	return ret;
 }
 
 static int write_protect_page(struct vm_area_struct *vma, struct page *page,
@@ -1190,7 +1251,8 @@ static int pksm_writepect_pte(struct page *page, struct vm_area_struct *vma,
 			err = 0;
 		}  else if (pages_identical(page, kpage)) {
 			err = replace_page(vma, page, kpage, orig_pte);	
-		} 
+		} else
+			err = PKSM_FAULT_DROP;
 	}
 
 	if ((vma->vm_flags & VM_LOCKED) && kpage && !err) {
@@ -1296,6 +1358,26 @@ static inline int hash_cmp(u32 new_val, u32 node_val)
 		return 0;
 }
 
+/*
+ * Order pages in the trees by sampled checksum, then by full checksum.
+ */
+static int rmap_item_cmp(struct rmap_item *rmap_item, struct page *page,
+			 struct rmap_item *tree_rmap_item,
+			 struct page *tree_page)
+{
+	int ret;
+
+	ret = hash_cmp(rmap_item->checksum, tree_rmap_item->checksum);
+	if (ret)
+		return ret;
+
+	ret = hash_cmp(full_checksum(rmap_item, page),
+		       full_checksum(tree_rmap_item, tree_page));
+	if (ret)
+		pksm_hash_collisions++;
+	return ret;
+}
+
 /*
  * stable_tree_search - search for page inside the stable tree
  *
@@ -1313,6 +1395,13 @@ static struct page *stable_tree_search(struct page *page)
 
 	if (PageKsm(page))
 		return NULL;
+
+#ifdef CONFIG_PKSM_RHASH
+	if (!*pksm_filter_slot(rmap_item)) {
+		pksm_filter_rejects++;
+		return NULL;
+	}
+#endif
 	
 retry:
 	new = &root_stable_tree.rb_node;
@@ -1341,7 +1430,7 @@ retry:
 		}
 
 #ifdef CONFIG_PKSM_RHASH
-		ret = hash_cmp(rmap_item->checksum, tree_rmap_item->checksum);
+		ret = rmap_item_cmp(rmap_item, page, tree_rmap_item, tree_page);
 #else
 		ret = memcmp_pages(page, tree_page);
 #endif
@@ -1373,6 +1462,9 @@ static int stable_tree_insert(struct rmap_item *rmap_item,
 	struct rb_node *parent = NULL;
 	struct rb_node **new;
 
+	/* kpage is write protected now, hash what it will be shared as */
+	rmap_item->address &= ~FULLHASH_FLAG;
+
 retry:
 	new = &root_stable_tree.rb_node;
 
@@ -1397,7 +1489,7 @@ retry:
 			return PKSM_FAULT_DROP;
 
 #ifdef CONFIG_PKSM_RHASH
-		ret = hash_cmp(rmap_item->checksum, tree_rmap_item->checksum);
+		ret = rmap_item_cmp(rmap_item, kpage, tree_rmap_item, tree_page);
 #else
 		ret = memcmp_pages(kpage, tree_page);
 #endif
@@ -1426,6 +1518,7 @@ retry:
 	rb_insert_color(&rmap_item->node, &root_stable_tree);
 	set_page_stable_ksm(kpage, rmap_item);
 	rmap_item->address |= STABLE_FLAG;
+	pksm_filter_add(rmap_item);
 
 	return 0;
 }
@@ -1491,7 +1584,7 @@ retry:
 		}
 
 #ifdef CONFIG_PKSM_RHASH
-		ret = hash_cmp(rmap_item->checksum, tree_rmap_item->checksum);
+		ret = rmap_item_cmp(rmap_item, page, tree_rmap_item, tree_page);
 #else
 		ret = memcmp_pages(page, tree_page);
 #endif
@@ -1675,6 +1768,8 @@ static int cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
 
 	remove_rmap_item_from_tree(rmap_item, 0);
 
+	/* out of the trees, the page may have changed since it was hashed */
+	rmap_item->address &= ~FULLHASH_FLAG;
 	if (init_checksum) 
 		rmap_item->checksum = calc_checksum(page);
 
@@ -1738,10 +1833,10 @@ static unsigned int pksm_calc_update_pages_num(void)
 {
 	unsigned int need_scan = 0;
 
-	if (ksm_pages_unshared < ksm_thread_pages_to_scan)
+	if (ksm_pages_unshared < pksm_adapt.pages_to_scan)
 		need_scan = ksm_pages_unshared;
 	else
-		need_scan = (ksm_pages_unshared * ksm_thread_sleep_millisecs) /
+		need_scan = (ksm_pages_unshared * pksm_adapt.sleep_millisecs) /
 		               (pksm_unshared_page_update_period *1000);
 
 	return need_scan;
@@ -1759,7 +1854,7 @@ static void pksm_update_unstable_page_checksum(void)
 	if (need_scan <= 0)
 		return ;
 
-	need_scan = min(need_scan, ksm_thread_pages_to_scan);
+	need_scan = min(need_scan, pksm_adapt.pages_to_scan);
 
 	list_for_each_entry_safe(rmap_item, n_item, &unstabletree_checksum_list, update_list) {
 		if (!rmap_item)
@@ -1824,14 +1919,17 @@ static void pksm_drop_rmap_item(struct rmap_item *rmap_item)
 /**
  * ksm_do_scan  - the ksm scanner main worker function.
  * @scan_npages - number of pages we want to scan before we return.
+ *
+ * Returns the number of pages compared against the trees.
  */
-static void ksm_do_scan(unsigned int scan_npages)
+static unsigned int ksm_do_scan(unsigned int scan_npages)
 {
 	struct rmap_item *rmap_item, *n_item;
 	struct page *page;
 	int init_checksum = 0;
 	LIST_HEAD(l_add);
 	int scan = 0;
+	unsigned int scanned = 0;
 
 	spin_lock_irq(&pksm_np_list_lock);
 	list_for_each_entry_safe(rmap_item, n_item, &new_anon_page_list, list) {
@@ -1893,6 +1991,7 @@ static void ksm_do_scan(unsigned int scan_npages)
 		if (check_page_dio(page))
 			goto rescan;
 
+		scanned++;
 		switch (cmp_and_merge_page(page, rmap_item, init_checksum)) {
 			case PKSM_FAULT_SUCCESS:
 			case PKSM_FAULT_KEEP:
@@ -1919,6 +2018,68 @@ out:
 	
 	pksm_free_all_rmap_items();
 	pksm_update_unstable_page_checksum();
+
+	return scanned;
+}
+
+/*
+ * Is free memory close to the watermarks? Summed over all zones, so a
+ * small zone that is always full does not count as pressure.
+ */
+static bool pksm_memory_pressure(void)
+{
+	unsigned long free = 0, high = 0;
+	struct zone *zone;
+
+	for_each_populated_zone(zone) {
+		free += zone_page_state(zone, NR_FREE_PAGES);
+		high += high_wmark_pages(zone);
+	}
+
+	return free < high * PKSM_PRESSURE_WMARK_SCALE;
+}
+
+/*
+ * pksm_adapt_rate - set the next batch size and sleep
+ * @scanned: pages compared in the last batch
+ * @merged: pages merged by the last batch
+ */
+static void pksm_adapt_rate(unsigned int scanned, unsigned long merged)
+{
+	unsigned int min_pages = max(ksm_thread_pages_to_scan /
+				     PKSM_ADAPT_MIN_DIV, 1U);
+	/* saturated, and never below min_pages even for pages_to_scan 0 */
+	unsigned int max_pages = clamp_t(u64, (u64)ksm_thread_pages_to_scan *
+					 PKSM_ADAPT_MAX_SCALE, min_pages,
+					 UINT_MAX);
+	unsigned int min_sleep = ksm_thread_sleep_millisecs;
+	unsigned int max_sleep = max(pksm_max_sleep_millisecs, min_sleep);
+	struct pksm_adapt *ad = &pksm_adapt;
+	unsigned int yield;
+
+	if (!pksm_adaptive) {
+		ad->pages_to_scan = ksm_thread_pages_to_scan;
+		ad->sleep_millisecs = ksm_thread_sleep_millisecs;
+		return;
+	}
+
+	/* an empty batch says nothing about the yield, let it decay */
+	yield = scanned ? min_t(unsigned long, merged * 1000 / scanned, 1000) : 0;
+	ad->yield = (ad->yield * 3 + yield) / 4;
+	ad->pressure = pksm_memory_pressure();
+
+	/* pressure does not help if there is nothing to merge */
+	if (ad->yield >= PKSM_YIELD_GOOD ||
+	    (ad->pressure && ad->yield >= PKSM_YIELD_POOR)) {
+		ad->pages_to_scan = min(ad->pages_to_scan, max_pages / 2) * 2;
+		ad->sleep_millisecs = ad->sleep_millisecs / 2;
+	} else if (ad->yield < PKSM_YIELD_POOR) {
+		ad->pages_to_scan = ad->pages_to_scan / 2;
+		ad->sleep_millisecs = min(ad->sleep_millisecs, max_sleep / 2) * 2;
+	}
+
+	ad->pages_to_scan = clamp(ad->pages_to_scan, min_pages, max_pages);
+	ad->sleep_millisecs = clamp(ad->sleep_millisecs, min_sleep, max_sleep);
 }
 
 static void process_timeout(unsigned long __data)
@@ -1967,8 +2128,17 @@ static int ksm_scan_thread(void *nothing)
 
 	while (!kthread_should_stop()) {
 		mutex_lock(&ksm_thread_mutex);
-		if (ksmd_should_run())
-			ksm_do_scan(ksm_thread_pages_to_scan);
+		if (ksmd_should_run()) {
+			unsigned long sharing = ksm_pages_sharing +
+						ksm_pages_zero_sharing;
+			unsigned int scanned;
+			long merged;
+
+			scanned = ksm_do_scan(pksm_adapt.pages_to_scan);
+			merged = ksm_pages_sharing + ksm_pages_zero_sharing -
+				 sharing;
+			pksm_adapt_rate(scanned, max(merged, 0L));
+		}
 		mutex_unlock(&ksm_thread_mutex);
 
 		try_to_freeze();
@@ -1976,10 +2146,10 @@ static int ksm_scan_thread(void *nothing)
 		if (ksmd_should_run()) {
             if(use_deferred_timer)
                 deferred_schedule_timeout(
-                    msecs_to_jiffies(ksm_thread_sleep_millisecs));
+                    msecs_to_jiffies(pksm_adapt.sleep_millisecs));
             else
 			    schedule_timeout_interruptible(
-                    msecs_to_jiffies(ksm_thread_sleep_millisecs));
+                    msecs_to_jiffies(pksm_adapt.sleep_millisecs));
 		} else {
 			wait_event_freezable(ksm_thread_wait,
 				ksmd_should_run() || kthread_should_stop());
@@ -2549,6 +2719,119 @@ static ssize_t rmap_items_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(rmap_items);
 
+static ssize_t filter_rejects_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", pksm_filter_rejects);
+}
+KSM_ATTR_RO(filter_rejects);
+
+static ssize_t full_hashes_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", pksm_full_hashes);
+}
+KSM_ATTR_RO(full_hashes);
+
+static ssize_t hash_collisions_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", pksm_hash_collisions);
+}
+KSM_ATTR_RO(hash_collisions);
+
+static ssize_t page_compares_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", pksm_page_compares);
+}
+KSM_ATTR_RO(page_compares);
+
+static ssize_t compare_mismatches_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", pksm_compare_mismatches);
+}
+KSM_ATTR_RO(compare_mismatches);
+
+static ssize_t adaptive_show(struct kobject *kobj,
+			     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pksm_adaptive);
+}
+
+static ssize_t adaptive_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err || enable > 1)
+		return -EINVAL;
+
+	mutex_lock(&ksm_thread_mutex);
+	pksm_adaptive = enable;
+	pksm_adapt.pages_to_scan = ksm_thread_pages_to_scan;
+	pksm_adapt.sleep_millisecs = ksm_thread_sleep_millisecs;
+	mutex_unlock(&ksm_thread_mutex);
+
+	return count;
+}
+KSM_ATTR(adaptive);
+
+static ssize_t max_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", pksm_max_sleep_millisecs);
+}
+
+static ssize_t max_sleep_millisecs_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	unsigned long msecs;
+	int err;
+
+	err = strict_strtoul(buf, 10, &msecs);
+	if (err || msecs > UINT_MAX)
+		return -EINVAL;
+
+	pksm_max_sleep_millisecs = msecs;
+
+	return count;
+}
+KSM_ATTR(max_sleep_millisecs);
+
+static ssize_t cur_pages_to_scan_show(struct kobject *kobj,
+				      struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", pksm_adapt.pages_to_scan);
+}
+KSM_ATTR_RO(cur_pages_to_scan);
+
+static ssize_t cur_sleep_millisecs_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", pksm_adapt.sleep_millisecs);
+}
+KSM_ATTR_RO(cur_sleep_millisecs);
+
+static ssize_t merge_yield_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", pksm_adapt.yield);
+}
+KSM_ATTR_RO(merge_yield);
+
+static ssize_t memory_pressure_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", pksm_adapt.pressure);
+}
+KSM_ATTR_RO(memory_pressure);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&period_seconds_attr.attr,
@@ -2562,6 +2845,17 @@ static struct attribute *ksm_attrs[] = {
 	&stable_nodes_attr.attr,
 	&rmap_items_attr.attr,
 	&deferred_timer_attr.attr,
+	&filter_rejects_attr.attr,
+	&full_hashes_attr.attr,
+	&hash_collisions_attr.attr,
+	&page_compares_attr.attr,
+	&compare_mismatches_attr.attr,
+	&adaptive_attr.attr,
+	&max_sleep_millisecs_attr.attr,
+	&cur_pages_to_scan_attr.attr,
+	&cur_sleep_millisecs_attr.attr,
+	&merge_yield_attr.attr,
+	&memory_pressure_attr.attr,
 	NULL,
 };
 
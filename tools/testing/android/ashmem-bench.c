@@ -0,0 +1,193 @@
+/*
+ * ashmem-bench - measure pin/unpin throughput of ashmem under reclaim
+ *
+ * Starts a number of threads that each own an ashmem area and unpin and
+ * pin it again in a loop, optionally alongside a thread that keeps
+ * running the ashmem shrinker through ASHMEM_PURGE_ALL_CACHES, and prints
+ * the number of unpin/pin pairs per second.  Areas are private to their
+ * thread, so with the shrinker running this shows how much reclaim holds
+ * up foreground callers.
+ *
+ * Usage: ashmem-bench [-t threads] [-p pages] [-d seconds] [-r]
+ *
+ *   -t	number of pin/unpin threads (default 4)
+ *   -p	size of each area in pages (default 16)
+ *   -d	duration in seconds (default 5)
+ *   -r	also run the shrinker in a loop (needs CAP_SYS_ADMIN)
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include <linux/types.h>
+#include "../../../include/linux/ashmem.h"
+
+#define ASHMEM_DEV	"/dev/ashmem"
+
+static size_t area_size;
+static volatile int stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long pairs;
+	unsigned long purged;
+	int error;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct ashmem_pin pin = { .offset = 0, .len = 0 };
+	char *map;
+	int fd, ret;
+
+	fd = open(ASHMEM_DEV, O_RDWR);
+	if (fd < 0 || ioctl(fd, ASHMEM_SET_SIZE, area_size) < 0) {
+		w->error = errno;
+		return NULL;
+	}
+
+	map = mmap(NULL, area_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		w->error = errno;
+		close(fd);
+		return NULL;
+	}
+	memset(map, 1, area_size);
+
+	while (!stop) {
+		if (ioctl(fd, ASHMEM_UNPIN, &pin) < 0) {
+			w->error = errno;
+			break;
+		}
+		ret = ioctl(fd, ASHMEM_PIN, &pin);
+		if (ret < 0) {
+			w->error = errno;
+			break;
+		}
+		if (ret == ASHMEM_WAS_PURGED) {
+			memset(map, 1, area_size);
+			w->purged++;
+		}
+		w->pairs++;
+	}
+
+	munmap(map, area_size);
+	close(fd);
+	return NULL;
+}
+
+static void *shrinker_fn(void *arg)
+{
+	unsigned long *runs = arg;
+	int fd;
+
+	fd = open(ASHMEM_DEV, O_RDWR);
+	if (fd < 0)
+		return NULL;
+
+	while (!stop) {
+		if (ioctl(fd, ASHMEM_PURGE_ALL_CACHES) < 0)
+			break;
+		(*runs)++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-p pages] [-d seconds] [-r]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	unsigned long pairs = 0, purged = 0, runs = 0;
+	pthread_t shrinker;
+	int nr_threads = 4, pages = 16, seconds = 5, do_reclaim = 0;
+	double start, elapsed;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:p:d:r")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'p':
+			pages = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			do_reclaim = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (nr_threads < 1 || pages < 1 || seconds < 1)
+		usage(argv[0]);
+	area_size = (size_t)pages * sysconf(_SC_PAGESIZE);
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers)
+		return 1;
+
+	start = now();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			return 1;
+
+	if (do_reclaim && pthread_create(&shrinker, NULL, shrinker_fn, &runs))
+		return 1;
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (workers[i].error) {
+			fprintf(stderr, "%s: %s\n", ASHMEM_DEV,
+				strerror(workers[i].error));
+			return 1;
+		}
+		pairs += workers[i].pairs;
+		purged += workers[i].purged;
+	}
+	elapsed = now() - start;
+	if (do_reclaim)
+		pthread_join(shrinker, NULL);
+
+	printf("threads %d pages %d: %.0f unpin/pin pairs/s, %lu purged",
+	       nr_threads, pages, pairs / elapsed, purged);
+	if (do_reclaim)
+		printf(", %.0f shrinker runs/s", runs / elapsed);
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,375 @@
+/*
+ * binder-stress - hammer the binder transaction path from many threads
+ *
+ * Forks a server that registers as the binder context manager and echoes
+ * every transaction back as its reply, then starts client threads that
+ * send transactions of random size to it, check the replies and free
+ * their buffers.  With -k the server is killed and restarted periodically,
+ * so that targets die while transactions to them are being copied.  Prints
+ * the number of round trips per second, the dead replies seen and any
+ * corrupted reply.
+ *
+ * Usage: binder-stress [-t threads] [-s size] [-d seconds] [-k ms]
+ *
+ *   -t	number of client threads (default 8)
+ *   -s	maximum transaction size in bytes (default 4096)
+ *   -d	duration in seconds (default 10)
+ *   -k	kill and restart the server every ms milliseconds
+ *
+ * Needs a binder device with no context manager registered yet, that is
+ * a system that is not running Android's servicemanager.
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "binder.h"
+
+#define BINDER_DEV	"/dev/binder"
+#define MAP_SIZE	(1024 * 1024)
+#define SERVER_THREADS	4
+
+static size_t max_size = 4096;
+static volatile int stop;
+
+struct cmd_buf {
+	char data[256];
+	size_t len;
+};
+
+static void put_cmd(struct cmd_buf *c, uint32_t cmd, const void *arg,
+		    size_t len)
+{
+	memcpy(c->data + c->len, &cmd, sizeof(cmd));
+	memcpy(c->data + c->len + sizeof(cmd), arg, len);
+	c->len += sizeof(cmd) + len;
+}
+
+/* Writes out c and reads into rbuf, returns the bytes read or -1 */
+static long write_read(int fd, struct cmd_buf *c, void *rbuf, size_t rsize)
+{
+	struct binder_write_read bwr;
+
+	bwr.write_size = c->len;
+	bwr.write_consumed = 0;
+	bwr.write_buffer = (unsigned long)c->data;
+	bwr.read_size = rsize;
+	bwr.read_consumed = 0;
+	bwr.read_buffer = (unsigned long)rbuf;
+
+	while (ioctl(fd, BINDER_WRITE_READ, &bwr) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	c->len = 0;
+	return bwr.read_consumed;
+}
+
+static int binder_open(void)
+{
+	int fd;
+
+	fd = open(BINDER_DEV, O_RDWR);
+	if (fd < 0)
+		return -1;
+	if (mmap(NULL, MAP_SIZE, PROT_READ, MAP_PRIVATE, fd, 0) == MAP_FAILED) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void *server_thread(void *arg)
+{
+	int fd = (long)arg;
+	struct cmd_buf c = { .len = 0 };
+	char rbuf[1024];
+	long n, off;
+
+	put_cmd(&c, BC_ENTER_LOOPER, NULL, 0);
+	for (;;) {
+		n = write_read(fd, &c, rbuf, sizeof(rbuf));
+		if (n < 0)
+			exit(1);
+
+		for (off = 0; off < n; ) {
+			uint32_t cmd;
+			struct binder_transaction_data txn;
+
+			memcpy(&cmd, rbuf + off, sizeof(cmd));
+			off += sizeof(cmd);
+			if (cmd == BR_TRANSACTION) {
+				const void *buf;
+
+				memcpy(&txn, rbuf + off, sizeof(txn));
+				buf = txn.data.ptr.buffer;
+
+				/* echo the data back, then free it */
+				txn.flags = 0;
+				txn.offsets_size = 0;
+				put_cmd(&c, BC_REPLY, &txn, sizeof(txn));
+				put_cmd(&c, BC_FREE_BUFFER, &buf, sizeof(buf));
+			}
+			off += _IOC_SIZE(cmd);
+		}
+	}
+	return NULL;
+}
+
+static void run_server(void)
+{
+	pthread_t thread;
+	long i;
+	int fd;
+
+	fd = binder_open();
+	if (fd < 0)
+		exit(1);
+
+	/* the previous server may not be released yet */
+	while (ioctl(fd, BINDER_SET_CONTEXT_MGR, 0) < 0) {
+		if (errno != EBUSY)
+			exit(1);
+		usleep(1000);
+	}
+
+	for (i = 1; i < SERVER_THREADS; i++)
+		pthread_create(&thread, NULL, server_thread, (void *)(long)fd);
+	server_thread((void *)(long)fd);
+}
+
+/* Keeps a server running, killing and restarting it every kill_ms */
+static void run_supervisor(int kill_ms)
+{
+	pid_t server;
+
+	for (;;) {
+		server = fork();
+		if (server == 0)
+			run_server();
+		if (!kill_ms) {
+			waitpid(server, NULL, 0);
+			exit(0);
+		}
+		usleep(kill_ms * 1000);
+		kill(server, SIGKILL);
+		waitpid(server, NULL, 0);
+	}
+}
+
+struct client {
+	pthread_t thread;
+	int fd;
+	unsigned int seed;
+	unsigned long round_trips;
+	unsigned long dead;
+	unsigned long corrupt;
+	int error;
+};
+
+static void fill(unsigned char *buf, size_t len, uint32_t seq)
+{
+	size_t i;
+
+	memcpy(buf, &seq, sizeof(seq));
+	for (i = sizeof(seq); i < len; i++)
+		buf[i] = seq + i;
+}
+
+static void *client_thread(void *arg)
+{
+	struct client *cl = arg;
+	struct cmd_buf c = { .len = 0 };
+	struct binder_transaction_data txn;
+	unsigned char *data;
+	char rbuf[1024];
+	uint32_t seq = 0;
+	size_t len;
+
+	data = malloc(max_size);
+	if (!data) {
+		cl->error = ENOMEM;
+		return NULL;
+	}
+
+	while (!stop) {
+		int done = 0;
+
+		len = sizeof(seq) + rand_r(&cl->seed) % (max_size - 3);
+		fill(data, len, ++seq);
+
+		memset(&txn, 0, sizeof(txn));
+		txn.target.handle = 0;
+		txn.code = 1;
+		txn.data_size = len;
+		txn.data.ptr.buffer = data;
+		put_cmd(&c, BC_TRANSACTION, &txn, sizeof(txn));
+
+		while (!done) {
+			long n, off;
+
+			n = write_read(cl->fd, &c, rbuf, sizeof(rbuf));
+			if (n < 0) {
+				cl->error = errno;
+				goto out;
+			}
+
+			for (off = 0; off < n; ) {
+				uint32_t cmd;
+
+				memcpy(&cmd, rbuf + off, sizeof(cmd));
+				off += sizeof(cmd);
+				switch (cmd) {
+				case BR_REPLY: {
+					const void *buf;
+					unsigned char *check;
+
+					memcpy(&txn, rbuf + off, sizeof(txn));
+					buf = txn.data.ptr.buffer;
+					check = malloc(len);
+					if (check)
+						fill(check, len, seq);
+					if (txn.data_size != len ||
+					    (check && memcmp(buf, check, len)))
+						cl->corrupt++;
+					free(check);
+					put_cmd(&c, BC_FREE_BUFFER, &buf,
+						sizeof(buf));
+					cl->round_trips++;
+					done = 1;
+					break;
+				}
+				case BR_DEAD_REPLY:
+				case BR_FAILED_REPLY:
+					cl->dead++;
+					done = 1;
+					break;
+				}
+				off += _IOC_SIZE(cmd);
+			}
+		}
+	}
+
+	/* hand back the last reply buffer */
+	if (c.len)
+		write_read(cl->fd, &c, rbuf, 0);
+out:
+	free(data);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-s size] [-d seconds] "
+		"[-k ms]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct client *clients;
+	unsigned long round_trips = 0, dead = 0, corrupt = 0;
+	int nr_threads = 8, seconds = 10, kill_ms = 0;
+	double start, elapsed;
+	pid_t supervisor;
+	int i, opt, fd;
+
+	while ((opt = getopt(argc, argv, "t:s:d:k:")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			max_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'k':
+			kill_ms = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (nr_threads < 1 || seconds < 1 || kill_ms < 0 || max_size < 4 ||
+	    max_size > MAP_SIZE / 16)
+		usage(argv[0]);
+
+	/* fork before any thread exists or binder is opened */
+	supervisor = fork();
+	if (supervisor < 0)
+		return 1;
+	if (supervisor == 0) {
+		setpgid(0, 0);
+		run_supervisor(kill_ms);
+	}
+	usleep(100000);
+
+	fd = binder_open();
+	if (fd < 0) {
+		perror(BINDER_DEV);
+		kill(-supervisor, SIGKILL);
+		return 1;
+	}
+
+	clients = calloc(nr_threads, sizeof(*clients));
+	if (!clients)
+		return 1;
+
+	start = now();
+	for (i = 0; i < nr_threads; i++) {
+		clients[i].fd = fd;
+		clients[i].seed = i;
+		if (pthread_create(&clients[i].thread, NULL, client_thread,
+				   &clients[i]))
+			return 1;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	/* a client blocked on a dead server gets its dead reply here */
+	kill(-supervisor, SIGKILL);
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(clients[i].thread, NULL);
+		if (clients[i].error)
+			fprintf(stderr, "client %d: %s\n", i,
+				strerror(clients[i].error));
+		round_trips += clients[i].round_trips;
+		dead += clients[i].dead;
+		corrupt += clients[i].corrupt;
+	}
+	elapsed = now() - start;
+	waitpid(supervisor, NULL, 0);
+
+	printf("threads %d size %zu: %.0f round trips/s, %lu dead replies, "
+	       "%lu corrupt\n", nr_threads, max_size, round_trips / elapsed,
+	       dead, corrupt);
+
+	return corrupt ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * logger-bench - measure the write throughput of an Android log
+ *
+ * Starts a number of writer threads that each write fixed size entries
+ * to the log as fast as they can, optionally alongside a reader draining
+ * it, and prints the number of entries written per second.  Comparing
+ * one writer against several shows how well concurrent writers scale.
+ *
+ * Usage: logger-bench [-t threads] [-s payload] [-d seconds] [-r] [log]
+ *
+ *   -t	number of writer threads (default 4)
+ *   -s	payload size of an entry in bytes (default 64)
+ *   -d	duration in seconds (default 5)
+ *   -r	also run a reader that drains the log with read()
+ *   log	log device (default /dev/log/main)
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "logger.h"
+
+static const char *path = "/dev/log/main";
+static size_t payload = 64;
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	unsigned long writes;
+	int error;
+};
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	static const char prio = 4;	/* ANDROID_LOG_INFO */
+	static const char tag[] = "logger-bench";
+	struct iovec iov[3];
+	char *msg;
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0) {
+		w->error = errno;
+		return NULL;
+	}
+
+	msg = malloc(payload);
+	if (!msg) {
+		w->error = ENOMEM;
+		close(fd);
+		return NULL;
+	}
+	memset(msg, 'x', payload - 1);
+	msg[payload - 1] = '\0';
+
+	iov[0].iov_base = (void *)&prio;
+	iov[0].iov_len = 1;
+	iov[1].iov_base = (void *)tag;
+	iov[1].iov_len = sizeof(tag);
+	iov[2].iov_base = msg;
+	iov[2].iov_len = payload;
+
+	while (!stop) {
+		if (writev(fd, iov, 3) < 0) {
+			w->error = errno;
+			break;
+		}
+		w->writes++;
+	}
+
+	free(msg);
+	close(fd);
+	return NULL;
+}
+
+static void *reader_fn(void *arg)
+{
+	unsigned long *reads = arg;
+	char buf[LOGGER_ENTRY_MAX_LEN];
+	int fd;
+
+	fd = open(path, O_RDONLY | O_NONBLOCK);
+	if (fd < 0)
+		return NULL;
+
+	while (!stop) {
+		if (read(fd, buf, sizeof(buf)) > 0)
+			(*reads)++;
+		else if (errno == EAGAIN)
+			usleep(1000);
+		else
+			break;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-s payload] [-d seconds] "
+		"[-r] [log]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct writer *writers;
+	unsigned long total = 0, reads = 0;
+	pthread_t reader;
+	int nr_threads = 4, seconds = 5, do_read = 0;
+	double start, elapsed;
+	int i, opt;
+
+	while ((opt = getopt(argc, argv, "t:s:d:r")) != -1) {
+		switch (opt) {
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 's':
+			payload = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		case 'r':
+			do_read = 1;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+
+	if (nr_threads < 1 || seconds < 1 || payload < 2 ||
+	    payload > LOGGER_ENTRY_MAX_PAYLOAD - 16)
+		usage(argv[0]);
+
+	writers = calloc(nr_threads, sizeof(*writers));
+	if (!writers)
+		return 1;
+
+	if (do_read && pthread_create(&reader, NULL, reader_fn, &reads))
+		return 1;
+
+	start = now();
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&writers[i].thread, NULL, writer_fn,
+				   &writers[i]))
+			return 1;
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(writers[i].thread, NULL);
+		if (writers[i].error) {
+			fprintf(stderr, "%s: %s\n", path,
+				strerror(writers[i].error));
+			return 1;
+		}
+		total += writers[i].writes;
+	}
+	elapsed = now() - start;
+	if (do_read)
+		pthread_join(reader, NULL);
+
+	printf("threads %d payload %zu: %.0f writes/s", nr_threads, payload,
+	       total / elapsed);
+	if (do_read)
+		printf(", %.0f reads/s", reads / elapsed);
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * zram-bench - measure how zram write throughput scales with writers
+ *
+ * Runs rounds of 1, 2, 4, ... up to the given number of writer threads.
+ * Each thread owns a slice of the device and writes pages to it with
+ * O_DIRECT as fast as it can, and each round prints the throughput in
+ * MB/s, in total and per thread.  Pages are half random and half zero,
+ * so every write goes through the compressor.  With more compression
+ * streams than writers the total should grow with the thread count.
+ *
+ * Usage: zram-bench [-t threads] [-d seconds] [dev]
+ *
+ *   -t	maximum number of writer threads (default: online cpus)
+ *   -d	duration of each round in seconds (default 5)
+ *   dev	zram device (default /dev/block/zram0)
+ *
+ * The device must be initialized (disksize set) and not in use, its
+ * contents are overwritten.  Set max_comp_streams before running.
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+static const char *path = "/dev/block/zram0";
+static size_t page_size;
+static volatile int stop;
+
+struct writer {
+	pthread_t thread;
+	off_t start;
+	size_t pages;
+	unsigned long writes;
+	int error;
+};
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned int seed = w->start / page_size;
+	unsigned char *buf;
+	size_t i, page = 0;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_DIRECT);
+	if (fd < 0) {
+		w->error = errno;
+		return NULL;
+	}
+
+	if (posix_memalign((void **)&buf, page_size, page_size)) {
+		w->error = ENOMEM;
+		close(fd);
+		return NULL;
+	}
+	memset(buf, 0, page_size);
+	for (i = 0; i < page_size / 2; i++)
+		buf[i] = rand_r(&seed);
+
+	while (!stop) {
+		/* keep consecutive pages different */
+		memcpy(buf, &w->writes, sizeof(w->writes));
+		if (pwrite(fd, buf, page_size,
+			   w->start + page * page_size) != (ssize_t)page_size) {
+			w->error = errno ? errno : EIO;
+			break;
+		}
+		w->writes++;
+		if (++page == w->pages)
+			page = 0;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the total throughput of nr_threads writers in MB/s, -1 on error */
+static double run(int nr_threads, int seconds, uint64_t dev_size)
+{
+	struct writer *writers;
+	size_t slice = dev_size / page_size / nr_threads;
+	unsigned long writes = 0;
+	double start, elapsed;
+	int i, error = 0;
+
+	writers = calloc(nr_threads, sizeof(*writers));
+	if (!writers)
+		return -1;
+
+	stop = 0;
+	start = now();
+	for (i = 0; i < nr_threads; i++) {
+		writers[i].start = (off_t)i * slice * page_size;
+		writers[i].pages = slice;
+		if (pthread_create(&writers[i].thread, NULL, writer_fn,
+				   &writers[i])) {
+			stop = 1;
+			nr_threads = i;
+			error = EAGAIN;
+			break;
+		}
+	}
+
+	if (!error)
+		sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(writers[i].thread, NULL);
+		if (writers[i].error)
+			error = writers[i].error;
+		writes += writers[i].writes;
+	}
+	elapsed = now() - start;
+	free(writers);
+
+	if (error) {
+		fprintf(stderr, "%s: %s\n", path, strerror(error));
+		return -1;
+	}
+	return writes * page_size / elapsed / (1024 * 1024);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads] [-d seconds] [dev]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN), seconds = 5;
+	uint64_t dev_size;
+	double mbs;
+	int nr, opt, fd;
+
+	while ((opt = getopt(argc, argv, "t:d:")) != -1) {
+		switch (opt) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+
+	if (max_threads < 1 || seconds < 1)
+		usage(argv[0]);
+	page_size = sysconf(_SC_PAGESIZE);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &dev_size) < 0) {
+		perror(path);
+		return 1;
+	}
+	close(fd);
+
+	if (dev_size / page_size < (uint64_t)max_threads) {
+		fprintf(stderr, "%s: too small for %d threads\n", path,
+			max_threads);
+		return 1;
+	}
+
+	for (nr = 1; ; nr = nr * 2 < max_threads ? nr * 2 : max_threads) {
+		mbs = run(nr, seconds, dev_size);
+		if (mbs < 0)
+			return 1;
+		printf("threads %d: %.1f MB/s, %.1f MB/s per thread\n", nr,
+		       mbs, mbs / nr);
+		if (nr == max_threads)
+			break;
+	}
+
+	return 0;
+}
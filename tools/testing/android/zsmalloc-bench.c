@@ -0,0 +1,251 @@
+/*
+ * zsmalloc-bench - time zram reads of objects that span two pages
+ *
+ * Fills a zram device with pages that compress to a given size, chosen
+ * so that most objects straddle a page boundary inside their zspage,
+ * then reads them back with O_DIRECT from a number of threads and
+ * prints the read throughput and the time per page.  Each such read
+ * maps a spanning object through zs_map_object(), so running it on
+ * kernels built with and without CONFIG_ZSMALLOC_PGTABLE_MAPPING
+ * compares the page table and the copy mapping modes.
+ *
+ * Usage: zsmalloc-bench [-n pages] [-c bytes] [-t threads] [-d seconds]
+ *		[dev]
+ *
+ *   -n	number of pages to fill (default: the whole device)
+ *   -c	incompressible bytes per page, roughly the object size
+ *	(default 2600)
+ *   -t	number of reader threads (default 1)
+ *   -d	duration in seconds (default 5)
+ *   dev	zram device (default /dev/block/zram0)
+ *
+ * The device must be initialized (disksize set) and not in use, its
+ * contents are overwritten.  The average object size is taken from the
+ * device's compr_data_size and orig_data_size attributes.
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include <linux/fs.h>
+
+static const char *path = "/dev/block/zram0";
+static size_t page_size;
+static size_t nr_pages;
+static volatile int stop;
+
+struct reader {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned long reads;
+	int error;
+};
+
+static int fill(size_t random_bytes)
+{
+	unsigned int seed = 1;
+	unsigned char *buf;
+	size_t page, i;
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY | O_DIRECT);
+	if (fd < 0)
+		return -1;
+	if (posix_memalign((void **)&buf, page_size, page_size)) {
+		close(fd);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	memset(buf, 0, page_size);
+	for (page = 0; page < nr_pages; page++) {
+		for (i = 0; i < random_bytes; i++)
+			buf[i] = rand_r(&seed);
+		if (pwrite(fd, buf, page_size, page * page_size) !=
+		    (ssize_t)page_size) {
+			ret = -1;
+			break;
+		}
+	}
+
+	free(buf);
+	close(fd);
+	return ret;
+}
+
+static void *reader_fn(void *arg)
+{
+	struct reader *r = arg;
+	unsigned char *buf;
+	size_t page;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_DIRECT);
+	if (fd < 0) {
+		r->error = errno;
+		return NULL;
+	}
+	if (posix_memalign((void **)&buf, page_size, page_size)) {
+		r->error = ENOMEM;
+		close(fd);
+		return NULL;
+	}
+
+	while (!stop) {
+		page = rand_r(&r->seed) % nr_pages;
+		if (pread(fd, buf, page_size, page * page_size) !=
+		    (ssize_t)page_size) {
+			r->error = errno ? errno : EIO;
+			break;
+		}
+		r->reads++;
+	}
+
+	free(buf);
+	close(fd);
+	return NULL;
+}
+
+/* Reads a numeric attribute of the zram device, 0 if it is not there */
+static unsigned long long zram_attr(const char *name)
+{
+	char file[256], *dev;
+	unsigned long long val = 0;
+	FILE *f;
+
+	dev = strdup(path);
+	if (!dev)
+		return 0;
+	snprintf(file, sizeof(file), "/sys/block/%s/%s", basename(dev), name);
+	free(dev);
+
+	f = fopen(file, "r");
+	if (!f)
+		return 0;
+	if (fscanf(f, "%llu", &val) != 1)
+		val = 0;
+	fclose(f);
+	return val;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-n pages] [-c bytes] [-t threads] "
+		"[-d seconds] [dev]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct reader *readers;
+	unsigned long reads = 0;
+	unsigned long long compr, orig;
+	size_t random_bytes = 2600;
+	int nr_threads = 1, seconds = 5;
+	double start, elapsed;
+	uint64_t dev_size;
+	struct utsname uts;
+	int i, opt, fd;
+
+	while ((opt = getopt(argc, argv, "n:c:t:d:")) != -1) {
+		switch (opt) {
+		case 'n':
+			nr_pages = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			random_bytes = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			seconds = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind < argc)
+		path = argv[optind];
+
+	page_size = sysconf(_SC_PAGESIZE);
+	if (nr_threads < 1 || seconds < 1 || random_bytes > page_size)
+		usage(argv[0]);
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || ioctl(fd, BLKGETSIZE64, &dev_size) < 0) {
+		perror(path);
+		return 1;
+	}
+	close(fd);
+
+	if (!nr_pages || nr_pages > dev_size / page_size)
+		nr_pages = dev_size / page_size;
+	if (!nr_pages)
+		usage(argv[0]);
+
+	if (fill(random_bytes) < 0) {
+		perror(path);
+		return 1;
+	}
+
+	readers = calloc(nr_threads, sizeof(*readers));
+	if (!readers)
+		return 1;
+
+	start = now();
+	for (i = 0; i < nr_threads; i++) {
+		readers[i].seed = i + 1;
+		if (pthread_create(&readers[i].thread, NULL, reader_fn,
+				   &readers[i]))
+			return 1;
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(readers[i].thread, NULL);
+		if (readers[i].error) {
+			fprintf(stderr, "%s: %s\n", path,
+				strerror(readers[i].error));
+			return 1;
+		}
+		reads += readers[i].reads;
+	}
+	elapsed = now() - start;
+
+	uname(&uts);
+	compr = zram_attr("compr_data_size");
+	orig = zram_attr("orig_data_size");
+
+	printf("%s %s\n", uts.release, uts.version);
+	printf("pages %zu", nr_pages);
+	if (compr && orig)
+		printf(", object size %llu", compr / (orig / page_size));
+	printf("\nthreads %d: %.1f MB/s, %.2f us per page\n", nr_threads,
+	       reads * page_size / elapsed / (1024 * 1024),
+	       elapsed * 1e6 * nr_threads / reads);
+
+	return 0;
+}
@@ -0,0 +1,93 @@
+#!/bin/sh
+#
+# governor-wakeups.sh - count idle wakeups under cpufreq governors
+#
+# Switches every online cpu to each of the given governors in turn, lets
+# the system sit idle and prints, per governor, the local timer
+# interrupts and cpuidle state entries per second, summed over all cpus.
+# Run it on an otherwise idle device, screen off, on the kernels to
+# compare.
+#
+# Usage: governor-wakeups.sh [-d seconds] [-s settle] [governor...]
+#
+#   -d		measuring time per governor in seconds (default 60)
+#   -s		time to settle after switching governors (default 10)
+#   governor	governors to compare
+#		(default: interactive dyninteractive intelliactive)
+#
+# Needs root to switch governors.  Local timer interrupts are the "LOC"
+# line of /proc/interrupts, the cpuidle entries are read from
+# /sys/devices/system/cpu/cpu*/cpuidle when cpuidle is enabled.
+#
+# Licensed under the terms of the GNU GPL License version 2.
+
+seconds=60
+settle=10
+
+usage()
+{
+	echo "usage: $0 [-d seconds] [-s settle] [governor...]" >&2
+	exit 1
+}
+
+while getopts "d:s:" opt; do
+	case $opt in
+	d) seconds=$OPTARG ;;
+	s) settle=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+governors=${*:-"interactive dyninteractive intelliactive"}
+
+cpufreq=/sys/devices/system/cpu/cpu0/cpufreq
+[ -w $cpufreq/scaling_governor ] || {
+	echo "cannot write $cpufreq/scaling_governor" >&2
+	exit 1
+}
+
+orig_gov=$(cat $cpufreq/scaling_governor)
+trap 'set_governor "$orig_gov"' EXIT INT TERM
+
+set_governor()
+{
+	for f in /sys/devices/system/cpu/cpu*/cpufreq/scaling_governor; do
+		[ -w "$f" ] || continue
+		echo "$1" > "$f" 2> /dev/null || return 1
+	done
+}
+
+local_timer_irqs()
+{
+	awk '$1 == "LOC:" {
+		for (i = 2; i <= NF && $i ~ /^[0-9]+$/; i++)
+			sum += $i
+	} END { print sum + 0 }' /proc/interrupts
+}
+
+idle_entries()
+{
+	cat /sys/devices/system/cpu/cpu*/cpuidle/state*/usage 2> /dev/null |
+		awk '{ sum += $1 } END { print sum + 0 }'
+}
+
+printf "%-16s %10s %10s\n" governor loc/s idle/s
+
+for gov in $governors; do
+	if ! set_governor "$gov"; then
+		echo "$gov: not available, skipped" >&2
+		continue
+	fi
+	sleep "$settle"
+
+	loc=$(local_timer_irqs)
+	idle=$(idle_entries)
+	sleep "$seconds"
+	loc=$(($(local_timer_irqs) - loc))
+	idle=$(($(idle_entries) - idle))
+
+	printf "%-16s %10s %10s\n" "$gov" \
+		"$(awk "BEGIN { printf \"%.1f\", $loc / $seconds }")" \
+		"$(awk "BEGIN { printf \"%.1f\", $idle / $seconds }")"
+done
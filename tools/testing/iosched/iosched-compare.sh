@@ -0,0 +1,101 @@
+#!/bin/sh
+#
+# iosched-compare.sh - compare I/O schedulers with fio
+#
+# Runs the same set of fio jobs on a block device under each of the given
+# I/O schedulers and prints, per scheduler and job, the read and write
+# bandwidth (KB/s), IOPS and the p50/p99 completion latency (usec).
+#
+# Usage: iosched-compare.sh [-r runtime] [-s size] <device> <directory>
+#		[scheduler...]
+#
+#   device	block device name as found in /sys/block (eg: mmcblk0)
+#   directory	scratch directory on a filesystem of that device
+#   scheduler	schedulers to compare (default: noop deadline sio zen)
+#
+# Needs root (to switch the scheduler and drop caches) and fio >= 2.0 for
+# its terse (--minimal) version 3 output.
+#
+# Licensed under the terms of the GNU GPL License version 2.
+
+runtime=30
+size=256m
+
+usage()
+{
+	echo "usage: $0 [-r runtime] [-s size] <device> <directory>" \
+	     "[scheduler...]" >&2
+	exit 1
+}
+
+while getopts "r:s:" opt; do
+	case $opt in
+	r) runtime=$OPTARG ;;
+	s) size=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+[ $# -ge 2 ] || usage
+dev=$1
+dir=$2
+shift 2
+scheds=${*:-"noop deadline sio zen"}
+
+sched_file=/sys/block/$dev/queue/scheduler
+[ -w "$sched_file" ] || { echo "cannot write $sched_file" >&2; exit 1; }
+[ -d "$dir" ] || { echo "no such directory: $dir" >&2; exit 1; }
+command -v fio > /dev/null || { echo "fio not found" >&2; exit 1; }
+
+orig_sched=$(sed -e 's/.*\[\(.*\)\].*/\1/' "$sched_file")
+trap 'echo "$orig_sched" > "$sched_file"; rm -f "$dir"/iosched-compare.*' \
+	EXIT INT TERM
+
+# name:fio arguments
+jobs="seqread:--rw=read --bs=128k
+seqwrite:--rw=write --bs=128k
+randread:--rw=randread --bs=4k
+randwrite:--rw=randwrite --bs=4k
+mixed:--rw=randrw --rwmixread=70 --bs=4k --numjobs=4 --group_reporting"
+
+#
+# Terse v3 fields: 7/8 read bw/iops, 24/30 read clat p50/p99,
+# 48/49 write bw/iops, 65/71 write clat p50/p99. Percentiles are
+# printed as "<percentile>%=<usec>".
+#
+parse()
+{
+	awk -F';' '
+	function pct(f) { sub(/.*=/, "", f); return f }
+	$1 == "3" {
+		printf "%10s %8s %8s %8s %10s %8s %8s %8s\n",
+			$7, $8, pct($24), pct($30),
+			$48, $49, pct($65), pct($71)
+		exit
+	}'
+}
+
+printf "%-10s %-10s %10s %8s %8s %8s %10s %8s %8s %8s\n" \
+	sched job rd_kb/s rd_iops rd_p50 rd_p99 \
+	wr_kb/s wr_iops wr_p50 wr_p99
+
+for sched in $scheds; do
+	if ! echo "$sched" > "$sched_file" 2> /dev/null; then
+		echo "$sched: not available on $dev, skipped" >&2
+		continue
+	fi
+
+	echo "$jobs" | while IFS=: read -r name args; do
+		sync
+		echo 3 > /proc/sys/vm/drop_caches
+
+		# shellcheck disable=SC2086
+		result=$(fio --minimal --name="$name" \
+			--filename="$dir/iosched-compare.$name" \
+			--size="$size" --runtime="$runtime" --time_based \
+			--ioengine=psync --direct=1 $args | parse)
+
+		printf "%-10s %-10s %s\n" "$sched" "$name" "$result"
+	done
+done